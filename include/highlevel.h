@@ -36,6 +36,35 @@ struct hdfs_namenode *	hdfs_namenode_new_version(const char *host,
 // Tears down the connection and frees memory.
 void			hdfs_namenode_delete(struct hdfs_namenode *);
 
+// A pool of 'nconns' connections to the same namenode, for multi-threaded
+// clients that would otherwise serialize on one socket and one receive thread.
+// Each invoke is routed to the connection with the fewest outstanding RPCs.
+// Connections that break are replaced in the background (retried every
+// HDFS_POOL_RECONNECT_MS, or sooner when an invoke notices the breakage).
+//
+// All connections are established up front; on error, returns NULL and sets
+// *error_out.
+#define HDFS_POOL_RECONNECT_MS 1000
+struct hdfs_namenode_pool *	hdfs_namenode_pool_new(const char *host,
+				const char *port, const char *username,
+				enum hdfs_kerb, enum hdfs_namenode_proto,
+				int nconns, const char **error_out);
+
+// Caller must not have any invokes in progress, or connections gotten from
+// the pool and not yet put back.
+void			hdfs_namenode_pool_delete(struct hdfs_namenode_pool *);
+
+// As hdfs_namenode_invoke(), on the least loaded connection.
+const char *		hdfs_namenode_pool_invoke(struct hdfs_namenode_pool *,
+			struct hdfs_object *, struct hdfs_rpc_response_future *);
+
+// For the high-level RPC routines below: borrow the least loaded connection,
+// and give it back afterwards. Returns NULL if no connection is currently
+// usable.
+struct hdfs_namenode *	hdfs_namenode_pool_get(struct hdfs_namenode_pool *);
+void			hdfs_namenode_pool_put(struct hdfs_namenode_pool *,
+			struct hdfs_namenode *);
+
 static inline bool
 hdfs_object_is_null(struct hdfs_object *o)
 {
@@ -137,6 +166,13 @@ bool			hdfs_mkdirs(struct hdfs_namenode *, const char *path,
 struct hdfs_object *	hdfs_getListing(struct hdfs_namenode *, const char *path,
 			struct hdfs_object *begin, struct hdfs_object **exception_out);
 
+// Like hdfs_getListing(), as a compact hdfs_listing_table. With lazy decode
+// (HDFSv2+), the table is built straight from the response. Returns NULL with
+// *exception_out NULL if 'path' doesn't exist.
+struct hdfs_listing_table *	hdfs_getListing_table(struct hdfs_namenode *,
+			const char *path, struct hdfs_object *begin,
+			struct hdfs_object **exception_out);
+
 void			hdfs_renewLease(struct hdfs_namenode *, const char *client,
 			struct hdfs_object **exception_out);
 
@@ -233,6 +269,11 @@ struct hdfs_object *	hdfs2_getLinkTarget(struct hdfs_namenode *, const char *,
 
 // Creates a new datanode connection. On error, returns NULL and sets
 // *error_out to an error message.
+//
+// Writes default to CRC32 checksums; the cluster's type isn't looked up here.
+// HDFSv2 writers (most clusters default to CRC32C) should pass the
+// _checksumtype from hdfs2_getServerDefaults() to
+// hdfs_datanode_set_checksum_type() before writing.
 struct hdfs_datanode *	hdfs_datanode_new(struct hdfs_object *located_block,
 			const char *client, int proto, const char **error_out);
 
@@ -21,34 +21,62 @@
 #include <hadoofus/objects.h>
 
 struct hdfs_namenode;
+struct hdfs_namenode_pool;
+struct hdfs_reactor;
 struct _hdfs_pending;
+struct _hdfs_sendq_frame;
+
+// Receive buffer: bytes [rb_off, rb_used) of rb_buf have been received but not
+// yet consumed.
+struct _hdfs_rbuf {
+	char *rb_buf;
+	size_t rb_off,
+	       rb_used,
+	       rb_size;
+};
+
+// Progress of the receiver through a (not length-prefixed) v1 response that
+// has only partly arrived; see _hdfs_result_scan().
+struct _hdfs_v1_scan {
+	int vs_off,		// 0 until the response header has been scanned
+	    vs_list;
+	int32_t vs_left;	// elements left after vs_off; -1 before the count
+};
 
 typedef void (*hdfs_namenode_destroy_cb)(struct hdfs_namenode *);
+typedef void (*hdfs_rpc_callback)(struct hdfs_object *result, void *ctx);
 
 struct hdfs_namenode {
 	pthread_mutex_t nn_lock;
 	int64_t nn_msgno;
-	char *nn_recvbuf,
-	     *nn_objbuf;
+	struct _hdfs_rbuf nn_recvbuf,
+			  nn_objbuf;
 	hdfs_namenode_destroy_cb nn_destroy_cb;
 	struct _hdfs_pending *nn_pending;
 	sasl_conn_t *nn_sasl_ctx;
 	int nn_refs,
 	    nn_sock,
 	    nn_pending_len,
+	    nn_pending_size,
 	    nn_sasl_ssf;
 	enum hdfs_kerb nn_kerb;
 	bool nn_dead/*user-killed*/,
 	     nn_authed,
 	     nn_recver_started;
-	pthread_mutex_t nn_sendlock;
-	size_t nn_recvbuf_used,
-	       nn_recvbuf_size,
-	       nn_objbuf_used,
-	       nn_objbuf_size;
+	size_t nn_recvbuf_hiwat;
+	bool nn_arena_results,
+	     nn_lazy_decode;
+	struct _hdfs_v1_scan nn_v1_scan;
+
+	// Outgoing frames; see src/sendq.h.
+	struct _hdfs_sendq_frame *nn_sendq;
+	const char *nn_send_error;
+	uint64_t nn_send_syscalls;
+	bool nn_sending;
 
 	pthread_t nn_recv_thr;
-	int nn_recv_sigpipe[2];
+	struct hdfs_reactor *nn_reactor;
+	bool nn_recv_detached;
 
 	enum hdfs_namenode_proto nn_proto;
 	uint8_t nn_client_id[_HDFS_CLIENT_ID_LEN];
@@ -65,10 +93,15 @@ struct hdfs_datanode {
 	char *dn_client;
 	int dn_sock,
 	    dn_proto;
-	bool dn_used;
+	bool dn_used,
+	     dn_cached,		/* dn_sock came from the connection cache */
+	     dn_reusable;	/* ... and can go back to it */
+	char *dn_host,
+	     *dn_port;
 
 	/* v2+ */
 	char *dn_pool_id;
+	enum hdfs_checksum_type dn_csum;
 };
 
 struct hdfs_rpc_response_future {
@@ -76,6 +109,12 @@ struct hdfs_rpc_response_future {
 	pthread_cond_t fu_cond;
 	struct hdfs_object *fu_res;
 	struct hdfs_namenode *fu_namenode;
+
+	// Lazy decode: the undecoded response, and how to decode it
+	void *fu_raw;
+	size_t fu_rawlen;
+	struct hdfs_object *(*fu_slurper)(struct hdfs_heap_buf *, bool);
+	bool fu_arena;
 };
 
 //
@@ -88,6 +127,7 @@ struct hdfs_rpc_response_future {
 		.fu_cond = PTHREAD_COND_INITIALIZER,	\
 		.fu_res = NULL,				\
 		.fu_namenode = NULL,			\
+		.fu_raw = NULL,				\
 	}
 
 static inline void
@@ -110,6 +150,7 @@ hdfs_rpc_response_future_init(struct hdfs_rpc_response_future *future)
 	}
 	future->fu_res = NULL;
 	future->fu_namenode = NULL;
+	future->fu_raw = NULL;
 }
 
 // Allocate a namenode object. (This allows us to add fields to hdfs_namenode
@@ -136,6 +177,18 @@ void		hdfs_namenode_init(struct hdfs_namenode *, enum hdfs_kerb);
 //   HDFS_NN_v2_2      -- v2.2
 void		hdfs_namenode_set_version(struct hdfs_namenode *, enum hdfs_namenode_proto);
 
+// By default, each namenode connection gets its own receive thread once the
+// first RPC is invoked. Alternatively, a connection may be serviced by a
+// reactor: a fixed pool of threads shared by many connections (Linux only).
+// The reactor must be set before the first RPC is invoked, and must outlive
+// every namenode attached to it (i.e., until their hdfs_namenode_destroy()
+// callbacks have run).
+//
+// Futures are completed on reactor threads.
+struct hdfs_reactor *	hdfs_reactor_new(int nthreads, const char **error_out);
+void		hdfs_reactor_destroy(struct hdfs_reactor *);
+void		hdfs_namenode_set_reactor(struct hdfs_namenode *, struct hdfs_reactor *);
+
 // Connect to the given host/port. You should only use this on a freshly
 // initialized namenode object (don't re-use the same object until it's been
 // destroyed / re-initialized).
@@ -148,18 +201,86 @@ const char *	hdfs_namenode_authenticate_full(struct hdfs_namenode *,
 
 int64_t		hdfs_namenode_get_msgno(struct hdfs_namenode *);
 
+// Returns NULL if the connection is usable (as far as we know), or else a
+// description of why it isn't.
+const char *	hdfs_namenode_get_error(struct hdfs_namenode *);
+
+// Receive buffers grow as needed to hold a whole response, but are trimmed
+// back to this size once an oversized response has been consumed. Defaults to
+// HDFS_NN_RECVBUF_HIWAT.
+#define HDFS_NN_RECVBUF_HIWAT (64*1024)
+void		hdfs_namenode_set_recvbuf_hiwat(struct hdfs_namenode *, size_t);
+
+// Arena mode (HDFSv2+): each decoded response lives in a single arena, which
+// is released when the result is freed. This avoids hundreds of malloc and
+// free calls per block location or directory listing result. File status,
+// listing and block location results are also decoded without protobuf-c,
+// with their strings pointing into the arena's copy of the response. See
+// hdfs_object_free() for what this means for the result objects. Off by
+// default.
+void		hdfs_namenode_set_arena_results(struct hdfs_namenode *, bool);
+
+// Lazy decode (HDFSv2+): the receive thread only frames each response to an
+// rpc invoked with a future, and leaves decoding it to hdfs_future_get(), on
+// the caller's thread. A connection's decode work is then spread over the
+// threads waiting on it, instead of all running on its receive thread. (See
+// also hdfs_future_get_raw().) Callbacks still get decoded results. Off by
+// default.
+void		hdfs_namenode_set_lazy_decode(struct hdfs_namenode *, bool);
+
 // The caller must initialize the future object before invoking the rpc. Once
 // this routine is called, the future belongs to this library until one of two
 // things happens:
 //   1) hdfs_future_get() on that future returns, or:
 //   2) hdfs_namenode_destroy()'s user callback is invoked.
+//
+// If the connection breaks (socket error, the namenode hangs up, or garbage on
+// the wire), every outstanding rpc completes right away with an
+// H_IPC_EXCEPTION, and further invokes return an error without sending
+// anything. Once an invoke has returned NULL, its future (or callback) is
+// always completed.
 const char *	hdfs_namenode_invoke(struct hdfs_namenode *, struct hdfs_object *,
 		struct hdfs_rpc_response_future *);
 
+// Invoke 'count' rpcs at once. futures[i] receives the response to rpcs[i];
+// each future is subject to the same rules as for hdfs_namenode_invoke(). The
+// rpcs get consecutive msgnos and are transmitted with a single writev(2), so
+// this is much cheaper than invoking them one at a time for bulk work.
+const char *	hdfs_namenode_invoke_batch(struct hdfs_namenode *,
+		struct hdfs_object **rpcs, struct hdfs_rpc_response_future **futures,
+		int count);
+
+// Invoke an rpc without a future: 'cb' is called with the result object (or
+// exception) and 'ctx' once the response arrives. The callback owns the
+// result and must free it.
+//
+// Threading contract:
+//   - Callbacks run on the connection's receive thread (or a reactor thread),
+//     with no library locks held. Responses on one connection are delivered
+//     one at a time, in the order they arrive.
+//   - A callback may invoke further rpcs, on this connection or others.
+//   - A callback should not block: while it runs, no other responses on the
+//     connection (or, with a reactor, on that reactor thread) are processed.
+//   - A callback must not destroy the namenode that invoked it.
+//   - Unlike futures, outstanding callbacks don't keep the namenode alive. If
+//     it is destroyed first, each is called once with an H_IPC_EXCEPTION
+//     before the destroy callback runs.
+const char *	hdfs_namenode_invoke_cb(struct hdfs_namenode *, struct hdfs_object *,
+		hdfs_rpc_callback cb, void *ctx);
+
 // After this returns, caller can do whatever they like with the "future"
 // object.
 void		hdfs_future_get(struct hdfs_rpc_response_future *, struct hdfs_object **);
 
+// Like hdfs_future_get(), but a response left undecoded by lazy decode stays
+// that way: the response message (for HDFSv2+, the method's <Foo>ResponseProto)
+// is handed to the caller as a malloc'd buffer in *raw_out and *rawlen_out, and
+// *object is set to NULL. Use this to skip decoding responses that are
+// ignored anyway, e.g. renewLease or setTimes. Otherwise (exceptions, or
+// without lazy decode), *raw_out is NULL and *object is the result.
+void		hdfs_future_get_raw(struct hdfs_rpc_response_future *,
+		struct hdfs_object **, void **raw_out, size_t *rawlen_out);
+
 // Returns 'false' if the RPC received no response in the time limit. The
 // Namenode object still references the future.
 // If 'true' is returned, same result as hdfs_future_get.
@@ -191,8 +312,16 @@ void		hdfs_datanode_init(struct hdfs_datanode *,
 // Sets the pool_id (required in HDFSv2+)
 void		hdfs_datanode_set_pool_id(struct hdfs_datanode *, const char *);
 
+// Sets the checksum type for writes (HDFSv2+; v1 always uses CRC32). Writers
+// should use the cluster's, from hdfs2_getServerDefaults(); the library never
+// looks it up itself. The default is HDFS_CSUM_CRC32. Reads use whatever the
+// datanode sends.
+void		hdfs_datanode_set_checksum_type(struct hdfs_datanode *,
+		enum hdfs_checksum_type);
+
 // Attempt to connect to a host and port. Should only be called on a freshly-
-// initialized datanode struct.
+// initialized datanode struct. HDFSv2 connections may be reused from the
+// connection cache (below).
 const char *	hdfs_datanode_connect(struct hdfs_datanode *, const char *host,
 		const char *port);
 
@@ -219,9 +348,33 @@ const char *	hdfs_datanode_read(struct hdfs_datanode *d, size_t off, size_t len,
 const char *	hdfs_datanode_read_file(struct hdfs_datanode *, off_t bloff,
 		off_t len, int fd, off_t fdoff, bool verifycrc);
 
+// As hdfs_datanode_read_file(), but maps the destination region of the file
+// and receives the block directly into it, instead of writing each packet out.
+// The fd must be open for reading and writing, and the file is extended to
+// fdoff+len first if needed; if the read then fails, it is truncated back to
+// its old size. (Whether this beats the copy depends on the
+// filesystem's page-fault costs; on Linux, reads to file without CRC
+// verification already avoid the copy via splice(2).)
+const char *	hdfs_datanode_read_file_mmap(struct hdfs_datanode *,
+		off_t bloff, off_t len, int fd, off_t fdoff, bool verifycrc);
+
 // Destroys a datanode object (caller should free).
 void		hdfs_datanode_destroy(struct hdfs_datanode *);
 
+// HDFSv2 datanodes keep a connection open after a successful read. Such
+// connections are put in a process-wide cache when their datanode object is
+// destroyed, and reused by later connects to the same host and port. (A
+// datanode object can also do further reads on it meanwhile.) At most
+// 'capacity' idle connections are kept in all, 'per_datanode' to any one
+// datanode, each for 'idle_ms'; keep that below the datanodes'
+// dfs.datanode.socket.reuse.keepalive. A capacity of zero disables the cache.
+// Closes any connections already cached.
+#define HDFS_DATANODE_CACHE_CAPACITY 16
+#define HDFS_DATANODE_CACHE_PER_DATANODE 8
+#define HDFS_DATANODE_CACHE_IDLE_MS 3000
+void		hdfs_datanode_cache_configure(int capacity, int per_datanode,
+		int idle_ms);
+
 // Error returned on reads if the user requested CRC validation but the server
 // did not transmit CRCs.
 extern const char *HDFS_DATANODE_ERR_NO_CRCS;
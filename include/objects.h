@@ -2,6 +2,7 @@
 #define HADOOFUS_OBJECTS_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -107,7 +108,67 @@ enum hdfs_object_type {
 
 const char *	hdfs_etype_to_string(enum hdfs_object_type e);
 
+/*
+ * Namenode RPC methods known to this library (across v1, v2 and v2.2). Each
+ * expands to an HDFS_RPC_<method> enum value; the method name is the same
+ * string the wire protocols use.
+ */
+#define HDFS_RPC_METHODS(X) \
+	X(abandonBlock) \
+	X(addBlock) \
+	X(append) \
+	X(cancelDelegationToken) \
+	X(complete) \
+	X(concat) \
+	X(create) \
+	X(createSymlink) \
+	X(delete) \
+	X(distributedUpgradeProgress) \
+	X(finalizeUpgrade) \
+	X(fsync) \
+	X(getBlockLocations) \
+	X(getContentSummary) \
+	X(getDatanodeReport) \
+	X(getDelegationToken) \
+	X(getFileInfo) \
+	X(getFileLinkInfo) \
+	X(getLinkTarget) \
+	X(getListing) \
+	X(getPreferredBlockSize) \
+	X(getProtocolVersion) \
+	X(getServerDefaults) \
+	X(getStats) \
+	X(isFileClosed) \
+	X(metaSave) \
+	X(mkdirs) \
+	X(recoverLease) \
+	X(refreshNodes) \
+	X(rename) \
+	X(renewDelegationToken) \
+	X(renewLease) \
+	X(reportBadBlocks) \
+	X(saveNamespace) \
+	X(setBalancerBandwidth) \
+	X(setOwner) \
+	X(setPermission) \
+	X(setQuota) \
+	X(setReplication) \
+	X(setSafeMode) \
+	X(setTimes)
+
+enum hdfs_rpc_method {
+	/* hdfs_rpc_invocation_new() with a name not in HDFS_RPC_METHODS */
+	HDFS_RPC_UNKNOWN = 0,
+#define _HDFS_RPC_ENUM(method) HDFS_RPC_ ## method,
+	HDFS_RPC_METHODS(_HDFS_RPC_ENUM)
+#undef _HDFS_RPC_ENUM
+	_HDFS_RPC_END,
+};
+
+const char *	hdfs_rpc_method_to_string(enum hdfs_rpc_method m);
+
 struct hdfs_object;
+struct _hdfs_arena;
 
 /*
  * Users should not use these structs directly, or even access them directly
@@ -234,7 +295,8 @@ struct hdfs_array_byte {
 
 struct hdfs_rpc_invocation {
 	struct hdfs_object *_args[8];
-	char *_method;
+	enum hdfs_rpc_method _method_id;
+	char *_method;		/* static name, unless _method_id is UNKNOWN */
 	int _nargs,
 	    _msgno;
 
@@ -335,6 +397,11 @@ struct hdfs_object {
 		struct hdfs_fsserverdefaults _server_defaults;
 	} ob_val;
 	enum hdfs_object_type ob_type;
+	uint32_t ob_refs;	/* references beyond the first (in an arena,
+				   those taken on a non-root object) */
+
+	/* Non-NULL if this is part of a response decoded into an arena. */
+	struct _hdfs_arena *ob_arena;
 };
 
 // These functions copy user-supplied values.
@@ -373,6 +440,7 @@ struct hdfs_object *	hdfs_array_string_new(int32_t len, const char **strings); /
 void			hdfs_array_string_add(struct hdfs_object *, const char *); /* copies */
 struct hdfs_object *	hdfs_array_string_copy(struct hdfs_object *);
 struct hdfs_object *	hdfs_rpc_invocation_new(const char *name, ...);
+struct hdfs_object *	hdfs_rpc_invocation_new_method(enum hdfs_rpc_method, ...);
 struct hdfs_object *	hdfs_authheader_new(const char *user);
 struct hdfs_object *	hdfs_authheader_new_ext(enum hdfs_namenode_proto,
 			const char * /*user*/, const char * /*real user*/,
@@ -424,6 +492,157 @@ struct hdfs_object *	hdfs_object_slurp(struct hdfs_heap_buf *rbuf,
 			enum hdfs_object_type realtype);
 
 // Recursively frees an object.
+//
+// Responses decoded in arena mode (hdfs_namenode_set_arena_results()) are
+// freed all at once, in O(1), when the root object is freed. Freeing any other
+// object of such a tree drops a reference taken on that object with
+// hdfs_object_ref(), and otherwise does nothing. Their objects must not be
+// modified (e.g. appended to) or outlive the root -- use the *_copy() routines
+// or hdfs_object_ref() to keep a part.
+//
+// If references have been taken with hdfs_object_ref(), this drops one, and
+// the object is only freed with the last.
 void	hdfs_object_free(struct hdfs_object *obj);
 
+// Shares an object: takes another reference to it, to be dropped with
+// hdfs_object_free(), and returns it. Safe from any thread, but a shared object
+// must not be modified. A reference to any object of an arena-decoded response
+// keeps the whole response alive.
+//
+// The *_copy() routines of objects containing others (located blocks, arrays)
+// share the contained objects this way, rather than duplicating them, unless
+// they are in an arena.
+struct hdfs_object *	hdfs_object_ref(struct hdfs_object *obj);
+
+// A compact, read-only form of a located_blocks object, for keeping the block
+// maps of many files around. Per-block fields are held in parallel arrays,
+// and each distinct datanode, token and string is stored once per table;
+// the whole table is a single allocation.
+//
+// Blocks are indexed 0.._num_blocks-1; if _has_last_block, the last block
+// follows at index _num_blocks. Block i is at locations
+// _datanodes[_locs[_locs_start[i].._locs_start[i+1]-1]] and has token
+// _token_table[_tokens[i]]. Datanodes and tokens point into the table and must
+// not be freed or modified.
+struct hdfs_bt_datanode {
+	const char *_hostname,
+		   *_port,
+		   *_location;
+	uint16_t _namenodeport;
+};
+
+struct hdfs_block_table {
+	int64_t _size;
+	int _num_blocks,
+	    _num_datanodes,
+	    _num_tokens;
+	bool _being_written,
+	     _has_last_block,
+	     _last_block_complete;
+
+	int64_t *_offsets,
+		*_blockids,
+		*_generations,
+		*_lens;
+	uint32_t *_tokens,
+		 *_locs_start,
+		 *_locs;
+	bool *_corrupt;
+
+	struct hdfs_bt_datanode *_datanodes;
+	struct hdfs_token *_token_table;
+	const char *_pool_id;	/* NULL for HDFSv1 blocks */
+
+	size_t _bytes;		/* size of the allocation */
+};
+
+// Returns NULL if the blocks are not all in the same block pool. The
+// located_blocks object is not modified and may be freed afterwards.
+struct hdfs_block_table *	hdfs_block_table_new(
+				const struct hdfs_object *located_blocks);
+void	hdfs_block_table_free(struct hdfs_block_table *);
+
+// Returns the index of the (non-last) block containing byte 'offset' of the
+// file, or -1.
+int	hdfs_block_table_find(const struct hdfs_block_table *, int64_t offset);
+int	hdfs_block_table_num_locs(const struct hdfs_block_table *, int block);
+const struct hdfs_bt_datanode *	hdfs_block_table_loc(
+				const struct hdfs_block_table *, int block,
+				int i);
+const struct hdfs_token *	hdfs_block_table_token(
+				const struct hdfs_block_table *, int block);
+
+// Views of a table as (newly allocated) objects, for the rest of the API.
+struct hdfs_object *	hdfs_block_table_located_block(
+			const struct hdfs_block_table *, int block);
+struct hdfs_object *	hdfs_block_table_located_blocks(
+			const struct hdfs_block_table *);
+
+// A compact, read-only form of a directory listing, for large scans. File
+// statuses are fixed-size records in one array, names (and symlink targets)
+// are offsets into one string pool, and owners and groups are indices into a
+// table of the distinct ones; the whole table is a single allocation.
+// Locations in located listings are not kept.
+#define HDFS_LISTING_NONE	UINT32_MAX
+
+struct hdfs_listing_entry {
+	int64_t _size,
+		_block_size,
+		_mtime,
+		_atime;
+	uint64_t _fileid;
+	uint32_t _name,			/* offset in _names */
+		 _symlink_target,	/* offset in _names, or HDFS_LISTING_NONE */
+		 _owner,		/* index in _users */
+		 _group;		/* index in _users */
+	int32_t _num_children;
+	int16_t _replication,
+		_permissions;
+	uint8_t _type;			/* enum hdfs_file_type (v2) */
+	bool _directory;
+};
+
+struct hdfs_listing_table {
+	int _num_files,
+	    _num_users;
+	uint32_t _remaining_entries;
+
+	struct hdfs_listing_entry *_entries;
+	const char **_users;
+	char *_names;
+
+	size_t _bytes;			/* size of the allocation */
+};
+
+// The directory_listing object is not modified and may be freed afterwards.
+struct hdfs_listing_table *	hdfs_listing_table_new(
+				const struct hdfs_object *directory_listing);
+// Decodes a serialized (HDFSv1) DirectoryListing straight into a table, with
+// the same conventions as hdfs_object_slurp().
+struct hdfs_listing_table *	hdfs_listing_table_slurp(
+				struct hdfs_heap_buf *rbuf);
+// Decodes an HDFSv2 GetListingResponseProto (e.g., from
+// hdfs_future_get_raw()) straight into a table. Returns an error if the
+// message is malformed; otherwise *table_out is the table, or NULL if the
+// directory doesn't exist.
+const char *	hdfs_listing_table_from_proto(const void *, size_t,
+		struct hdfs_listing_table **table_out);
+void		hdfs_listing_table_free(struct hdfs_listing_table *);
+
+const char *	hdfs_listing_table_name(const struct hdfs_listing_table *,
+		int i);
+const char *	hdfs_listing_table_owner(const struct hdfs_listing_table *,
+		int i);
+const char *	hdfs_listing_table_group(const struct hdfs_listing_table *,
+		int i);
+// NULL if entry 'i' is not a symlink.
+const char *	hdfs_listing_table_symlink_target(
+		const struct hdfs_listing_table *, int i);
+
+// Views of a table as (newly allocated) objects, for the rest of the API.
+struct hdfs_object *	hdfs_listing_table_file_status(
+			const struct hdfs_listing_table *, int i);
+struct hdfs_object *	hdfs_listing_table_directory_listing(
+			const struct hdfs_listing_table *);
+
 #endif
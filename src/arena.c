@@ -0,0 +1,126 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "util.h"
+
+#define _ARENA_ALIGN	16
+#define _ARENA_MIN	(4*1024)
+#define _ARENA_MAX	(1024*1024)
+
+struct _hdfs_arena_chunk {
+	struct _hdfs_arena_chunk *ac_next;
+	uint64_t ac_pad;	/* keep ac_data aligned */
+	char ac_data[];
+};
+
+static inline size_t
+_arena_round(size_t sz)
+{
+
+	return (sz + _ARENA_ALIGN - 1) & ~(size_t)(_ARENA_ALIGN - 1);
+}
+
+static void *
+_arena_pb_alloc(void *v_ar, size_t sz)
+{
+
+	return _arena_alloc(v_ar, sz);
+}
+
+static void
+_arena_pb_free(void *v_ar, void *p)
+{
+
+	(void)v_ar;
+	(void)p;
+}
+
+static struct _hdfs_arena_chunk *
+_arena_chunk_new(size_t sz)
+{
+	struct _hdfs_arena_chunk *c;
+
+	c = malloc(sizeof(*c) + sz);
+	ASSERT(c);
+	return c;
+}
+
+struct _hdfs_arena *
+_arena_new(size_t sizehint)
+{
+	struct _hdfs_arena_chunk *c;
+	struct _hdfs_arena *ar;
+	size_t sz;
+
+	sz = _arena_round(sizehint + sizeof(*ar));
+	if (sz < _ARENA_MIN)
+		sz = _ARENA_MIN;
+
+	// The arena lives at the front of its own first chunk.
+	c = _arena_chunk_new(sz);
+	c->ac_next = NULL;
+
+	ar = (void *)c->ac_data;
+	ar->ar_chunks = c;
+	ar->ar_cur = c->ac_data + _arena_round(sizeof(*ar));
+	ar->ar_end = c->ac_data + sz;
+	ar->ar_chunksz = sz;
+	ar->ar_root = NULL;
+	ar->ar_refs = 0;
+	ar->ar_pballoc = (ProtobufCAllocator) {
+		.alloc = _arena_pb_alloc,
+		.free = _arena_pb_free,
+		.allocator_data = ar,
+	};
+	return ar;
+}
+
+void
+_arena_free(struct _hdfs_arena *ar)
+{
+	struct _hdfs_arena_chunk *c, *next;
+
+	// The first chunk (holding *ar) can be anywhere on the list: big
+	// chunks go in after the head, so they may follow it. *ar is only read
+	// to find the head, so freeing it part-way through the walk is fine.
+	for (c = ar->ar_chunks; c; c = next) {
+		next = c->ac_next;
+		free(c);
+	}
+}
+
+void *
+_arena_alloc(struct _hdfs_arena *ar, size_t sz)
+{
+	struct _hdfs_arena_chunk *c;
+	void *res;
+
+	sz = _arena_round(sz);
+	if (sz <= (size_t)(ar->ar_end - ar->ar_cur)) {
+		res = ar->ar_cur;
+		ar->ar_cur += sz;
+		return res;
+	}
+
+	// Big allocations get a chunk to themselves, so that they don't waste
+	// the rest of the current one.
+	if (sz > ar->ar_chunksz / 4) {
+		c = _arena_chunk_new(sz);
+		c->ac_next = ar->ar_chunks->ac_next;
+		ar->ar_chunks->ac_next = c;
+		return c->ac_data;
+	}
+
+	if (ar->ar_chunksz < _ARENA_MAX)
+		ar->ar_chunksz *= 2;
+
+	c = _arena_chunk_new(ar->ar_chunksz);
+	c->ac_next = ar->ar_chunks;
+	ar->ar_chunks = c;
+
+	ar->ar_cur = c->ac_data + sz;
+	ar->ar_end = c->ac_data + ar->ar_chunksz;
+	return c->ac_data;
+}
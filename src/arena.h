@@ -0,0 +1,36 @@
+#ifndef _HADOOFUS_ARENA_H
+#define _HADOOFUS_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <protobuf-c/protobuf-c.h>
+
+struct hdfs_object;
+
+// A bump allocator backing one decoded response: the unpacked protobuf and
+// every hdfs_object built from it. Nothing is freed individually; the whole
+// arena goes at once, when its root object is freed (and any references taken
+// on its objects are dropped).
+
+struct _hdfs_arena_chunk;
+
+struct _hdfs_arena {
+	struct _hdfs_arena_chunk *ar_chunks;
+	char *ar_cur,
+	     *ar_end;
+	size_t ar_chunksz;
+
+	struct hdfs_object *ar_root;
+	uint32_t ar_refs;	/* hdfs_object_ref()s of its objects */
+	ProtobufCAllocator ar_pballoc;
+};
+
+// 'sizehint' is the expected total allocation; it sizes the first chunk.
+struct _hdfs_arena *	_arena_new(size_t sizehint);
+void			_arena_free(struct _hdfs_arena *);
+
+// Never fails; memory is suitably aligned for any object.
+void *			_arena_alloc(struct _hdfs_arena *, size_t);
+
+#endif
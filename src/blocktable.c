@@ -0,0 +1,433 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hadoofus/objects.h>
+
+#include "util.h"
+
+// A table is built in two passes. The first interns every string, datanode and
+// token of the located_blocks into temporary tables (bounded by the input, so
+// they never need to grow) and sizes the result; the second lays everything
+// out in a single allocation.
+
+#define _BT_FNV_INIT	UINT32_C(2166136261)
+#define _BT_FNV_PRIME	UINT32_C(16777619)
+
+struct _bt_str {
+	const char *st_s;
+	uint32_t st_len,
+		 st_off;	/* in the string area of the table */
+};
+
+// Keys are indices of interned strings, so they compare with memcmp.
+struct _bt_dn {
+	uint32_t dn_host,
+		 dn_port,
+		 dn_location,
+		 dn_namenodeport;
+};
+
+struct _bt_tok {
+	uint32_t tk_strings[4];
+};
+
+struct _bt_build {
+	uint32_t bb_mask;	/* of each of the *_slots hash tables */
+
+	struct _bt_str *bb_strs;
+	uint32_t *bb_str_slots,	/* index + 1, or 0 if free */
+		 bb_nstrs;
+	size_t bb_strbytes;
+
+	struct _bt_dn *bb_dns;
+	uint32_t *bb_dn_slots,
+		 bb_ndns;
+
+	struct _bt_tok *bb_toks;
+	uint32_t *bb_tok_slots,
+		 bb_ntoks;
+};
+
+static uint32_t
+_bt_hash(const void *p, size_t len)
+{
+	const unsigned char *c = p;
+	uint32_t h = _BT_FNV_INIT;
+
+	for (size_t i = 0; i < len; i++) {
+		h ^= c[i];
+		h *= _BT_FNV_PRIME;
+	}
+	return h;
+}
+
+static uint32_t
+_bt_intern_str(struct _bt_build *bb, const char *s, size_t len)
+{
+	struct _bt_str *st;
+	uint32_t i, idx;
+
+	ASSERT(len <= UINT32_MAX);
+
+	// Empty token fields may come with s == NULL; intern them all as "",
+	// so neither this nor the final copy hands NULL to memcmp/memcpy.
+	if (len == 0)
+		s = "";
+
+	for (i = _bt_hash(s, len) & bb->bb_mask; bb->bb_str_slots[i] != 0;
+	    i = (i + 1) & bb->bb_mask) {
+		st = &bb->bb_strs[bb->bb_str_slots[i] - 1];
+		if (st->st_len == len && memcmp(st->st_s, s, len) == 0)
+			return bb->bb_str_slots[i] - 1;
+	}
+
+	idx = bb->bb_nstrs++;
+	bb->bb_strs[idx] = (struct _bt_str) {
+		.st_s = s,
+		.st_len = len,
+		.st_off = bb->bb_strbytes,
+	};
+	bb->bb_strbytes += len + 1;
+	bb->bb_str_slots[i] = idx + 1;
+	return idx;
+}
+
+static uint32_t
+_bt_intern_dn(struct _bt_build *bb, const struct hdfs_datanode_info *di)
+{
+	struct _bt_dn key;
+	uint32_t i, idx;
+
+	key = (struct _bt_dn) {
+		.dn_host = _bt_intern_str(bb, di->_hostname,
+		    strlen(di->_hostname)),
+		.dn_port = _bt_intern_str(bb, di->_port, strlen(di->_port)),
+		.dn_location = _bt_intern_str(bb, di->_location,
+		    strlen(di->_location)),
+		.dn_namenodeport = di->_namenodeport,
+	};
+
+	for (i = _bt_hash(&key, sizeof(key)) & bb->bb_mask;
+	    bb->bb_dn_slots[i] != 0; i = (i + 1) & bb->bb_mask)
+		if (memcmp(&bb->bb_dns[bb->bb_dn_slots[i] - 1], &key,
+		    sizeof(key)) == 0)
+			return bb->bb_dn_slots[i] - 1;
+
+	idx = bb->bb_ndns++;
+	bb->bb_dns[idx] = key;
+	bb->bb_dn_slots[i] = idx + 1;
+	return idx;
+}
+
+static uint32_t
+_bt_intern_tok(struct _bt_build *bb, const struct hdfs_object *token)
+{
+	struct _bt_tok key;
+	uint32_t i, idx;
+
+	if (token == NULL) {
+		for (unsigned j = 0; j < 4; j++)
+			key.tk_strings[j] = _bt_intern_str(bb, "", 0);
+	} else {
+		for (unsigned j = 0; j < 2; j++)
+			key.tk_strings[j] = _bt_intern_str(bb,
+			    token->ob_val._token._strings[j],
+			    token->ob_val._token._lens[j]);
+		for (unsigned j = 2; j < 4; j++)
+			key.tk_strings[j] = _bt_intern_str(bb,
+			    token->ob_val._token._strings[j],
+			    strlen(token->ob_val._token._strings[j]));
+	}
+
+	for (i = _bt_hash(&key, sizeof(key)) & bb->bb_mask;
+	    bb->bb_tok_slots[i] != 0; i = (i + 1) & bb->bb_mask)
+		if (memcmp(&bb->bb_toks[bb->bb_tok_slots[i] - 1], &key,
+		    sizeof(key)) == 0)
+			return bb->bb_tok_slots[i] - 1;
+
+	idx = bb->bb_ntoks++;
+	bb->bb_toks[idx] = key;
+	bb->bb_tok_slots[i] = idx + 1;
+	return idx;
+}
+
+// Reserves 'sz' bytes (aligned for anything in the table) at *off.
+static size_t
+_bt_carve(size_t *off, size_t sz)
+{
+	size_t res;
+
+	res = (*off + 7) & ~(size_t)7;
+	*off = res + sz;
+	return res;
+}
+
+static const struct hdfs_located_block *
+_bt_block(const struct hdfs_located_blocks *lbs, int i)
+{
+
+	if (i == lbs->_num_blocks)
+		return &lbs->_last_block->ob_val._located_block;
+	return &lbs->_blocks[i]->ob_val._located_block;
+}
+
+EXPORT_SYM struct hdfs_block_table *
+hdfs_block_table_new(const struct hdfs_object *located_blocks)
+{
+	const struct hdfs_located_blocks *lbs;
+	const struct hdfs_located_block *lb;
+	struct hdfs_block_table *res = NULL;
+	struct _bt_build bb = { 0 };
+	uint32_t *blk_tok = NULL, *locs = NULL, pool = 0;
+	size_t nlocs, maxstrs, nslots, off, o_offsets, o_blockids,
+	       o_generations, o_lens, o_datanodes, o_token_table, o_tokens,
+	       o_locs_start, o_locs, o_corrupt, o_strings;
+	bool has_pool = false;
+	char *base, *strings;
+	int nb;
+
+	ASSERT(located_blocks->ob_type == H_LOCATED_BLOCKS);
+	lbs = &located_blocks->ob_val._located_blocks;
+
+	nb = lbs->_num_blocks + (lbs->_last_block != NULL);
+	nlocs = 0;
+	for (int i = 0; i < nb; i++)
+		nlocs += _bt_block(lbs, i)->_num_locs;
+
+	// Every token has 4 strings, every block a pool id, every datanode 3
+	// strings.
+	maxstrs = 5 * (size_t)nb + 3 * nlocs + 1;
+	ASSERT(maxstrs < UINT32_MAX / 2);
+	for (nslots = 16; nslots < 2 * maxstrs; nslots *= 2)
+		;
+
+	bb.bb_mask = nslots - 1;
+	bb.bb_strs = malloc(maxstrs * sizeof(*bb.bb_strs));
+	bb.bb_str_slots = calloc(nslots, sizeof(*bb.bb_str_slots));
+	bb.bb_dns = malloc((nlocs + 1) * sizeof(*bb.bb_dns));
+	bb.bb_dn_slots = calloc(nslots, sizeof(*bb.bb_dn_slots));
+	bb.bb_toks = malloc((nb + 1) * sizeof(*bb.bb_toks));
+	bb.bb_tok_slots = calloc(nslots, sizeof(*bb.bb_tok_slots));
+	blk_tok = malloc((nb + 1) * sizeof(*blk_tok));
+	locs = malloc((nlocs + 1) * sizeof(*locs));
+	ASSERT(bb.bb_strs && bb.bb_str_slots && bb.bb_dns && bb.bb_dn_slots &&
+	    bb.bb_toks && bb.bb_tok_slots && blk_tok && locs);
+
+	nlocs = 0;
+	for (int i = 0; i < nb; i++) {
+		lb = _bt_block(lbs, i);
+
+		// A file's blocks are all in one block pool
+		if (i == 0 && lb->_pool_id) {
+			pool = _bt_intern_str(&bb, lb->_pool_id,
+			    strlen(lb->_pool_id));
+			has_pool = true;
+		} else if ((lb->_pool_id != NULL) != has_pool ||
+		    (has_pool && strcmp(lb->_pool_id,
+		    bb.bb_strs[pool].st_s) != 0))
+			goto out;
+
+		blk_tok[i] = _bt_intern_tok(&bb, lb->_token);
+		for (int j = 0; j < lb->_num_locs; j++)
+			locs[nlocs++] = _bt_intern_dn(&bb,
+			    &lb->_locs[j]->ob_val._datanode_info);
+	}
+
+	off = 0;
+	_bt_carve(&off, sizeof(*res));
+	o_offsets = _bt_carve(&off, nb * sizeof(*res->_offsets));
+	o_blockids = _bt_carve(&off, nb * sizeof(*res->_blockids));
+	o_generations = _bt_carve(&off, nb * sizeof(*res->_generations));
+	o_lens = _bt_carve(&off, nb * sizeof(*res->_lens));
+	o_datanodes = _bt_carve(&off, bb.bb_ndns * sizeof(*res->_datanodes));
+	o_token_table = _bt_carve(&off,
+	    bb.bb_ntoks * sizeof(*res->_token_table));
+	o_tokens = _bt_carve(&off, nb * sizeof(*res->_tokens));
+	o_locs_start = _bt_carve(&off, (nb + 1) * sizeof(*res->_locs_start));
+	o_locs = _bt_carve(&off, nlocs * sizeof(*res->_locs));
+	o_corrupt = _bt_carve(&off, nb * sizeof(*res->_corrupt));
+	o_strings = _bt_carve(&off, bb.bb_strbytes);
+
+	base = malloc(off);
+	ASSERT(base);
+	res = (void *)base;
+	strings = base + o_strings;
+
+	*res = (struct hdfs_block_table) {
+		._size = lbs->_size,
+		._num_blocks = lbs->_num_blocks,
+		._num_datanodes = bb.bb_ndns,
+		._num_tokens = bb.bb_ntoks,
+		._being_written = lbs->_being_written,
+		._has_last_block = (lbs->_last_block != NULL),
+		._last_block_complete = lbs->_last_block_complete,
+		._offsets = (void *)(base + o_offsets),
+		._blockids = (void *)(base + o_blockids),
+		._generations = (void *)(base + o_generations),
+		._lens = (void *)(base + o_lens),
+		._tokens = (void *)(base + o_tokens),
+		._locs_start = (void *)(base + o_locs_start),
+		._locs = (void *)(base + o_locs),
+		._corrupt = (void *)(base + o_corrupt),
+		._datanodes = (void *)(base + o_datanodes),
+		._token_table = (void *)(base + o_token_table),
+		._pool_id = has_pool ? strings + bb.bb_strs[pool].st_off : NULL,
+		._bytes = off,
+	};
+
+	for (uint32_t i = 0; i < bb.bb_nstrs; i++) {
+		memcpy(strings + bb.bb_strs[i].st_off, bb.bb_strs[i].st_s,
+		    bb.bb_strs[i].st_len);
+		strings[bb.bb_strs[i].st_off + bb.bb_strs[i].st_len] = '\0';
+	}
+
+	for (uint32_t i = 0; i < bb.bb_ndns; i++)
+		res->_datanodes[i] = (struct hdfs_bt_datanode) {
+			._hostname = strings +
+			    bb.bb_strs[bb.bb_dns[i].dn_host].st_off,
+			._port = strings +
+			    bb.bb_strs[bb.bb_dns[i].dn_port].st_off,
+			._location = strings +
+			    bb.bb_strs[bb.bb_dns[i].dn_location].st_off,
+			._namenodeport = bb.bb_dns[i].dn_namenodeport,
+		};
+
+	for (uint32_t i = 0; i < bb.bb_ntoks; i++) {
+		for (unsigned j = 0; j < 4; j++)
+			res->_token_table[i]._strings[j] = strings +
+			    bb.bb_strs[bb.bb_toks[i].tk_strings[j]].st_off;
+		for (unsigned j = 0; j < 2; j++)
+			res->_token_table[i]._lens[j] =
+			    bb.bb_strs[bb.bb_toks[i].tk_strings[j]].st_len;
+	}
+
+	nlocs = 0;
+	for (int i = 0; i < nb; i++) {
+		lb = _bt_block(lbs, i);
+
+		res->_offsets[i] = lb->_offset;
+		res->_blockids[i] = lb->_blockid;
+		res->_generations[i] = lb->_generation;
+		res->_lens[i] = lb->_len;
+		res->_tokens[i] = blk_tok[i];
+		res->_corrupt[i] = lb->_corrupt;
+		res->_locs_start[i] = nlocs;
+		nlocs += lb->_num_locs;
+	}
+	res->_locs_start[nb] = nlocs;
+	memcpy(res->_locs, locs, nlocs * sizeof(*locs));
+
+out:
+	free(bb.bb_strs);
+	free(bb.bb_str_slots);
+	free(bb.bb_dns);
+	free(bb.bb_dn_slots);
+	free(bb.bb_toks);
+	free(bb.bb_tok_slots);
+	free(blk_tok);
+	free(locs);
+	return res;
+}
+
+EXPORT_SYM void
+hdfs_block_table_free(struct hdfs_block_table *bt)
+{
+
+	free(bt);
+}
+
+EXPORT_SYM int
+hdfs_block_table_find(const struct hdfs_block_table *bt, int64_t offset)
+{
+	int lo, hi, mid;
+
+	// Last block starting at or before 'offset'
+	lo = 0;
+	hi = bt->_num_blocks;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (bt->_offsets[mid] <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0 || offset >= bt->_offsets[lo - 1] + bt->_lens[lo - 1])
+		return -1;
+	return lo - 1;
+}
+
+EXPORT_SYM int
+hdfs_block_table_num_locs(const struct hdfs_block_table *bt, int block)
+{
+
+	return bt->_locs_start[block + 1] - bt->_locs_start[block];
+}
+
+EXPORT_SYM const struct hdfs_bt_datanode *
+hdfs_block_table_loc(const struct hdfs_block_table *bt, int block, int i)
+{
+
+	ASSERT(i >= 0 && i < hdfs_block_table_num_locs(bt, block));
+	return &bt->_datanodes[bt->_locs[bt->_locs_start[block] + i]];
+}
+
+EXPORT_SYM const struct hdfs_token *
+hdfs_block_table_token(const struct hdfs_block_table *bt, int block)
+{
+
+	return &bt->_token_table[bt->_tokens[block]];
+}
+
+EXPORT_SYM struct hdfs_object *
+hdfs_block_table_located_block(const struct hdfs_block_table *bt, int block)
+{
+	const struct hdfs_bt_datanode *dn;
+	const struct hdfs_token *tok;
+	struct hdfs_object *res;
+
+	ASSERT(block >= 0 && block < bt->_num_blocks + bt->_has_last_block);
+
+	res = hdfs_located_block_new(bt->_blockids[block], bt->_lens[block],
+	    bt->_generations[block], bt->_offsets[block]);
+
+	tok = hdfs_block_table_token(bt, block);
+	hdfs_object_free(res->ob_val._located_block._token);
+	res->ob_val._located_block._token = hdfs_token_new_nulsafe(
+	    tok->_strings[0], tok->_lens[0], tok->_strings[1], tok->_lens[1],
+	    tok->_strings[2], tok->_strings[3]);
+
+	if (bt->_pool_id) {
+		res->ob_val._located_block._pool_id = strdup(bt->_pool_id);
+		ASSERT(res->ob_val._located_block._pool_id);
+	}
+	res->ob_val._located_block._corrupt = bt->_corrupt[block];
+
+	for (int i = 0; i < hdfs_block_table_num_locs(bt, block); i++) {
+		dn = hdfs_block_table_loc(bt, block, i);
+		hdfs_located_block_append_datanode_info(res,
+		    hdfs_datanode_info_new(dn->_hostname, dn->_port,
+		    dn->_location, dn->_namenodeport));
+	}
+	return res;
+}
+
+EXPORT_SYM struct hdfs_object *
+hdfs_block_table_located_blocks(const struct hdfs_block_table *bt)
+{
+	struct hdfs_object *res;
+
+	res = hdfs_located_blocks_new(bt->_being_written, bt->_size);
+	for (int i = 0; i < bt->_num_blocks; i++)
+		hdfs_located_blocks_append_located_block(res,
+		    hdfs_block_table_located_block(bt, i));
+
+	if (bt->_has_last_block)
+		res->ob_val._located_blocks._last_block =
+		    hdfs_block_table_located_block(bt, bt->_num_blocks);
+	res->ob_val._located_blocks._last_block_complete =
+	    bt->_last_block_complete;
+	return res;
+}
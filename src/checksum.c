@@ -0,0 +1,518 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "checksum.h"
+#include "util.h"
+
+#if defined(__x86_64__)
+# define _CRC_X86
+# include <nmmintrin.h>
+# include <smmintrin.h>
+# include <wmmintrin.h>
+#elif defined(__aarch64__) && defined(__linux__)
+# define _CRC_ARMV8
+# include <sys/auxv.h>
+# ifndef HWCAP_CRC32
+#  define HWCAP_CRC32	(1 << 7)
+# endif
+#endif
+
+#define _CRC32_POLY	0x104c11db7ULL
+#define _CRC32C_POLY	0x11edc6f41ULL
+
+// Chunks checksummed side by side by the multi-lane kernels
+#define _LANES		4
+// Chunks _hdfs_checksum_verify() checksums per kernel call
+#define _VERIFY_BATCH	128
+
+// Constants for folding a CRC with carry-less multiplies; see _clmul_init().
+struct _clmul_consts {
+	uint64_t k1k2[2],
+		 k3k4[2],
+		 k5,
+		 poly[2];
+};
+
+static uint32_t crc32c_table[8][256];
+static uint32_t (*crc32c_impl)(uint32_t, const void *, size_t);
+static unsigned crc_cpu;
+static const struct _hdfs_crc_kernel *crc_best[HDFS_CSUM_CRC32C + 1];
+static struct _clmul_consts crc32_clmul, crc32c_clmul;
+static pthread_once_t checksum_once = PTHREAD_ONCE_INIT;
+
+static inline uint64_t
+_ld64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t
+_crc32_zlib(uint32_t crc, const void *buf, size_t len)
+{
+
+	return crc32(crc, buf, len);
+}
+
+// Slicing-by-8: eight bytes per step, through one table per byte position.
+static uint32_t
+_crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t lo, hi;
+
+	crc = ~crc;
+	for (; len >= 8; p += 8, len -= 8) {
+		lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		    (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+		hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 |
+		    (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+		crc = crc32c_table[7][lo & 0xff] ^
+		    crc32c_table[6][(lo >> 8) & 0xff] ^
+		    crc32c_table[5][(lo >> 16) & 0xff] ^
+		    crc32c_table[4][lo >> 24] ^
+		    crc32c_table[3][hi & 0xff] ^
+		    crc32c_table[2][(hi >> 8) & 0xff] ^
+		    crc32c_table[1][(hi >> 16) & 0xff] ^
+		    crc32c_table[0][hi >> 24];
+	}
+	for (; len > 0; p++, len--)
+		crc = crc32c_table[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+#if defined(_CRC_X86)
+__attribute__((target("sse4.2")))
+static uint32_t
+_crc32c_sse42(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint64_t c = ~crc;
+
+	for (; len > 0 && ((uintptr_t)p & 7); p++, len--)
+		c = _mm_crc32_u8((uint32_t)c, *p);
+	for (; len >= 8; p += 8, len -= 8)
+		c = _mm_crc32_u64(c, _ld64(p));
+	for (; len > 0; p++, len--)
+		c = _mm_crc32_u8((uint32_t)c, *p);
+	return ~(uint32_t)c;
+}
+
+// The crc32 instruction has a latency of three cycles but a throughput of
+// one, so a single chunk leaves it mostly idle. Interleaving the chunks of a
+// packet keeps it busy.
+__attribute__((target("sse4.2")))
+static void
+_crc32c_sse42_lanes(const void *data, size_t dlen, size_t cs, void *crcs)
+{
+	const uint8_t *p = data;
+	uint8_t *out = crcs;
+	uint64_t c[_LANES];
+	size_t i = 0;
+
+	if (cs % 8 == 0) {
+		for (; (i + _LANES) * cs <= dlen; i += _LANES) {
+			const uint8_t *b = p + i * cs;
+
+			for (unsigned l = 0; l < _LANES; l++)
+				c[l] = 0xffffffff;
+			for (size_t o = 0; o < cs; o += 8) {
+				c[0] = _mm_crc32_u64(c[0], _ld64(b + o));
+				c[1] = _mm_crc32_u64(c[1], _ld64(b + cs + o));
+				c[2] = _mm_crc32_u64(c[2], _ld64(b + 2*cs + o));
+				c[3] = _mm_crc32_u64(c[3], _ld64(b + 3*cs + o));
+			}
+			for (unsigned l = 0; l < _LANES; l++)
+				_be32enc(out + 4 * (i + l), ~(uint32_t)c[l]);
+		}
+	}
+	for (; i * cs < dlen; i++)
+		_be32enc(out + 4 * i, _crc32c_sse42(0, p + i * cs,
+		    _min(cs, dlen - i * cs)));
+}
+
+// Folds 'len' (at least 64, a multiple of 16) bytes into the CRC state 'crc'
+// (not inverted) four 128-bit lanes at a time, then Barrett-reduces to 32
+// bits. See Intel's "Fast CRC Computation for Generic Polynomials Using
+// PCLMULQDQ Instruction"; this is the bit-reflected form.
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t
+_crc_clmul_fold(const struct _clmul_consts *k, uint32_t crc, const uint8_t *p,
+	size_t len)
+{
+	__m128i x0, x1, x2, x3, x4, t1, t2, t3, t4, mask;
+
+	x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	p += 64;
+	len -= 64;
+
+	x0 = _mm_set_epi64x(k->k1k2[1], k->k1k2[0]);
+	for (; len >= 64; p += 64, len -= 64) {
+		t1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		t2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		t3 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		t4 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, t1),
+		    _mm_loadu_si128((const __m128i *)(p + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, t2),
+		    _mm_loadu_si128((const __m128i *)(p + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, t3),
+		    _mm_loadu_si128((const __m128i *)(p + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, t4),
+		    _mm_loadu_si128((const __m128i *)(p + 0x30)));
+	}
+
+	// Fold the four lanes into one, then any remaining 16-byte blocks
+	x0 = _mm_set_epi64x(k->k3k4[1], k->k3k4[0]);
+#define _FOLD_INTO(x, y) do { \
+	t1 = _mm_clmulepi64_si128(x, x0, 0x00); \
+	x = _mm_clmulepi64_si128(x, x0, 0x11); \
+	x = _mm_xor_si128(_mm_xor_si128(x, t1), y); \
+} while (false)
+	_FOLD_INTO(x1, x2);
+	_FOLD_INTO(x1, x3);
+	_FOLD_INTO(x1, x4);
+	for (; len >= 16; p += 16, len -= 16)
+		_FOLD_INTO(x1, _mm_loadu_si128((const __m128i *)p));
+#undef _FOLD_INTO
+
+	// 128 bits to 64, then 64 to 32
+	mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x0 = _mm_set_epi64x(0, k->k5);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction
+	x0 = _mm_set_epi64x(k->poly[1], k->poly[0]);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t
+_crc32_pclmul(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	size_t n;
+
+	if (len >= 64) {
+		n = len & ~(size_t)15;
+		crc = ~_crc_clmul_fold(&crc32_clmul, ~crc, p, n);
+		p += n;
+		len -= n;
+	}
+	return crc32(crc, p, len);
+}
+
+static uint32_t
+_crc32c_pclmul(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	size_t n;
+
+	if (len >= 64) {
+		n = len & ~(size_t)15;
+		crc = ~_crc_clmul_fold(&crc32c_clmul, ~crc, p, n);
+		p += n;
+		len -= n;
+	}
+	return _crc32c_sw(crc, p, len);
+}
+#elif defined(_CRC_ARMV8)
+// ARMv8's CRC extension has instructions for both polynomials.
+# define _ARMV8_CRC(name, lanes, insn) \
+static uint32_t \
+name(uint32_t crc, const void *buf, size_t len) \
+{ \
+	const uint8_t *p = buf; \
+	uint32_t c = ~crc; \
+\
+	for (; len >= 8; p += 8, len -= 8) \
+		__asm__(".arch_extension crc\n\t" insn "x %w0, %w0, %x1" \
+		    : "+r"(c) : "r"(_ld64(p))); \
+	for (; len > 0; p++, len--) \
+		__asm__(".arch_extension crc\n\t" insn "b %w0, %w0, %w1" \
+		    : "+r"(c) : "r"((uint32_t)*p)); \
+	return ~c; \
+} \
+\
+static void \
+lanes(const void *data, size_t dlen, size_t cs, void *crcs) \
+{ \
+	const uint8_t *p = data; \
+	uint8_t *out = crcs; \
+	uint32_t c[_LANES]; \
+	size_t i = 0; \
+\
+	if (cs % 8 == 0) { \
+		for (; (i + _LANES) * cs <= dlen; i += _LANES) { \
+			const uint8_t *b = p + i * cs; \
+\
+			for (unsigned l = 0; l < _LANES; l++) \
+				c[l] = 0xffffffff; \
+			for (size_t o = 0; o < cs; o += 8) \
+				__asm__(".arch_extension crc\n\t" \
+				    insn "x %w0, %w0, %x4\n\t" \
+				    insn "x %w1, %w1, %x5\n\t" \
+				    insn "x %w2, %w2, %x6\n\t" \
+				    insn "x %w3, %w3, %x7" \
+				    : "+r"(c[0]), "+r"(c[1]), "+r"(c[2]), \
+				      "+r"(c[3]) \
+				    : "r"(_ld64(b + o)), \
+				      "r"(_ld64(b + cs + o)), \
+				      "r"(_ld64(b + 2*cs + o)), \
+				      "r"(_ld64(b + 3*cs + o))); \
+			for (unsigned l = 0; l < _LANES; l++) \
+				_be32enc(out + 4 * (i + l), ~c[l]); \
+		} \
+	} \
+	for (; i * cs < dlen; i++) \
+		_be32enc(out + 4 * i, name(0, p + i * cs, \
+		    _min(cs, dlen - i * cs))); \
+}
+
+_ARMV8_CRC(_crc32_armv8, _crc32_armv8_lanes, "crc32")
+_ARMV8_CRC(_crc32c_armv8, _crc32c_armv8_lanes, "crc32c")
+# undef _ARMV8_CRC
+#endif
+
+// Best first, per type; _checksum_init() picks the first one the CPU can run.
+static const struct _hdfs_crc_kernel crc_kernels[] = {
+#if defined(_CRC_X86)
+	{ "sse4.2x4", HDFS_CSUM_CRC32C, _CRC_CPU_SSE42, _crc32c_sse42,
+	  _crc32c_sse42_lanes },
+	{ "pclmul", HDFS_CSUM_CRC32C, _CRC_CPU_PCLMUL, _crc32c_pclmul, NULL },
+	{ "sse4.2", HDFS_CSUM_CRC32C, _CRC_CPU_SSE42, _crc32c_sse42, NULL },
+	{ "pclmul", HDFS_CSUM_CRC32, _CRC_CPU_PCLMUL, _crc32_pclmul, NULL },
+#elif defined(_CRC_ARMV8)
+	{ "armv8x4", HDFS_CSUM_CRC32C, _CRC_CPU_ARMV8, _crc32c_armv8,
+	  _crc32c_armv8_lanes },
+	{ "armv8", HDFS_CSUM_CRC32C, _CRC_CPU_ARMV8, _crc32c_armv8, NULL },
+	{ "armv8x4", HDFS_CSUM_CRC32, _CRC_CPU_ARMV8, _crc32_armv8,
+	  _crc32_armv8_lanes },
+	{ "armv8", HDFS_CSUM_CRC32, _CRC_CPU_ARMV8, _crc32_armv8, NULL },
+#endif
+	{ "table", HDFS_CSUM_CRC32C, 0, _crc32c_sw, NULL },
+	{ "zlib", HDFS_CSUM_CRC32, 0, _crc32_zlib, NULL },
+};
+
+// x^n mod P, for the unreflected 33-bit polynomial P
+static uint32_t
+_xpow_mod(unsigned n, uint64_t poly)
+{
+	uint64_t r = 1;
+
+	while (n--) {
+		r <<= 1;
+		if (r & (1ULL << 32))
+			r ^= poly;
+	}
+	return r;
+}
+
+static uint64_t
+_reflect(uint64_t v, unsigned bits)
+{
+	uint64_t r = 0;
+
+	for (unsigned i = 0; i < bits; i++, v >>= 1)
+		r = (r << 1) | (v & 1);
+	return r;
+}
+
+static void
+_clmul_init(struct _clmul_consts *k, uint64_t poly)
+{
+	uint64_t q, r;
+
+#define _K(n)	(_reflect(_xpow_mod((n), poly), 32) << 1)
+	k->k1k2[0] = _K(4*128 + 32);
+	k->k1k2[1] = _K(4*128 - 32);
+	k->k3k4[0] = _K(128 + 32);
+	k->k3k4[1] = _K(128 - 32);
+	k->k5 = _K(64);
+#undef _K
+
+	// floor(x^64 / P), by long division; the x^64 term is implicit
+	q = 1ULL << 32;
+	r = (poly & 0xffffffff) << 32;
+	for (int i = 63; i >= 32; i--) {
+		if (r & (1ULL << i)) {
+			q |= 1ULL << (i - 32);
+			r ^= poly << (i - 32);
+		}
+	}
+	k->poly[0] = _reflect(poly, 33);
+	k->poly[1] = _reflect(q, 33);
+}
+
+static bool
+_kernel_usable(const struct _hdfs_crc_kernel *ck)
+{
+
+	return (ck->ck_cpu & ~crc_cpu) == 0;
+}
+
+static void
+_checksum_init(void)
+{
+	uint32_t c;
+
+	for (unsigned i = 0; i < 256; i++) {
+		c = i;
+		for (unsigned k = 0; k < 8; k++)
+			c = (c >> 1) ^ (0x82f63b78 & (0 - (c & 1)));
+		crc32c_table[0][i] = c;
+	}
+	for (unsigned i = 0; i < 256; i++) {
+		c = crc32c_table[0][i];
+		for (unsigned t = 1; t < 8; t++) {
+			c = crc32c_table[0][c & 0xff] ^ (c >> 8);
+			crc32c_table[t][i] = c;
+		}
+	}
+	_clmul_init(&crc32_clmul, _CRC32_POLY);
+	_clmul_init(&crc32c_clmul, _CRC32C_POLY);
+
+#if defined(_CRC_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2"))
+		crc_cpu |= _CRC_CPU_SSE42;
+	if (__builtin_cpu_supports("pclmul") &&
+	    __builtin_cpu_supports("sse4.1"))
+		crc_cpu |= _CRC_CPU_PCLMUL;
+#elif defined(_CRC_ARMV8)
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+		crc_cpu |= _CRC_CPU_ARMV8;
+#endif
+
+	for (unsigned i = nelem(crc_kernels); i > 0; i--) {
+		const struct _hdfs_crc_kernel *ck = &crc_kernels[i - 1];
+
+		if (_kernel_usable(ck))
+			crc_best[ck->ck_type] = ck;
+	}
+
+	// Single streams: whatever backs the CRC32C kernel, without the lanes
+	crc32c_impl = crc_best[HDFS_CSUM_CRC32C]->ck_crc;
+}
+
+static void
+_checksum_once(void)
+{
+	int rc;
+
+	rc = pthread_once(&checksum_once, _checksum_init);
+	ASSERT(rc == 0);
+}
+
+uint32_t
+_hdfs_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+
+	_checksum_once();
+	return crc32c_impl(crc, buf, len);
+}
+
+uint32_t
+_hdfs_crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+
+	_checksum_once();
+	return _crc32c_sw(crc, buf, len);
+}
+
+uint32_t
+_hdfs_checksum_update(enum hdfs_checksum_type type, uint32_t crc,
+	const void *buf, size_t len)
+{
+
+	ASSERT(type == HDFS_CSUM_CRC32 || type == HDFS_CSUM_CRC32C);
+	_checksum_once();
+
+	return crc_best[type]->ck_crc(crc, buf, len);
+}
+
+const struct _hdfs_crc_kernel *
+_hdfs_crc_kernels(size_t *nkernels_out)
+{
+
+	_checksum_once();
+	*nkernels_out = nelem(crc_kernels);
+	return crc_kernels;
+}
+
+bool
+_hdfs_crc_kernel_usable(const struct _hdfs_crc_kernel *ck)
+{
+
+	_checksum_once();
+	return _kernel_usable(ck);
+}
+
+void
+_hdfs_crc_kernel_chunks(const struct _hdfs_crc_kernel *ck, int32_t chunksize,
+	const void *data, size_t dlen, void *crcs)
+{
+	const uint8_t *p = data;
+	uint8_t *out = crcs;
+
+	ASSERT(chunksize > 0);
+
+	if (ck->ck_chunks) {
+		ck->ck_chunks(data, dlen, chunksize, crcs);
+		return;
+	}
+	for (size_t off = 0; off < dlen; off += chunksize, out += 4)
+		_be32enc(out, ck->ck_crc(0, p + off, _min(chunksize,
+		    dlen - off)));
+}
+
+void
+_hdfs_checksum_chunks(enum hdfs_checksum_type type, int32_t chunksize,
+	const void *data, size_t dlen, void *crcs)
+{
+
+	ASSERT(type == HDFS_CSUM_CRC32 || type == HDFS_CSUM_CRC32C);
+	_checksum_once();
+
+	_hdfs_crc_kernel_chunks(crc_best[type], chunksize, data, dlen, crcs);
+}
+
+const char *
+_hdfs_checksum_verify(enum hdfs_checksum_type type, int32_t chunksize,
+	const void *data, size_t dlen, const void *crcs)
+{
+	const uint8_t *p = data, *in = crcs;
+	uint8_t want[4 * _VERIFY_BATCH];
+	size_t n;
+
+	ASSERT(chunksize > 0);
+
+	// Checksum a batch of chunks at a time, so the kernel can interleave
+	for (size_t off = 0; off < dlen; off += n, in += sizeof(want)) {
+		n = _min(dlen - off, _VERIFY_BATCH * (size_t)chunksize);
+		_hdfs_checksum_chunks(type, chunksize, p + off, n, want);
+		if (memcmp(want, in, 4 * ((n + chunksize - 1) / chunksize)))
+			return "Got bad CRC during read; aborting";
+	}
+	return NULL;
+}
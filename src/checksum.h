@@ -0,0 +1,57 @@
+#ifndef _HADOOFUS_CHECKSUM_H
+#define _HADOOFUS_CHECKSUM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hadoofus/objects.h>
+
+// Block data checksums. HDFS checksums each 'chunksize'-byte chunk of a packet
+// separately and sends the results as big-endian uint32s ahead of the data.
+//
+// Each checksum type has a few implementations ("kernels"); the best one the
+// CPU supports is picked at runtime. CRC32C uses the SSE4.2 or ARMv8 CRC
+// instructions, several chunks at a time, or PCLMULQDQ folding; CRC32 uses
+// PCLMULQDQ folding or the ARMv8 instructions. Either falls back to tables.
+
+// Like zlib's crc32(): start with crc = 0, or continue from a previous result.
+uint32_t	_hdfs_crc32c(uint32_t crc, const void *, size_t);
+// The portable implementation, whatever the CPU supports (for tests).
+uint32_t	_hdfs_crc32c_sw(uint32_t crc, const void *, size_t);
+
+// Continues a checksum of 'type' over another piece of the data (start with
+// crc = 0); for chunks that aren't contiguous in memory.
+uint32_t	_hdfs_checksum_update(enum hdfs_checksum_type, uint32_t crc,
+		const void *, size_t);
+
+// Writes the (dlen + chunksize - 1) / chunksize checksums of 'data' to
+// 'crcs'.
+void		_hdfs_checksum_chunks(enum hdfs_checksum_type, int32_t chunksize,
+		const void *data, size_t dlen, void *crcs);
+
+// Returns NULL if the checksums in 'crcs' match 'data', or an error message.
+const char *	_hdfs_checksum_verify(enum hdfs_checksum_type, int32_t chunksize,
+		const void *data, size_t dlen, const void *crcs);
+
+// Every kernel built in, for tests and benchmarks; usable or not.
+#define _CRC_CPU_SSE42	0x1
+#define _CRC_CPU_PCLMUL	0x2
+#define _CRC_CPU_ARMV8	0x4
+
+struct _hdfs_crc_kernel {
+	const char *ck_name;
+	enum hdfs_checksum_type ck_type;
+	unsigned ck_cpu;	/* _CRC_CPU_* features it needs */
+	// One stream, with _hdfs_crc32c()'s conventions:
+	uint32_t (*ck_crc)(uint32_t, const void *, size_t);
+	// Multi-lane, or NULL; same contract as _hdfs_checksum_chunks():
+	void (*ck_chunks)(const void *, size_t dlen, size_t chunksize, void *);
+};
+
+const struct _hdfs_crc_kernel *	_hdfs_crc_kernels(size_t *nkernels_out);
+bool		_hdfs_crc_kernel_usable(const struct _hdfs_crc_kernel *);
+void		_hdfs_crc_kernel_chunks(const struct _hdfs_crc_kernel *,
+		int32_t chunksize, const void *data, size_t dlen, void *crcs);
+
+#endif
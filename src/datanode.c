@@ -1,3 +1,5 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
@@ -8,10 +10,10 @@
 #include <string.h>
 #include <unistd.h>
 
-#include <zlib.h>
-
 #include <hadoofus/highlevel.h>
 
+#include "checksum.h"
+#include "dncache.h"
 #include "heapbuf.h"
 #include "net.h"
 #include "objects-internal.h"
@@ -71,6 +73,11 @@ struct _packet_state {
 	    proto,
 	    fd;
 	bool sendcrcs;
+	enum hdfs_checksum_type csum;
+	// Unverified reads to file (Linux): the pipe to splice(2) data through
+	bool splice;
+	int pipefds[2];
+	bool lastpacket;
 };
 
 struct _read_state {
@@ -78,6 +85,7 @@ struct _read_state {
 		server_offset;
 	int32_t chunk_size;
 	bool has_crcs;
+	enum hdfs_checksum_type csum;
 };
 
 
@@ -92,12 +100,13 @@ static const char *	_read_read_status2(struct hdfs_datanode *, struct hdfs_heap_
 static const char *	_read_write_status(struct hdfs_datanode *, struct hdfs_heap_buf *);
 static const char *	_read_write_status2(struct hdfs_datanode *, struct hdfs_heap_buf *);
 static const char *	_recv_packet(struct _packet_state *, struct _read_state *);
+static const char *	_datanode_reconnect(struct hdfs_datanode *);
+static void		_read_file_setup(struct _packet_state *);
+static void		_read_file_teardown(struct _packet_state *);
 static const char *	_process_recv_packet(struct _packet_state *, struct _read_state *,
 			ssize_t /*hdr_len*/, ssize_t /*plen*/, ssize_t /*dlen*/,
 			int64_t /*offset*/, bool /*lastpacket*/);
 static const char *	_send_packet(struct _packet_state *);
-static const char *	_verify_crcdata(void *crcdata, int32_t chunksize,
-			int32_t crcdlen, int32_t dlen);
 static const char *	_wait_ack(struct _packet_state *ps);
 static const char *	_wait_ack2(struct _packet_state *ps);
 
@@ -173,6 +182,10 @@ hdfs_datanode_init(struct hdfs_datanode *d,
 	d->dn_lock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
 	d->dn_sock = -1;
 	d->dn_used = false;
+	d->dn_cached = false;
+	d->dn_reusable = false;
+	d->dn_host = NULL;
+	d->dn_port = NULL;
 
 	d->dn_blkid = blkid;
 	d->dn_size = size;
@@ -180,7 +193,7 @@ hdfs_datanode_init(struct hdfs_datanode *d,
 
 	d->dn_offset = offset;
 	if (token)
-		d->dn_token = hdfs_token_copy(token);
+		d->dn_token = _hdfs_object_share(token, hdfs_token_copy);
 	else
 		d->dn_token = hdfs_token_new_empty();
 
@@ -190,6 +203,7 @@ hdfs_datanode_init(struct hdfs_datanode *d,
 
 	d->dn_proto = proto;
 	d->dn_pool_id = NULL;
+	d->dn_csum = HDFS_CSUM_CRC32;
 }
 
 EXPORT_SYM void
@@ -204,17 +218,32 @@ hdfs_datanode_set_pool_id(struct hdfs_datanode *d, const char *pool_id)
 	d->dn_pool_id = pool_copy;
 }
 
+EXPORT_SYM void
+hdfs_datanode_set_checksum_type(struct hdfs_datanode *d,
+	enum hdfs_checksum_type csum)
+{
+
+	ASSERT(csum == HDFS_CSUM_CRC32 || csum == HDFS_CSUM_CRC32C);
+	d->dn_csum = csum;
+}
+
 EXPORT_SYM void
 hdfs_datanode_destroy(struct hdfs_datanode *d)
 {
 	ASSERT(d);
 
 	_lock(&d->dn_lock);
-	if (d->dn_sock != -1)
-		close(d->dn_sock);
+	if (d->dn_sock != -1) {
+		if (d->dn_reusable)
+			_dncache_put(d->dn_host, d->dn_port, d->dn_sock);
+		else
+			close(d->dn_sock);
+	}
 	hdfs_object_free(d->dn_token);
 	free(d->dn_client);
 	free(d->dn_pool_id);
+	free(d->dn_host);
+	free(d->dn_port);
 	_unlock(&d->dn_lock);
 
 	memset(d, 0, sizeof *d);
@@ -230,13 +259,49 @@ hdfs_datanode_connect(struct hdfs_datanode *d, const char *host, const char *por
 	_lock(&d->dn_lock);
 
 	ASSERT(d->dn_sock == -1);
-	error = _connect(&d->dn_sock, host, port);
+
+	free(d->dn_host);
+	free(d->dn_port);
+	d->dn_host = strdup(host);
+	d->dn_port = strdup(port);
+	ASSERT(d->dn_host && d->dn_port);
+
+	error = NULL;
+	if (d->dn_proto >= HDFS_DATANODE_AP_2_0)
+		d->dn_sock = _dncache_get(host, port);
+	d->dn_cached = (d->dn_sock != -1);
+	if (!d->dn_cached)
+		error = _connect(&d->dn_sock, host, port);
 
 	_unlock(&d->dn_lock);
 
 	return error;
 }
 
+// An idle connection (from the cache, or left over from a previous read) may
+// have been closed by the datanode meanwhile. Ops that fail before getting
+// anywhere on one retry once, on a new connection.
+static const char *
+_datanode_reconnect(struct hdfs_datanode *d)
+{
+
+	close(d->dn_sock);
+	d->dn_sock = -1;
+	d->dn_cached = false;
+	return _connect(&d->dn_sock, d->dn_host, d->dn_port);
+}
+
+// Whether reading an op's response status failed because the connection was
+// gone: it ended or was reset before any of the response arrived. Errors the
+// datanode actually sent are final.
+static bool
+_conn_dropped(const char *error, struct hdfs_heap_buf *h)
+{
+
+	return h->used == 0 && (strcmp(error, "EOS") == 0 ||
+	    strcmp(error, strerror(ECONNRESET)) == 0);
+}
+
 // Datanode write operations
 
 EXPORT_SYM const char *
@@ -280,6 +345,59 @@ hdfs_datanode_read_file(struct hdfs_datanode *d, off_t bloff, off_t len,
 	return _datanode_read(d, bloff, len, fd, fdoff, NULL/*buf*/, verifycrc);
 }
 
+EXPORT_SYM const char *
+hdfs_datanode_read_file_mmap(struct hdfs_datanode *d, off_t bloff, off_t len,
+	int fd, off_t fdoff, bool verifycrc)
+{
+	const char *error;
+	struct stat sb;
+	off_t mapoff;
+	size_t maplen;
+	void *map;
+	bool extended = false;
+	int rc;
+
+	ASSERT(bloff >= 0);
+	ASSERT(fdoff >= 0);
+	ASSERT(fd >= 0);
+	ASSERT(len > 0);
+
+	mapoff = fdoff - fdoff % sysconf(_SC_PAGESIZE);
+	if ((uintmax_t)(fdoff - mapoff + len) > SIZE_MAX)
+		return "Read too large to map";
+	maplen = fdoff - mapoff + len;
+
+	rc = fstat(fd, &sb);
+	if (rc == -1)
+		return strerror(errno);
+
+	map = mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+	    mapoff);
+	if (map == MAP_FAILED)
+		return strerror(errno);
+
+	// Stores past EOF would fault
+	if (sb.st_size < fdoff + len) {
+		rc = ftruncate(fd, fdoff + len);
+		if (rc == -1) {
+			error = strerror(errno);
+			goto out;
+		}
+		extended = true;
+	}
+
+	error = _datanode_read(d, bloff, len, -1/*fd*/, -1/*fdoff*/,
+	    (char *)map + (fdoff - mapoff), verifycrc);
+
+out:
+	munmap(map, maplen);
+	// Don't leave a failed read's extension behind. (If this fails too,
+	// the read's error is still the one to report.)
+	if (error && extended)
+		rc = ftruncate(fd, sb.st_size);
+	return error;
+}
+
 static void
 _compose_read_header(struct hdfs_heap_buf *h, struct hdfs_datanode *d,
 	off_t offset, off_t len, bool crcs)
@@ -385,10 +503,10 @@ _compose_write_header(struct hdfs_heap_buf *h, struct hdfs_datanode *d, bool crc
 		hdr.baseheader = &bhdr;
 		hdr.clientname = d->dn_client;
 
-		csum.bytesperchecksum = 512;
+		csum.bytesperchecksum = CHUNK_SIZE;
 		csum.type = CHECKSUM_TYPE_PROTO__NULL;
 		if (crcs)
-			csum.type = CHECKSUM_TYPE_PROTO__CRC32;
+			csum.type = _hdfs_csum_to_proto(d->dn_csum);
 
 		op.header = &hdr;
 
@@ -436,18 +554,32 @@ _datanode_read(struct hdfs_datanode *d, off_t bloff, off_t len,
 
 	_lock(&d->dn_lock);
 
-	ASSERT(!d->dn_used);
+	// Only a connection kept alive by the previous read can take another
+	ASSERT(!d->dn_used || d->dn_reusable);
 	d->dn_used = true;
+	d->dn_reusable = false;
 
 	_compose_read_header(&header, d, bloff, len, verify);
-	error = _write_all(d->dn_sock, header.buf, header.used);
-	if (error)
-		goto out;
+	for (;;) {
+		bool dropped;
 
-	if (d->dn_proto >= HDFS_DATANODE_AP_2_0)
-		error = _read_read_status2(d, &recvbuf, &rinfo);
-	else
-		error = _read_read_status(d, &recvbuf, &rinfo);
+		error = _write_all(d->dn_sock, header.buf, header.used);
+		dropped = (error != NULL);
+		if (!error) {
+			if (d->dn_proto >= HDFS_DATANODE_AP_2_0)
+				error = _read_read_status2(d, &recvbuf, &rinfo);
+			else
+				error = _read_read_status(d, &recvbuf, &rinfo);
+			dropped = (error && _conn_dropped(error, &recvbuf));
+		}
+		if (!error || !dropped || !d->dn_cached)
+			break;
+
+		recvbuf.used = 0;
+		error = _datanode_reconnect(d);
+		if (error)
+			goto out;
+	}
 	if (error)
 		goto out;
 
@@ -467,12 +599,22 @@ _datanode_read(struct hdfs_datanode *d, off_t bloff, off_t len,
 	pstate.fdoffset = fdoff;
 	pstate.recvbuf = &recvbuf;
 	pstate.proto = d->dn_proto;
+	if (fd != -1)
+		_read_file_setup(&pstate);
 	while (pstate.remains > 0) {
 		error = _recv_packet(&pstate, &rinfo);
 		if (error)
 			goto out;
 	}
 
+	// v2 follows the data with an empty last packet; it has to be read
+	// off before the connection can be used again.
+	if (d->dn_proto >= HDFS_DATANODE_AP_2_0 && !pstate.lastpacket) {
+		error = _recv_packet(&pstate, &rinfo);
+		if (error)
+			goto out;
+	}
+
 	// tell server the read was fine
 	if (d->dn_proto >= HDFS_DATANODE_AP_2_0) {
 		ClientReadStatusProto status = CLIENT_READ_STATUS_PROTO__INIT;
@@ -494,12 +636,17 @@ _datanode_read(struct hdfs_datanode *d, off_t bloff, off_t len,
 		header.used += sz;
 
 		error = _write_all(d->dn_sock, header.buf, header.used);
+
+		// The datanode now waits for another op on this connection
+		if (!error && pstate.lastpacket && recvbuf.used == 0)
+			d->dn_reusable = d->dn_cached = true;
 	} else
 		error = _write_all(d->dn_sock, DN_CHECKSUM_OK, 2);
 	if (error)
 		goto out;
 
 out:
+	_read_file_teardown(&pstate);
 	if (header.buf)
 		free(header.buf);
 	if (recvbuf.buf)
@@ -508,6 +655,41 @@ out:
 	return error;
 }
 
+/*
+ * Reading to a regular file without verifying CRCs, on Linux, splice(2) the
+ * data from the socket to the file instead of bouncing it through recvbuf.
+ * Otherwise (or if we can't get a pipe) the data goes out with pwrite(2).
+ */
+static void
+_read_file_setup(struct _packet_state *ps)
+{
+#if defined(__linux__)
+	struct stat sb;
+	int rc;
+
+	if (ps->sendcrcs)
+		return;
+
+	rc = fstat(ps->fd, &sb);
+	if (rc == -1 || !S_ISREG(sb.st_mode))
+		return;
+
+	rc = pipe(ps->pipefds);
+	if (rc == 0)
+		ps->splice = true;
+#endif
+}
+
+static void
+_read_file_teardown(struct _packet_state *ps)
+{
+
+	if (ps->splice) {
+		close(ps->pipefds[0]);
+		close(ps->pipefds[1]);
+	}
+}
+
 const char *
 _datanode_write(struct hdfs_datanode *d, const void *buf, int fd, off_t len,
 	off_t offset, bool sendcrcs)
@@ -528,20 +710,39 @@ _datanode_write(struct hdfs_datanode *d, const void *buf, int fd, off_t len,
 	d->dn_used = true;
 
 	_compose_write_header(&header, d, sendcrcs);
-	error = _write_all(d->dn_sock, header.buf, header.used);
-	if (error)
-		goto out;
+	for (;;) {
+		bool dropped;
 
-	if (d->dn_proto >= HDFS_DATANODE_AP_2_0)
-		error = _read_write_status2(d, &recvbuf);
-	else
-		error = _read_write_status(d, &recvbuf);
+		error = _write_all(d->dn_sock, header.buf, header.used);
+		dropped = (error != NULL);
+		if (!error) {
+			if (d->dn_proto >= HDFS_DATANODE_AP_2_0)
+				error = _read_write_status2(d, &recvbuf);
+			else
+				error = _read_write_status(d, &recvbuf);
+			dropped = (error && _conn_dropped(error, &recvbuf));
+		}
+		if (!error || !dropped || !d->dn_cached)
+			break;
+
+		recvbuf.used = 0;
+		error = _datanode_reconnect(d);
+		if (error)
+			goto out;
+	}
 	if (error)
 		goto out;
 
 	// we're good to write. start sending packets.
 	pstate.sock = d->dn_sock;
 	pstate.sendcrcs = sendcrcs;
+	pstate.csum = HDFS_CSUM_NULL;
+	if (sendcrcs) {
+		// HDFSv1 only speaks CRC32
+		pstate.csum = HDFS_CSUM_CRC32;
+		if (d->dn_proto >= HDFS_DATANODE_AP_2_0)
+			pstate.csum = d->dn_csum;
+	}
 	pstate.buf = __DECONST(void*, buf);
 	pstate.fd = fd;
 	pstate.remains = len;
@@ -589,7 +790,7 @@ _read_read_status(struct hdfs_datanode *d, struct hdfs_heap_buf *h,
 	int16_t status;
 	int32_t chunk_size;
 	int64_t server_offset;
-	bool crcs;
+	int8_t csum;
 
 	while (h->used < 2) {
 		error = _read_to_hbuf(d->dn_sock, h);
@@ -616,16 +817,27 @@ _read_read_status(struct hdfs_datanode *d, struct hdfs_heap_buf *h,
 
 	obuf.size = h->used;
 
-	crcs = _bslurp_s8(&obuf);
+	// The checksum type (DataChecksum's ids match ours)
+	csum = _bslurp_s8(&obuf);
 	ASSERT(obuf.used > 0);
 	chunk_size = _bslurp_s32(&obuf);
 	ASSERT(obuf.used > 0);
 	server_offset = _bslurp_s64(&obuf);
 	ASSERT(obuf.used > 0);
 
+	if (csum < HDFS_CSUM_NULL || csum > HDFS_CSUM_CRC32C) {
+		error = "Server uses an unknown checksum type; aborting read";
+		goto out;
+	}
+	if (csum != HDFS_CSUM_NULL && chunk_size <= 0) {
+		error = "Server sent bogus checksum chunk size; aborting read";
+		goto out;
+	}
+
 	rs->server_offset = server_offset;
 	rs->chunk_size = chunk_size;
-	rs->has_crcs = crcs;
+	rs->csum = csum;
+	rs->has_crcs = (csum != HDFS_CSUM_NULL);
 
 	// Skip recvbuf past request status
 	h->used -= obuf.used;
@@ -706,6 +918,7 @@ _read_read_status2(struct hdfs_datanode *d, struct hdfs_heap_buf *h,
 {
 	const char *error;
 	BlockOpResponseProto *opres;
+	ChecksumProto *csum;
 
 	opres = NULL;
 
@@ -715,13 +928,23 @@ _read_read_status2(struct hdfs_datanode *d, struct hdfs_heap_buf *h,
 
 	ASSERT(opres->readopchecksuminfo);
 	ASSERT(opres->readopchecksuminfo->checksum);
+	csum = opres->readopchecksuminfo->checksum;
 
-	rs->server_offset = opres->readopchecksuminfo->chunkoffset;
+	if ((unsigned)csum->type > CHECKSUM_TYPE_PROTO__CRC32C) {
+		error = "Server uses an unknown checksum type; aborting read";
+		goto out;
+	}
+	if (csum->type != CHECKSUM_TYPE_PROTO__NULL &&
+	    (csum->bytesperchecksum == 0 ||
+	     csum->bytesperchecksum > INT32_MAX)) {
+		error = "Server sent bogus checksum chunk size; aborting read";
+		goto out;
+	}
 
-	/* XXX check what kind of CRC? */
-	rs->has_crcs = (opres->readopchecksuminfo->checksum->type !=
-	    CHECKSUM_TYPE_PROTO__NULL);
-	rs->chunk_size = opres->readopchecksuminfo->checksum->bytesperchecksum;
+	rs->server_offset = opres->readopchecksuminfo->chunkoffset;
+	rs->csum = _hdfs_csum_from_proto(csum->type);
+	rs->has_crcs = (rs->csum != HDFS_CSUM_NULL);
+	rs->chunk_size = csum->bytesperchecksum;
 
 out:
 	if (opres)
@@ -830,12 +1053,11 @@ _recv_packet(struct _packet_state *ps, struct _read_state *rs)
 	phdr = NULL;
 
 	if (ps->proto < HDFS_DATANODE_AP_2_0) {
-		// slurp packet header
-		while (recvbuf->used < 25) {
-			error = _read_to_hbuf(ps->sock, recvbuf);
-			if (error)
-				goto out;
-		}
+		// slurp packet header (only; the rest goes straight to its
+		// destination)
+		error = _read_to_hbuf_n(ps->sock, recvbuf, 25);
+		if (error)
+			goto out;
 
 		obuf.buf = recvbuf->buf;
 		obuf.size = recvbuf->used;
@@ -856,11 +1078,9 @@ _recv_packet(struct _packet_state *ps, struct _read_state *rs)
 		goto out;
 	}
 
-	while (recvbuf->used < 6) {
-		error = _read_to_hbuf(ps->sock, recvbuf);
-		if (error)
-			goto out;
-	}
+	error = _read_to_hbuf_n(ps->sock, recvbuf, 6);
+	if (error)
+		goto out;
 
 	obuf.buf = recvbuf->buf;
 	obuf.size = recvbuf->used;
@@ -870,11 +1090,9 @@ _recv_packet(struct _packet_state *ps, struct _read_state *rs)
 	hlen = (uint16_t)_bslurp_s16(&obuf);
 	ASSERT(obuf.used > 0);
 
-	while (recvbuf->used < 6 + hlen) {
-		error = _read_to_hbuf(ps->sock, recvbuf);
-		if (error)
-			goto out;
-	}
+	error = _read_to_hbuf_n(ps->sock, recvbuf, 6 + hlen);
+	if (error)
+		goto out;
 
 	phdr = packet_header_proto__unpack(NULL, hlen,
 	    (void *)&recvbuf->buf[6]);
@@ -896,6 +1114,86 @@ out:
 	return error;
 }
 
+// Checksums of a packet whose data is split into a head, a body and a tail
+// (seg[0..2], contiguous in the packet but not in memory). Chunks wholly inside
+// the body are checked in place, in batches; the (at most two) chunks that
+// straddle its ends are checksummed piecewise.
+static const char *
+_verify_packet(struct _read_state *rs, const uint8_t *crcs,
+	const struct iovec seg[3])
+{
+	size_t cs = rs->chunk_size,
+	       head = seg[0].iov_len,
+	       body = seg[1].iov_len,
+	       dlen = head + body + seg[2].iov_len,
+	       lo, hi, ranges[2][2];
+	const char *error;
+
+	lo = (head + cs - 1) / cs * cs;
+	hi = (head + body == dlen) ? dlen : (head + body) / cs * cs;
+	if (lo < hi) {
+		error = _hdfs_checksum_verify(rs->csum, rs->chunk_size,
+		    (const uint8_t *)seg[1].iov_base + (lo - head), hi - lo,
+		    crcs + lo / cs * 4);
+		if (error)
+			return error;
+	} else
+		lo = hi = 0;
+
+	ranges[0][0] = 0;
+	ranges[0][1] = lo;
+	ranges[1][0] = hi;
+	ranges[1][1] = dlen;
+	for (unsigned r = 0; r < 2; r++) {
+		for (size_t off = ranges[r][0]; off < ranges[r][1]; off += cs) {
+			size_t left = _min(cs, dlen - off), skip = off, n;
+			uint32_t crc = 0;
+
+			for (unsigned i = 0; i < 3 && left > 0; i++) {
+				if (skip >= seg[i].iov_len) {
+					skip -= seg[i].iov_len;
+					continue;
+				}
+				n = _min(left, seg[i].iov_len - skip);
+				crc = _hdfs_checksum_update(rs->csum, crc,
+				    (const uint8_t *)seg[i].iov_base + skip, n);
+				left -= n;
+				skip = 0;
+			}
+
+			if (crc != _be32dec(__DECONST(uint8_t *,
+			    crcs + off / cs * 4)))
+				return "Got bad CRC during read; aborting";
+		}
+	}
+	return NULL;
+}
+
+#if defined(__linux__)
+// Receives a packet, given the iovecs _process_recv_packet() would readv(2),
+// moving the data from the socket to file without touching it (but for any
+// that came in with the header). CRCs, if the server sent any, are skipped.
+static const char *
+_splice_packet(struct _packet_state *ps, struct iovec iov[4], uint8_t *body,
+	size_t c_len)
+{
+	size_t early = c_len - iov[2].iov_len;
+	const char *error;
+
+	error = _readv_all(ps->sock, iov, 2);
+	if (error)
+		return error;
+	error = _pwrite_all(ps->fd, body, early, ps->fdoffset);
+	if (error)
+		return error;
+	error = _splice_all(ps->sock, ps->pipefds, ps->fd, ps->fdoffset + early,
+	    iov[2].iov_len);
+	if (error)
+		return error;
+	return _readv_all(ps->sock, &iov[3], 1);
+}
+#endif
+
 static const char *
 _process_recv_packet(struct _packet_state *ps, struct _read_state *rs,
 	ssize_t hdr_len, ssize_t plen, ssize_t dlen, int64_t offset,
@@ -905,7 +1203,9 @@ _process_recv_packet(struct _packet_state *ps, struct _read_state *rs,
 	const int ONEGB = 1024*1024*1024;
 	const char *error = NULL;
 	int32_t c_begin, c_len;
-	ssize_t crcdlen;
+	ssize_t crcdlen, have, scratchlen;
+	struct iovec iov[4], seg[3];
+	uint8_t *scratch, *body;
 
 	crcdlen = plen - dlen - 4;
 	if (plen < 0 || dlen < 0 || dlen > ONEGB || plen > ONEGB)
@@ -930,21 +1230,6 @@ _process_recv_packet(struct _packet_state *ps, struct _read_state *rs,
 		goto check_remainder;
 	}
 
-	while (recvbuf->used < hdr_len + crcdlen + dlen) {
-		error = _read_to_hbuf(ps->sock, recvbuf);
-		if (error)
-			goto out;
-	}
-
-	if (crcdlen > 0) {
-		error = _verify_crcdata(recvbuf->buf + hdr_len, rs->chunk_size, crcdlen, dlen);
-		if (error) {
-			// On CRC errors, let the server know before aborting:
-			_write_all(ps->sock, DN_ERROR_CHECKSUM, 2);
-			goto out;
-		}
-	}
-
 	// figure out where in the packet to start copying from, and how much to copy
 	if (offset < rs->client_offset)
 		c_begin = rs->client_offset - offset;
@@ -956,43 +1241,83 @@ _process_recv_packet(struct _packet_state *ps, struct _read_state *rs,
 	}
 	c_len = _min(dlen - c_begin, ps->remains);
 
-	// Copy the packet data out to the user's buf or to file:
-	if (ps->buf) {
-		memcpy(ps->buf, recvbuf->buf + hdr_len + crcdlen + c_begin, c_len);
-	} else {
-		int written = 0, rc;
-		while (written < c_len) {
-			rc = pwrite(ps->fd,
-			    recvbuf->buf + hdr_len + crcdlen + c_begin + written,
-			    c_len - written,
-			    ps->fdoffset + written);
-			if (rc == -1)
-				error = strerror(errno);
-			else if (rc == 0)
-				error = "EOF writing out to file; aborting read";
+	/*
+	 * Only the header has been read so far. The CRCs, and whatever packet
+	 * data the caller didn't ask for, go to scratch space past the end of
+	 * recvbuf; the rest of the data is received directly into the user's
+	 * buffer. (Writing to a file with pwrite(2), it all goes to scratch.)
+	 */
+	scratchlen = crcdlen + (ps->buf ? dlen - c_len : dlen);
+	_hbuf_reserve(recvbuf, scratchlen);
+	scratch = (uint8_t *)recvbuf->buf + recvbuf->used;
+	body = ps->buf ? ps->buf : scratch + crcdlen + c_begin;
+
+	seg[0].iov_base = scratch + crcdlen;
+	seg[0].iov_len = c_begin;
+	seg[1].iov_base = body;
+	seg[1].iov_len = c_len;
+	seg[2].iov_base = ps->buf ? scratch + crcdlen + c_begin :
+	    body + c_len;
+	seg[2].iov_len = dlen - c_begin - c_len;
+
+	iov[0].iov_base = scratch;
+	iov[0].iov_len = crcdlen;
+	memcpy(&iov[1], seg, sizeof(seg));
+
+	// Anything read along with the header (i.e., after the read status)
+	// belongs to this packet first:
+	have = recvbuf->used - hdr_len;
+	for (unsigned i = 0; i < nelem(iov) && have > 0; i++) {
+		size_t n = _min(have, iov[i].iov_len);
+
+		memcpy(iov[i].iov_base, recvbuf->buf + recvbuf->used - have, n);
+		iov[i].iov_base = (char *)iov[i].iov_base + n;
+		iov[i].iov_len -= n;
+		have -= n;
+	}
 
-			if (error)
-				goto out;
-			written += rc;
+#if defined(__linux__)
+	if (ps->splice)
+		error = _splice_packet(ps, iov, body, c_len);
+	else
+#endif
+		error = _readv_all(ps->sock, iov, nelem(iov));
+	if (error)
+		goto out;
+
+	if (crcdlen > 0 && !ps->splice) {
+		error = _verify_packet(rs, scratch, seg);
+		if (error) {
+			// On CRC errors, let the server know before aborting:
+			_write_all(ps->sock, DN_ERROR_CHECKSUM, 2);
+			goto out;
 		}
 	}
 
+	// Write the packet data out to file:
+	if (!ps->buf && !ps->splice) {
+		error = _pwrite_all(ps->fd, body, c_len, ps->fdoffset);
+		if (error)
+			goto out;
+	}
+
 	ps->remains -= c_len;
 	ps->fdoffset += c_len;
 	if (ps->buf)
 		ps->buf = (char*)ps->buf + c_len;
 
 check_remainder:
+	ps->lastpacket = lastpacket;
 	if (ps->remains > 0 && lastpacket) {
 		error = "Got last packet before read completed; aborting read";
 		goto out;
 	}
 
-	// skip recvbuf over this packet. this is probably excessive memcopying
-	// especially if/when multiple packets queue up. TODO: something
-	// smarter.
-	recvbuf->used -= (hdr_len + crcdlen + dlen);
-	memmove(recvbuf->buf, recvbuf->buf + hdr_len + crcdlen + dlen, recvbuf->used);
+	// Skip recvbuf over this packet, keeping anything that was read past it
+	have = recvbuf->used - (hdr_len + crcdlen + dlen);
+	if (have > 0)
+		memmove(recvbuf->buf, recvbuf->buf + recvbuf->used - have, have);
+	recvbuf->used = (have > 0) ? have : 0;
 
 out:
 	return error;
@@ -1064,18 +1389,12 @@ _send_packet(struct _packet_state *ps)
 
 	// calculate crcs, if requested
 	if (ps->sendcrcs) {
-		uint32_t crcinit;
-
 		crclen = (tosend + CHUNK_SIZE - 1) / CHUNK_SIZE;
 		crcdata = malloc(4*crclen);
 		ASSERT(crcdata);
 
-		crcinit = crc32(0L, Z_NULL, 0);
-		for (unsigned i = 0; i < crclen; i++) {
-			uint32_t chunklen = _min(CHUNK_SIZE, tosend - i * CHUNK_SIZE);
-			uint32_t crc = crc32(crcinit, data + i * CHUNK_SIZE, chunklen);
-			crcdata[i] = htonl(crc);
-		}
+		_hdfs_checksum_chunks(ps->csum, CHUNK_SIZE, data, tosend,
+		    crcdata);
 	}
 
 	// construct header:
@@ -1155,32 +1474,6 @@ out:
 	return error;
 }
 
-static const char *
-_verify_crcdata(void *crcdata, int32_t chunksize, int32_t crcdlen, int32_t dlen)
-{
-	uint32_t crcinit;
-	void *data = (char*)crcdata + crcdlen;
-
-	crcinit = crc32(0L, Z_NULL, 0);
-
-	for (int i = 0; i < (dlen + chunksize - 1) / chunksize; i++) {
-		int32_t chunklen = _min(chunksize, dlen - i*chunksize);
-		uint32_t crc = crc32(crcinit,
-		    (uint8_t*)data + i*chunksize, chunklen),
-			 pcrc;
-
-		pcrc = (((uint32_t) (*((uint8_t *)crcdata + i*4))) << 24) +
-		    (((uint32_t) (*((uint8_t *)crcdata + i*4 + 1))) << 16) +
-		    (((uint32_t) (*((uint8_t *)crcdata + i*4 + 2))) << 8) +
-		    (uint32_t) (*((uint8_t *)crcdata + i*4 + 3));
-
-		if (crc != pcrc)
-			return "Got bad CRC during read; aborting";
-	}
-
-	return NULL;
-}
-
 static const char *
 _wait_ack(struct _packet_state *ps)
 {
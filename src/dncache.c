@@ -0,0 +1,184 @@
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <hadoofus/lowlevel.h>
+
+#include "dncache.h"
+#include "pthread_wrappers.h"
+#include "util.h"
+
+//
+// HDFSv2 datanodes keep a connection open after a successful read, waiting for
+// another op. Rather than close it, hdfs_datanode_destroy() parks it here, and
+// the next hdfs_datanode_connect() to the same host and port takes it back,
+// skipping the TCP handshake and slow start.
+//
+// All entries are on one list, most recently parked first; so the oldest is at
+// the tail, and expiry (done lazily, on each get and put) only looks there.
+// The cache is small enough that lookups just walk the list.
+//
+
+struct _dncache_entry {
+	struct _dncache_entry *de_next,
+			      *de_prev;
+	uint64_t de_since;	/* _now_ms() when parked */
+	int de_sock;
+	char de_key[];		/* host NUL port NUL */
+};
+
+static pthread_mutex_t dncache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct _dncache_entry *dncache_head,
+			     *dncache_tail;
+static int dncache_size,
+	   dncache_capacity = HDFS_DATANODE_CACHE_CAPACITY,
+	   dncache_per_datanode = HDFS_DATANODE_CACHE_PER_DATANODE,
+	   dncache_idle_ms = HDFS_DATANODE_CACHE_IDLE_MS;
+
+static bool
+_entry_matches(struct _dncache_entry *e, const char *host, const char *port)
+{
+
+	return strcmp(e->de_key, host) == 0 &&
+	    strcmp(e->de_key + strlen(e->de_key) + 1, port) == 0;
+}
+
+static void
+_entry_unlink(struct _dncache_entry *e)
+{
+
+	if (e->de_prev)
+		e->de_prev->de_next = e->de_next;
+	else
+		dncache_head = e->de_next;
+	if (e->de_next)
+		e->de_next->de_prev = e->de_prev;
+	else
+		dncache_tail = e->de_prev;
+	dncache_size--;
+}
+
+static void
+_entry_drop(struct _dncache_entry *e)
+{
+
+	_entry_unlink(e);
+	close(e->de_sock);
+	free(e);
+}
+
+static void
+_expire_locked(void)
+{
+	uint64_t now = _now_ms();
+
+	while (dncache_tail &&
+	    now - dncache_tail->de_since >= (uint64_t)dncache_idle_ms)
+		_entry_drop(dncache_tail);
+}
+
+// An idle connection has nothing to read; if it's readable, the datanode has
+// closed it (or sent something we can't make sense of).
+static bool
+_sock_idle(int s)
+{
+	struct pollfd pfd = { .fd = s, .events = POLLIN };
+
+	return poll(&pfd, 1, 0) == 0;
+}
+
+int
+_dncache_get(const char *host, const char *port)
+{
+	struct _dncache_entry *e, *next;
+	int sock = -1;
+
+	_lock(&dncache_lock);
+	_expire_locked();
+
+	for (e = dncache_head; e; e = next) {
+		next = e->de_next;
+		if (!_entry_matches(e, host, port))
+			continue;
+
+		_entry_unlink(e);
+		sock = e->de_sock;
+		free(e);
+
+		if (_sock_idle(sock))
+			break;
+		close(sock);
+		sock = -1;
+	}
+
+	_unlock(&dncache_lock);
+	return sock;
+}
+
+void
+_dncache_put(const char *host, const char *port, int sock)
+{
+	struct _dncache_entry *e, *oldest = NULL;
+	size_t hostlen, portlen;
+	int n = 0;
+
+	_lock(&dncache_lock);
+	_expire_locked();
+
+	if (dncache_capacity == 0 || dncache_per_datanode == 0) {
+		close(sock);
+		goto out;
+	}
+
+	// Make room: first under the per-datanode limit, then the total
+	for (e = dncache_tail; e; e = e->de_prev) {
+		if (!_entry_matches(e, host, port))
+			continue;
+		if (oldest == NULL)
+			oldest = e;
+		n++;
+	}
+	if (n >= dncache_per_datanode)
+		_entry_drop(oldest);
+	else if (dncache_size >= dncache_capacity)
+		_entry_drop(dncache_tail);
+
+	hostlen = strlen(host);
+	portlen = strlen(port);
+	e = malloc(sizeof(*e) + hostlen + portlen + 2);
+	ASSERT(e);
+	memcpy(e->de_key, host, hostlen + 1);
+	memcpy(e->de_key + hostlen + 1, port, portlen + 1);
+	e->de_sock = sock;
+	e->de_since = _now_ms();
+
+	e->de_prev = NULL;
+	e->de_next = dncache_head;
+	if (dncache_head)
+		dncache_head->de_prev = e;
+	else
+		dncache_tail = e;
+	dncache_head = e;
+	dncache_size++;
+
+out:
+	_unlock(&dncache_lock);
+}
+
+EXPORT_SYM void
+hdfs_datanode_cache_configure(int capacity, int per_datanode, int idle_ms)
+{
+
+	ASSERT(capacity >= 0);
+	ASSERT(per_datanode >= 0);
+	ASSERT(idle_ms >= 0);
+
+	_lock(&dncache_lock);
+	while (dncache_head)
+		_entry_drop(dncache_head);
+	dncache_capacity = capacity;
+	dncache_per_datanode = per_datanode;
+	dncache_idle_ms = idle_ms;
+	_unlock(&dncache_lock);
+}
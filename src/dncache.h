@@ -0,0 +1,12 @@
+#ifndef _HADOOFUS_DNCACHE_H
+#define _HADOOFUS_DNCACHE_H
+
+// Process-wide cache of idle datanode connections, by host and port.
+
+// Returns a live cached connection to host:port, or -1.
+int	_dncache_get(const char *host, const char *port);
+// Takes ownership of 'sock', an idle connection to host:port; closes it if
+// the cache has no room.
+void	_dncache_put(const char *host, const char *port, int sock);
+
+#endif
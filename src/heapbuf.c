@@ -275,6 +275,94 @@ _bslurp_string32(struct hdfs_heap_buf *b)
 	return res;
 }
 
+static const char *
+_bslurp_ref(struct hdfs_heap_buf *b, size_t len, size_t *len_out)
+{
+	const char *res;
+
+	if (_eos(b, len))
+		return NULL;
+
+	res = b->buf + b->used;
+	b->used += len;
+	*len_out = len;
+	return res;
+}
+
+const char *
+_bslurp_string_ref(struct hdfs_heap_buf *b, size_t *len_out)
+{
+	int16_t slen;
+
+	slen = _bslurp_s16(b);
+	if (b->used < 0)
+		return NULL;
+
+	if (slen < 0) {
+		b->used = _H_PARSE_ERROR;
+		return NULL;
+	}
+
+	return _bslurp_ref(b, slen, len_out);
+}
+
+const char *
+_bslurp_string32_ref(struct hdfs_heap_buf *b, size_t *len_out)
+{
+	int32_t slen;
+
+	slen = _bslurp_s32(b);
+	if (b->used < 0)
+		return NULL;
+
+	if (slen < 0 || slen > 10*1024*1024/*sanity*/) {
+		b->used = _H_PARSE_ERROR;
+		return NULL;
+	}
+
+	return _bslurp_ref(b, slen, len_out);
+}
+
+const char *
+_bslurp_text_ref(struct hdfs_heap_buf *b, size_t *len_out)
+{
+	int64_t len;
+
+	len = _bslurp_vlint(b);
+	if (b->used < 0)
+		return NULL;
+
+	if (len < 0 || len > INT32_MAX) {
+		b->used = _H_PARSE_ERROR;
+		return NULL;
+	}
+
+	return _bslurp_ref(b, len, len_out);
+}
+
+void
+_bslurp_skip(struct hdfs_heap_buf *b, size_t len)
+{
+
+	if (_eos(b, len))
+		return;
+	b->used += len;
+}
+
+void
+_bslurp_string_expect(struct hdfs_heap_buf *b, const char *expect)
+{
+	const char *s;
+	size_t len;
+
+	s = _bslurp_string_ref(b, &len);
+	if (b->used < 0)
+		return;
+
+	if (len != strlen(expect) || memcmp(s, expect, len) != 0)
+		b->used = _H_PARSE_ERROR;
+}
+
 char *
 _bslurp_text(struct hdfs_heap_buf *b)
 {
@@ -37,6 +37,15 @@ int64_t		_bslurp_vlint(struct hdfs_heap_buf *);
 char *		_bslurp_string(struct hdfs_heap_buf *);
 char *		_bslurp_string32(struct hdfs_heap_buf *);
 char *		_bslurp_text(struct hdfs_heap_buf *);
+// Like _bslurp_string() and _bslurp_string32(), but return a pointer into the
+// buf instead of a copy. The result is not NUL-terminated.
+const char *	_bslurp_string_ref(struct hdfs_heap_buf *, size_t *len_out);
+const char *	_bslurp_string32_ref(struct hdfs_heap_buf *, size_t *len_out);
+const char *	_bslurp_text_ref(struct hdfs_heap_buf *, size_t *len_out);
+// Skips 'len' bytes.
+void		_bslurp_skip(struct hdfs_heap_buf *, size_t len);
+// Slurps a string, and fails (with _H_PARSE_ERROR) unless it is 'expect'.
+void		_bslurp_string_expect(struct hdfs_heap_buf *, const char *expect);
 // Helper for string slurpers. For their purposes, allocates an extra byte at
 // the end of the returned buf.
 void		_bslurp_mem1(struct hdfs_heap_buf *, size_t, char **);
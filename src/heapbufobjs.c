@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "heapbuf.h"
 #include "heapbufobjs.h"
@@ -8,25 +9,23 @@
 struct hdfs_object *
 _oslurp_null(struct hdfs_heap_buf *b)
 {
-	char *t;
+	const char *t;
+	size_t len;
 	enum hdfs_object_type rt;
-	struct hdfs_object *res = NULL;
 
-	t = _bslurp_string(b);
+	t = _bslurp_string_ref(b, &len);
 	if (b->used < 0)
-		return res;
+		return NULL;
 
-	if (streq(t, "void")) {
-		res = hdfs_void_new();
-	} else {
-		rt = _string_to_type(t);
-		if (rt == _H_INVALID)
-			b->used = _H_PARSE_ERROR;
-		else
-			res = hdfs_null_new(rt);
+	if (len == strlen("void") && memcmp(t, "void", len) == 0)
+		return hdfs_void_new();
+
+	rt = _string_to_type(t, len);
+	if (rt == _H_INVALID) {
+		b->used = _H_PARSE_ERROR;
+		return NULL;
 	}
-	free(t);
-	return res;
+	return hdfs_null_new(rt);
 }
 
 struct hdfs_object *
@@ -97,16 +96,9 @@ _oslurp_array_long(struct hdfs_heap_buf *b)
 		ASSERT(longs);
 
 		for (int32_t i = 0; i < n; i++) {
-			bool eq;
-			char *s = _bslurp_string(b);
+			_bslurp_string_expect(b, LONG_TYPE);
 			if (b->used < 0)
 				goto out;
-			eq = streq(s, LONG_TYPE);
-			free(s);
-			if (!eq) {
-				b->used = _H_PARSE_ERROR;
-				goto out;
-			}
 
 			longs[i] = _bslurp_s64(b);
 			if (b->used < 0)
@@ -446,7 +438,6 @@ _oslurp_array_datanode_info(struct hdfs_heap_buf *b)
 {
 	struct hdfs_object *res = NULL;
 	int32_t len;
-	char *tstring = NULL;
 
 	len = _bslurp_s32(b);
 	if (b->used < 0)
@@ -463,13 +454,9 @@ _oslurp_array_datanode_info(struct hdfs_heap_buf *b)
 		// but I'm pretty sure the Apache API doesn't produce/expect it.
 		struct hdfs_object *di;
 		for (int j = 0; j < 2; j++) {
-			tstring = _bslurp_string(b);
+			_bslurp_string_expect(b, DATANODEINFO_TYPE);
 			if (b->used < 0)
 				goto err;
-			if (!streq(tstring, DATANODEINFO_TYPE))
-				goto err;
-			free(tstring);
-			tstring = NULL;
 		}
 		di = _oslurp_datanode_info(b);
 		if (b->used < 0)
@@ -479,8 +466,6 @@ _oslurp_array_datanode_info(struct hdfs_heap_buf *b)
 	return res;
 
 err:
-	if (tstring)
-		free(tstring);
 	if (res)
 		hdfs_object_free(res);
 	return NULL;
@@ -529,3 +514,105 @@ _oslurp_upgrade_status_report(struct hdfs_heap_buf *b)
 
 	return hdfs_upgrade_status_report_new(version, status);
 }
+
+void
+_oskip_token(struct hdfs_heap_buf *b)
+{
+	int64_t len;
+	size_t slen;
+
+	for (unsigned i = 0; i < 2; i++) {
+		len = _bslurp_vlint(b);
+		if (b->used < 0)
+			return;
+		if (len < 0) {
+			b->used = _H_PARSE_ERROR;
+			return;
+		}
+		_bslurp_skip(b, len);
+		if (b->used < 0)
+			return;
+	}
+	for (unsigned i = 0; i < 2; i++) {
+		_bslurp_text_ref(b, &slen);
+		if (b->used < 0)
+			return;
+	}
+}
+
+void
+_oskip_located_block(struct hdfs_heap_buf *b)
+{
+	int32_t n_datanodes;
+
+	_oskip_token(b);
+	if (b->used < 0)
+		return;
+
+	// corrupt, offset, block
+	_bslurp_skip(b, 1 + 8 + 3*8);
+	if (b->used < 0)
+		return;
+
+	n_datanodes = _bslurp_s32(b);
+	if (b->used < 0)
+		return;
+	if (n_datanodes < 0) {
+		b->used = _H_PARSE_ERROR;
+		return;
+	}
+
+	for (int32_t i = 0; i < n_datanodes; i++) {
+		_oskip_datanode_info(b);
+		if (b->used < 0)
+			return;
+	}
+}
+
+void
+_oskip_datanode_info(struct hdfs_heap_buf *b)
+{
+	size_t len;
+
+	// name, storage id
+	for (unsigned i = 0; i < 2; i++) {
+		_bslurp_string_ref(b, &len);
+		if (b->used < 0)
+			return;
+	}
+
+	// info and ipc ports, capacity, dfsused, remaining, lastupdate,
+	// xceivercount
+	_bslurp_skip(b, 2*2 + 4*8 + 4);
+	if (b->used < 0)
+		return;
+
+	// location, hostname, adminstate
+	for (unsigned i = 0; i < 3; i++) {
+		_bslurp_text_ref(b, &len);
+		if (b->used < 0)
+			return;
+	}
+}
+
+void
+_oskip_file_status(struct hdfs_heap_buf *b)
+{
+	size_t len;
+
+	_bslurp_string32_ref(b, &len);
+	if (b->used < 0)
+		return;
+
+	// size, isdir, replication, blocksize, mtime, atime, perms
+	_bslurp_skip(b, 8 + 1 + 2 + 3*8 + 2);
+	if (b->used < 0)
+		return;
+
+	// owner, group
+	for (unsigned i = 0; i < 2; i++) {
+		_bslurp_text_ref(b, &len);
+		if (b->used < 0)
+			return;
+	}
+}
@@ -28,4 +28,12 @@ struct hdfs_object *	_oslurp_block(struct hdfs_heap_buf *);
 struct hdfs_object *	_oslurp_fsperms(struct hdfs_heap_buf *);
 struct hdfs_object *	_oslurp_upgrade_status_report(struct hdfs_heap_buf *);
 
+// Skip functions advance past one serialized object without building it (or
+// checking much beyond its framing), like the slurp functions on EOS and
+// invalid data.
+void			_oskip_token(struct hdfs_heap_buf *);
+void			_oskip_located_block(struct hdfs_heap_buf *);
+void			_oskip_datanode_info(struct hdfs_heap_buf *);
+void			_oskip_file_status(struct hdfs_heap_buf *);
+
 #endif
@@ -1,19 +1,10 @@
-#include <stdio.h>
 #include <stdlib.h>
 
 #include <hadoofus/highlevel.h>
 
+#include "objects-internal.h"
 #include "util.h"
 
-static void
-_assert_not_err(const char *error)
-{
-	if (error) {
-		fprintf(stderr, "libhadoofus: Got error, bailing: %s\n", error);
-		ASSERT(!error);
-	}
-}
-
 EXPORT_SYM struct hdfs_namenode *
 hdfs_namenode_new(const char *host, const char *port, const char *username,
 	enum hdfs_kerb kerb_pref, const char **error_out)
@@ -60,6 +51,87 @@ hdfs_namenode_delete(struct hdfs_namenode *h)
 }
 
 // RPC implementations
+//
+// The rpc and its arguments are built on the stack and only borrow the
+// caller's strings and objects: hdfs_namenode_invoke() has serialized the
+// call by the time it returns, so nothing needs to be copied or freed.
+
+static struct hdfs_object *
+_arg_string(struct hdfs_object *o, enum hdfs_object_type type, const char *s)
+{
+
+	if (s)
+		*o = (struct hdfs_object) {
+			.ob_type = type,
+			.ob_val._string._val = __DECONST(char *, s),
+		};
+	else
+		*o = (struct hdfs_object) {
+			.ob_type = H_NULL,
+			.ob_val._null._type = type,
+		};
+	return o;
+}
+
+static struct hdfs_object *
+_arg_mode(struct hdfs_object *o, enum hdfs_object_type type, const char *mode)
+{
+
+	ASSERT(mode);
+	switch (type) {
+	case H_SAFEMODEACTION:
+		ASSERT(streq(mode, HDFS_SAFEMODE_ENTER) ||
+		    streq(mode, HDFS_SAFEMODE_LEAVE) ||
+		    streq(mode, HDFS_SAFEMODE_GET));
+		break;
+	case H_DNREPORTTYPE:
+		ASSERT(streq(mode, HDFS_DNREPORT_ALL) ||
+		    streq(mode, HDFS_DNREPORT_LIVE) ||
+		    streq(mode, HDFS_DNREPORT_DEAD));
+		break;
+	case H_UPGRADE_ACTION:
+		ASSERT(streq(mode, HDFS_UPGRADEACTION_STATUS) ||
+		    streq(mode, HDFS_UPGRADEACTION_DETAILED) ||
+		    streq(mode, HDFS_UPGRADEACTION_FORCE_PROCEED));
+		break;
+	default:
+		ASSERT(false);
+	}
+	return _arg_string(o, type, mode);
+}
+
+#define _ARG_STORAGE (&(struct hdfs_object) { .ob_type = H_VOID })
+#define _STRING_ARG(s) _arg_string(_ARG_STORAGE, H_STRING, (s))
+#define _TEXT_ARG(s) _arg_string(_ARG_STORAGE, H_TEXT, (s))
+#define _MODE_ARG(type, m) _arg_mode(_ARG_STORAGE, (type), (m))
+#define _PRIM_ARG(type, field, v) \
+	(&(struct hdfs_object) { .ob_type = (type), .ob_val.field = (v) })
+#define _BOOLEAN_ARG(v) _PRIM_ARG(H_BOOLEAN, _boolean._val, (v))
+#define _SHORT_ARG(v) _PRIM_ARG(H_SHORT, _short._val, (v))
+#define _LONG_ARG(v) _PRIM_ARG(H_LONG, _long._val, (v))
+#define _FSPERMS_ARG(v) _PRIM_ARG(H_FSPERMS, _fsperms._perms, (v))
+
+// Stand-ins for optional object arguments the caller left NULL
+static char _empty_str[1];
+static struct hdfs_object _empty_array_byte = { .ob_type = H_ARRAY_BYTE };
+static struct hdfs_object _empty_array_string = { .ob_type = H_ARRAY_STRING };
+static struct hdfs_object _empty_array_locatedblock = {
+	.ob_type = H_ARRAY_LOCATEDBLOCK,
+};
+static struct hdfs_object _null_block = {
+	.ob_type = H_NULL,
+	.ob_val._null._type = H_BLOCK,
+};
+static struct hdfs_object _null_array_datanode_info = {
+	.ob_type = H_NULL,
+	.ob_val._null._type = H_ARRAY_DATANODE_INFO,
+};
+static struct hdfs_object _empty_token = {
+	.ob_type = H_TOKEN,
+	.ob_val._token._strings = {
+		_empty_str, _empty_str, _empty_str, _empty_str,
+	},
+};
 
 #define _HDFS_PRIM_RPC_DECL(type, name, args...) \
 EXPORT_SYM type \
@@ -68,17 +140,19 @@ hdfs_ ## name (struct hdfs_namenode *h, ##args, struct hdfs_object **exception_o
 #define _HDFS_PRIM_RPC_BODY(name, htype, result, retval, dflt, args...) \
 { \
 	struct hdfs_rpc_response_future future = HDFS_RPC_RESPONSE_FUTURE_INITIALIZER; \
-	struct hdfs_object *rpc, *object; \
+	struct hdfs_object rpc, *object; \
 	const char *error; \
 \
-	rpc = hdfs_rpc_invocation_new( \
-	    #name, \
+	_rpc_invocation_init(&rpc, \
+	    HDFS_RPC_ ## name, \
 	    ##args, \
 	    NULL); \
-	error = hdfs_namenode_invoke(h, rpc, &future); \
-	_assert_not_err(error); \
-\
-	hdfs_object_free(rpc); \
+	error = hdfs_namenode_invoke(h, &rpc, &future); \
+	if (error) { \
+		*exception_out = hdfs_protocol_exception_new(H_IPC_EXCEPTION, \
+		    error); \
+		return dflt ; \
+	} \
 \
 	hdfs_future_get(&future, &object); \
 \
@@ -102,8 +176,8 @@ _HDFS_PRIM_RPC_BODY(getProtocolVersion,
 	int64_t res = object->ob_val._long._val,
 	res,
 	0,
-	hdfs_string_new(protocol),
-	hdfs_long_new(client_version)
+	_STRING_ARG(protocol),
+	_LONG_ARG(client_version)
 )
 
 #define _HDFS_OBJ_RPC_DECL(name, args...) \
@@ -113,17 +187,19 @@ hdfs_ ## name (struct hdfs_namenode *h, ##args, struct hdfs_object **exception_o
 #define _HDFS_OBJ_RPC_BODY(name, htype, args...) \
 { \
 	struct hdfs_rpc_response_future future = HDFS_RPC_RESPONSE_FUTURE_INITIALIZER; \
-	struct hdfs_object *rpc, *object; \
+	struct hdfs_object rpc, *object; \
 	const char *error; \
 \
-	rpc = hdfs_rpc_invocation_new( \
-	    #name, \
+	_rpc_invocation_init(&rpc, \
+	    HDFS_RPC_ ## name, \
 	    ##args, \
 	    NULL); \
-	error = hdfs_namenode_invoke(h, rpc, &future); \
-	_assert_not_err(error); \
-\
-	hdfs_object_free(rpc); \
+	error = hdfs_namenode_invoke(h, &rpc, &future); \
+	if (error) { \
+		*exception_out = hdfs_protocol_exception_new(H_IPC_EXCEPTION, \
+		    error); \
+		return NULL; \
+	} \
 \
 	hdfs_future_get(&future, &object); \
 \
@@ -143,9 +219,9 @@ _HDFS_OBJ_RPC_DECL(getBlockLocations,
 	const char *path, int64_t offset, int64_t length)
 _HDFS_OBJ_RPC_BODY(getBlockLocations,
 	H_LOCATED_BLOCKS,
-	hdfs_string_new(path),
-	hdfs_long_new(offset),
-	hdfs_long_new(length)
+	_STRING_ARG(path),
+	_LONG_ARG(offset),
+	_LONG_ARG(length)
 )
 
 _HDFS_PRIM_RPC_DECL(void, create,
@@ -157,21 +233,21 @@ _HDFS_PRIM_RPC_BODY(create,
 	,
 	,
 	,
-	hdfs_string_new(path),
-	hdfs_fsperms_new(perms),
-	hdfs_string_new(clientname),
-	hdfs_boolean_new(overwrite),
-	hdfs_boolean_new(create_parent),
-	hdfs_short_new(replication),
-	hdfs_long_new(blocksize)
+	_STRING_ARG(path),
+	_FSPERMS_ARG(perms),
+	_STRING_ARG(clientname),
+	_BOOLEAN_ARG(overwrite),
+	_BOOLEAN_ARG(create_parent),
+	_SHORT_ARG(replication),
+	_LONG_ARG(blocksize)
 )
 
 _HDFS_OBJ_RPC_DECL(append,
 	const char *path, const char *client)
 _HDFS_OBJ_RPC_BODY(append,
 	H_LOCATED_BLOCK,
-	hdfs_string_new(path),
-	hdfs_string_new(client)
+	_STRING_ARG(path),
+	_STRING_ARG(client)
 )
 
 _HDFS_PRIM_RPC_DECL(bool, setReplication,
@@ -181,8 +257,8 @@ _HDFS_PRIM_RPC_BODY(setReplication,
 	bool res = object->ob_val._boolean._val,
 	res,
 	false,
-	hdfs_string_new(path),
-	hdfs_short_new(replication)
+	_STRING_ARG(path),
+	_SHORT_ARG(replication)
 )
 
 _HDFS_PRIM_RPC_DECL(void, setPermission,
@@ -192,8 +268,8 @@ _HDFS_PRIM_RPC_BODY(setPermission,
 	,
 	,
 	,
-	hdfs_string_new(path),
-	hdfs_fsperms_new(perms)
+	_STRING_ARG(path),
+	_FSPERMS_ARG(perms)
 )
 
 _HDFS_PRIM_RPC_DECL(void, setOwner,
@@ -203,9 +279,9 @@ _HDFS_PRIM_RPC_BODY(setOwner,
 	,
 	,
 	,
-	hdfs_string_new(path),
-	hdfs_string_new(owner),
-	hdfs_string_new(group)
+	_STRING_ARG(path),
+	_STRING_ARG(owner),
+	_STRING_ARG(group)
 )
 
 _HDFS_PRIM_RPC_DECL(void, abandonBlock,
@@ -215,18 +291,18 @@ _HDFS_PRIM_RPC_BODY(abandonBlock,
 	,
 	,
 	,
-	hdfs_block_copy(block),
-	hdfs_string_new(path),
-	hdfs_string_new(client)
+	(block? block : &_null_block),
+	_STRING_ARG(path),
+	_STRING_ARG(client)
 )
 
 _HDFS_OBJ_RPC_DECL(addBlock,
 	const char *path, const char *client, struct hdfs_object *excluded)
 _HDFS_OBJ_RPC_BODY(addBlock,
 	H_LOCATED_BLOCK,
-	hdfs_string_new(path),
-	hdfs_string_new(client),
-	hdfs_array_datanode_info_copy(excluded)
+	_STRING_ARG(path),
+	_STRING_ARG(client),
+	(excluded? excluded : &_null_array_datanode_info)
 )
 
 _HDFS_PRIM_RPC_DECL(bool, complete,
@@ -236,8 +312,8 @@ _HDFS_PRIM_RPC_BODY(complete,
 	bool res = object->ob_val._boolean._val,
 	res,
 	false,
-	hdfs_string_new(path),
-	hdfs_string_new(client)
+	_STRING_ARG(path),
+	_STRING_ARG(client)
 )
 
 _HDFS_PRIM_RPC_DECL(bool, rename,
@@ -247,8 +323,8 @@ _HDFS_PRIM_RPC_BODY(rename,
 	bool res = object->ob_val._boolean._val,
 	res,
 	false,
-	hdfs_string_new(src),
-	hdfs_string_new(dst)
+	_STRING_ARG(src),
+	_STRING_ARG(dst)
 )
 
 _HDFS_PRIM_RPC_DECL(bool, delete,
@@ -258,8 +334,8 @@ _HDFS_PRIM_RPC_BODY(delete,
 	bool res = object->ob_val._boolean._val,
 	res,
 	false,
-	hdfs_string_new(path),
-	hdfs_boolean_new(can_recurse)
+	_STRING_ARG(path),
+	_BOOLEAN_ARG(can_recurse)
 )
 
 _HDFS_PRIM_RPC_DECL(bool, mkdirs,
@@ -269,18 +345,70 @@ _HDFS_PRIM_RPC_BODY(mkdirs,
 	bool res = object->ob_val._boolean._val,
 	res,
 	false,
-	hdfs_string_new(path),
-	hdfs_fsperms_new(perms)
+	_STRING_ARG(path),
+	_FSPERMS_ARG(perms)
 )
 
 _HDFS_OBJ_RPC_DECL(getListing,
 	const char *path, struct hdfs_object *begin)
 _HDFS_OBJ_RPC_BODY(getListing,
 	H_DIRECTORY_LISTING,
-	hdfs_string_new(path),
-	(begin? hdfs_array_byte_copy(begin) : hdfs_array_byte_new(0, NULL))
+	_STRING_ARG(path),
+	(begin? begin : &_empty_array_byte)
 )
 
+EXPORT_SYM struct hdfs_listing_table *
+hdfs_getListing_table(struct hdfs_namenode *h, const char *path,
+	struct hdfs_object *begin, struct hdfs_object **exception_out)
+{
+	struct hdfs_rpc_response_future future = HDFS_RPC_RESPONSE_FUTURE_INITIALIZER;
+	struct hdfs_listing_table *res = NULL;
+	struct hdfs_object rpc, *object;
+	const char *error;
+	size_t rawlen;
+	void *raw;
+
+	*exception_out = NULL;
+
+	_rpc_invocation_init(&rpc,
+	    HDFS_RPC_getListing,
+	    _STRING_ARG(path),
+	    (begin? begin : &_empty_array_byte),
+	    NULL);
+	error = hdfs_namenode_invoke(h, &rpc, &future);
+	if (error) {
+		*exception_out = hdfs_protocol_exception_new(H_IPC_EXCEPTION,
+		    error);
+		return NULL;
+	}
+
+	// With lazy decode, the listing never becomes objects.
+	hdfs_future_get_raw(&future, &object, &raw, &rawlen);
+	if (raw) {
+		error = hdfs_listing_table_from_proto(raw, rawlen, &res);
+		free(raw);
+		if (error)
+			*exception_out = hdfs_protocol_exception_new(
+			    H_PROTOCOL_EXCEPTION, error);
+		return res;
+	}
+
+	ASSERT(object->ob_type == H_DIRECTORY_LISTING ||
+	    (object->ob_type == H_NULL &&
+	     object->ob_val._null._type == H_DIRECTORY_LISTING) ||
+	    object->ob_type == H_PROTOCOL_EXCEPTION);
+
+	if (object->ob_type == H_PROTOCOL_EXCEPTION) {
+		*exception_out = object;
+		return NULL;
+	}
+
+	if (object->ob_type == H_DIRECTORY_LISTING)
+		res = hdfs_listing_table_new(object);
+	hdfs_object_free(object);
+	return res;
+}
+
 _HDFS_PRIM_RPC_DECL(void, renewLease,
 	const char *client)
 _HDFS_PRIM_RPC_BODY(renewLease,
@@ -288,7 +416,7 @@ _HDFS_PRIM_RPC_BODY(renewLease,
 	,
 	,
 	,
-	hdfs_string_new(client)
+	_STRING_ARG(client)
 )
 
 _HDFS_OBJ_RPC_DECL(getStats)
@@ -303,21 +431,21 @@ _HDFS_PRIM_RPC_BODY(getPreferredBlockSize,
 	int64_t res = object->ob_val._long._val,
 	res,
 	0,
-	hdfs_string_new(path)
+	_STRING_ARG(path)
 )
 
 _HDFS_OBJ_RPC_DECL(getFileInfo,
 	const char *path)
 _HDFS_OBJ_RPC_BODY(getFileInfo,
 	H_FILE_STATUS,
-	hdfs_string_new(path)
+	_STRING_ARG(path)
 )
 
 _HDFS_OBJ_RPC_DECL(getContentSummary,
 	const char *path)
 _HDFS_OBJ_RPC_BODY(getContentSummary,
 	H_CONTENT_SUMMARY,
-	hdfs_string_new(path)
+	_STRING_ARG(path)
 )
 
 _HDFS_PRIM_RPC_DECL(void, setQuota,
@@ -327,9 +455,9 @@ _HDFS_PRIM_RPC_BODY(setQuota,
 	,
 	,
 	,
-	hdfs_string_new(path),
-	hdfs_long_new(ns_quota),
-	hdfs_long_new(ds_quota)
+	_STRING_ARG(path),
+	_LONG_ARG(ns_quota),
+	_LONG_ARG(ds_quota)
 )
 
 _HDFS_PRIM_RPC_DECL(void, fsync,
@@ -339,8 +467,8 @@ _HDFS_PRIM_RPC_BODY(fsync,
 	,
 	,
 	,
-	hdfs_string_new(path),
-	hdfs_string_new(client)
+	_STRING_ARG(path),
+	_STRING_ARG(client)
 )
 
 _HDFS_PRIM_RPC_DECL(void, setTimes,
@@ -350,9 +478,9 @@ _HDFS_PRIM_RPC_BODY(setTimes,
 	,
 	,
 	,
-	hdfs_string_new(path),
-	hdfs_long_new(mtime),
-	hdfs_long_new(atime)
+	_STRING_ARG(path),
+	_LONG_ARG(mtime),
+	_LONG_ARG(atime)
 )
 
 _HDFS_PRIM_RPC_DECL(bool, recoverLease,
@@ -362,8 +490,8 @@ _HDFS_PRIM_RPC_BODY(recoverLease,
 	bool res = object->ob_val._boolean._val,
 	res,
 	false,
-	hdfs_string_new(path),
-	hdfs_string_new(client)
+	_STRING_ARG(path),
+	_STRING_ARG(client)
 )
 
 _HDFS_PRIM_RPC_DECL(void, concat,
@@ -373,15 +501,15 @@ _HDFS_PRIM_RPC_BODY(concat,
 	,
 	,
 	,
-	hdfs_string_new(target),
-	(srcs? hdfs_array_string_copy(srcs) : hdfs_array_string_new(0, NULL))
+	_STRING_ARG(target),
+	(srcs? srcs : &_empty_array_string)
 )
 
 _HDFS_OBJ_RPC_DECL(getDelegationToken,
 	const char *renewer)
 _HDFS_OBJ_RPC_BODY(getDelegationToken,
 	H_TOKEN,
-	hdfs_text_new(renewer)
+	_TEXT_ARG(renewer)
 )
 
 _HDFS_PRIM_RPC_DECL(void, cancelDelegationToken,
@@ -391,7 +519,7 @@ _HDFS_PRIM_RPC_BODY(cancelDelegationToken,
 	,
 	,
 	,
-	(token? hdfs_token_copy(token) : hdfs_token_new_empty())
+	(token? token : &_empty_token)
 )
 
 _HDFS_PRIM_RPC_DECL(int64_t, renewDelegationToken,
@@ -401,7 +529,7 @@ _HDFS_PRIM_RPC_BODY(renewDelegationToken,
 	int64_t res = object->ob_val._long._val,
 	res,
 	0,
-	(token? hdfs_token_copy(token) : hdfs_token_new_empty())
+	(token? token : &_empty_token)
 )
 
 _HDFS_PRIM_RPC_DECL(bool, setSafeMode,
@@ -411,14 +539,14 @@ _HDFS_PRIM_RPC_BODY(setSafeMode,
 	bool res = object->ob_val._boolean._val,
 	res,
 	false,
-	hdfs_safemodeaction_new(mode)
+	_MODE_ARG(H_SAFEMODEACTION, mode)
 )
 
 _HDFS_OBJ_RPC_DECL(getDatanodeReport,
 	const char *mode)
 _HDFS_OBJ_RPC_BODY(getDatanodeReport,
 	H_ARRAY_DATANODE_INFO,
-	hdfs_dnreporttype_new(mode)
+	_MODE_ARG(H_DNREPORTTYPE, mode)
 )
 
 _HDFS_PRIM_RPC_DECL(void, reportBadBlocks,
@@ -428,15 +556,14 @@ _HDFS_PRIM_RPC_BODY(reportBadBlocks,
 	,
 	,
 	,
-	(blocks? hdfs_array_locatedblock_copy(blocks) :
-	 hdfs_array_locatedblock_new())
+	(blocks? blocks : &_empty_array_locatedblock)
 )
 
 _HDFS_OBJ_RPC_DECL(distributedUpgradeProgress,
 	const char *act)
 _HDFS_OBJ_RPC_BODY(distributedUpgradeProgress,
 	H_UPGRADE_STATUS_REPORT,
-	hdfs_upgradeaction_new(act)
+	_MODE_ARG(H_UPGRADE_ACTION, act)
 )
 
 _HDFS_PRIM_RPC_DECL(void, finalizeUpgrade)
@@ -473,7 +600,7 @@ _HDFS_PRIM_RPC_BODY(metaSave,
 	,
 	,
 	,
-	hdfs_string_new(filename)
+	_STRING_ARG(filename)
 )
 
 _HDFS_PRIM_RPC_DECL(void, setBalancerBandwidth,
@@ -483,7 +610,7 @@ _HDFS_PRIM_RPC_BODY(setBalancerBandwidth,
 	,
 	,
 	,
-	hdfs_long_new(bw)
+	_LONG_ARG(bw)
 )
 
 _HDFS_PRIM_RPC_DECL(bool, isFileClosed,
@@ -493,7 +620,7 @@ _HDFS_PRIM_RPC_BODY(isFileClosed,
 	bool res = object->ob_val._boolean._val,
 	res,
 	false,
-	hdfs_string_new(src)
+	_STRING_ARG(src)
 )
 
 #define _HDFS2_PRIM_RPC_DECL(type, name, args...) \
@@ -513,7 +640,7 @@ _HDFS_OBJ_RPC_BODY(getServerDefaults,
 _HDFS2_OBJ_RPC_DECL(getFileLinkInfo, const char *src)
 _HDFS_OBJ_RPC_BODY(getFileLinkInfo,
 	H_FILE_STATUS,
-	hdfs_string_new(src)
+	_STRING_ARG(src)
 )
 
 _HDFS2_PRIM_RPC_DECL(void, createSymlink,
@@ -524,14 +651,14 @@ _HDFS_PRIM_RPC_BODY(createSymlink,
 	,
 	,
 	,
-	hdfs_string_new(target),
-	hdfs_string_new(link),
-	hdfs_fsperms_new(dirperm),
-	hdfs_boolean_new(createparent)
+	_STRING_ARG(target),
+	_STRING_ARG(link),
+	_FSPERMS_ARG(dirperm),
+	_BOOLEAN_ARG(createparent)
 )
 
 _HDFS2_OBJ_RPC_DECL(getLinkTarget, const char *path)
 _HDFS_OBJ_RPC_BODY(getLinkTarget,
 	H_STRING,
-	hdfs_string_new(path)
+	_STRING_ARG(path)
 )
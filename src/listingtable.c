@@ -0,0 +1,411 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hadoofus/objects.h>
+
+#include "heapbuf.h"
+#include "pbwire.h"
+#include "util.h"
+
+// Every source (objects, a v1 Writable listing, a v2 GetListingResponseProto)
+// is first reduced to an array of hdfs_file_status whose strings are borrowed
+// from the source, with their lengths. _lt_build() then interns owners and
+// groups and lays the table out in a single allocation.
+
+#define _LT_FNV_INIT	UINT32_C(2166136261)
+#define _LT_FNV_PRIME	UINT32_C(16777619)
+
+enum { _LT_NAME, _LT_OWNER, _LT_GROUP, _LT_SYMLINK, _LT_NSTRS };
+
+struct _lt_lens {
+	size_t ll_len[_LT_NSTRS];
+};
+
+// Owners and groups, interned into an open-addressed table.
+struct _lt_users {
+	uint32_t *lu_slots,	/* index + 1, or 0 if free */
+		 lu_mask,
+		 lu_num;
+	const char **lu_strs;
+	size_t *lu_lens,
+	       lu_bytes;
+};
+
+static size_t
+_lt_len(const char *s, const struct _lt_lens *lens, int i, unsigned which)
+{
+
+	if (s == NULL)
+		return 0;
+	return lens ? lens[i].ll_len[which] : strlen(s);
+}
+
+static uint32_t
+_lt_intern(struct _lt_users *lu, const char *s, size_t len)
+{
+	uint32_t h = _LT_FNV_INIT, i, idx;
+
+	for (size_t j = 0; j < len; j++) {
+		h ^= (unsigned char)s[j];
+		h *= _LT_FNV_PRIME;
+	}
+
+	for (i = h & lu->lu_mask; lu->lu_slots[i] != 0;
+	    i = (i + 1) & lu->lu_mask) {
+		idx = lu->lu_slots[i] - 1;
+		if (lu->lu_lens[idx] == len &&
+		    memcmp(lu->lu_strs[idx], s, len) == 0)
+			return idx;
+	}
+
+	idx = lu->lu_num++;
+	lu->lu_strs[idx] = s;
+	lu->lu_lens[idx] = len;
+	lu->lu_bytes += len + 1;
+	lu->lu_slots[i] = idx + 1;
+	return idx;
+}
+
+// Copies a string into the name pool at *off; returns its offset.
+static uint32_t
+_lt_name(char *names, size_t *off, const char *s, size_t len)
+{
+	uint32_t res = *off;
+
+	if (len)
+		memcpy(names + res, s, len);
+	names[res + len] = '\0';
+	*off += len + 1;
+	return res;
+}
+
+// 'lens' may be NULL if all strings are NUL-terminated.
+static struct hdfs_listing_table *
+_lt_build(const struct hdfs_file_status *files, const struct _lt_lens *lens,
+	int nfiles, uint32_t remaining)
+{
+	const struct hdfs_file_status *fs;
+	struct hdfs_listing_table *res;
+	struct hdfs_listing_entry *le;
+	struct _lt_users lu = { 0 };
+	size_t nslots, nmax, namebytes = 0, off, o_entries, o_users, o_names,
+	       o_userstrs;
+	uint32_t *user_idx;
+	char *base, *userstrs;
+
+	// Every file could have a distinct owner and group
+	nmax = 2 * (size_t)nfiles + 1;
+	for (nslots = 16; nslots < 2 * nmax; nslots *= 2)
+		;
+
+	lu.lu_mask = nslots - 1;
+	lu.lu_slots = calloc(nslots, sizeof(*lu.lu_slots));
+	lu.lu_strs = malloc(nmax * sizeof(*lu.lu_strs));
+	lu.lu_lens = malloc(nmax * sizeof(*lu.lu_lens));
+	user_idx = malloc(nmax * sizeof(*user_idx));
+	ASSERT(lu.lu_slots && lu.lu_strs && lu.lu_lens && user_idx);
+
+	for (int i = 0; i < nfiles; i++) {
+		fs = &files[i];
+
+		namebytes += _lt_len(fs->_file, lens, i, _LT_NAME) + 1;
+		if (fs->_symlink_target)
+			namebytes += _lt_len(fs->_symlink_target, lens, i,
+			    _LT_SYMLINK) + 1;
+
+		user_idx[2 * i] = _lt_intern(&lu, fs->_owner ? fs->_owner : "",
+		    _lt_len(fs->_owner, lens, i, _LT_OWNER));
+		user_idx[2 * i + 1] = _lt_intern(&lu,
+		    fs->_group ? fs->_group : "",
+		    _lt_len(fs->_group, lens, i, _LT_GROUP));
+	}
+	ASSERT(namebytes < HDFS_LISTING_NONE);
+
+	off = (sizeof(*res) + 7) & ~(size_t)7;
+	o_entries = off;
+	off += nfiles * sizeof(*res->_entries);
+	off = (off + 7) & ~(size_t)7;
+	o_users = off;
+	off += lu.lu_num * sizeof(*res->_users);
+	o_names = off;
+	off += namebytes;
+	o_userstrs = off;
+	off += lu.lu_bytes;
+
+	base = malloc(off);
+	ASSERT(base);
+	res = (void *)base;
+
+	*res = (struct hdfs_listing_table) {
+		._num_files = nfiles,
+		._num_users = lu.lu_num,
+		._remaining_entries = remaining,
+		._entries = (void *)(base + o_entries),
+		._users = (void *)(base + o_users),
+		._names = base + o_names,
+		._bytes = off,
+	};
+
+	userstrs = base + o_userstrs;
+	off = 0;
+	for (uint32_t u = 0; u < lu.lu_num; u++)
+		res->_users[u] = userstrs + _lt_name(userstrs, &off,
+		    lu.lu_strs[u], lu.lu_lens[u]);
+
+	off = 0;
+	for (int i = 0; i < nfiles; i++) {
+		fs = &files[i];
+		le = &res->_entries[i];
+
+		*le = (struct hdfs_listing_entry) {
+			._size = fs->_size,
+			._block_size = fs->_block_size,
+			._mtime = fs->_mtime,
+			._atime = fs->_atime,
+			._fileid = fs->_fileid,
+			._name = _lt_name(res->_names, &off, fs->_file,
+			    _lt_len(fs->_file, lens, i, _LT_NAME)),
+			._symlink_target = HDFS_LISTING_NONE,
+			._owner = user_idx[2 * i],
+			._group = user_idx[2 * i + 1],
+			._num_children = fs->_num_children,
+			._replication = fs->_replication,
+			._permissions = fs->_permissions,
+			._type = fs->_type,
+			._directory = fs->_directory,
+		};
+		if (fs->_symlink_target)
+			le->_symlink_target = _lt_name(res->_names, &off,
+			    fs->_symlink_target, _lt_len(fs->_symlink_target,
+			    lens, i, _LT_SYMLINK));
+	}
+
+	free(lu.lu_slots);
+	free(lu.lu_strs);
+	free(lu.lu_lens);
+	free(user_idx);
+	return res;
+}
+
+EXPORT_SYM struct hdfs_listing_table *
+hdfs_listing_table_new(const struct hdfs_object *directory_listing)
+{
+	const struct hdfs_directory_listing *dl;
+	struct hdfs_listing_table *res;
+	struct hdfs_file_status *files;
+
+	ASSERT(directory_listing->ob_type == H_DIRECTORY_LISTING);
+	dl = &directory_listing->ob_val._directory_listing;
+
+	files = malloc((dl->_num_files + 1) * sizeof(*files));
+	ASSERT(files);
+	for (int i = 0; i < dl->_num_files; i++)
+		files[i] = dl->_files[i]->ob_val._file_status;
+
+	res = _lt_build(files, NULL, dl->_num_files, dl->_remaining_entries);
+	free(files);
+	return res;
+}
+
+// Like _oslurp_file_status(), but borrowing the strings.
+static void
+_lt_slurp_file_status(struct hdfs_heap_buf *b, struct hdfs_file_status *fs,
+	struct _lt_lens *lens)
+{
+
+	fs->_file = __DECONST(char *,
+	    _bslurp_string32_ref(b, &lens->ll_len[_LT_NAME]));
+	if (b->used < 0)
+		return;
+	fs->_size = _bslurp_s64(b);
+	if (b->used < 0)
+		return;
+	fs->_directory = _bslurp_s8(b);
+	if (b->used < 0)
+		return;
+	fs->_replication = _bslurp_s16(b);
+	if (b->used < 0)
+		return;
+	fs->_block_size = _bslurp_s64(b);
+	if (b->used < 0)
+		return;
+	fs->_mtime = _bslurp_s64(b);
+	if (b->used < 0)
+		return;
+	fs->_atime = _bslurp_s64(b);
+	if (b->used < 0)
+		return;
+	fs->_permissions = _bslurp_s16(b);
+	if (b->used < 0)
+		return;
+	if (fs->_permissions < 0) {
+		b->used = _H_PARSE_ERROR;
+		return;
+	}
+	fs->_owner = __DECONST(char *,
+	    _bslurp_text_ref(b, &lens->ll_len[_LT_OWNER]));
+	if (b->used < 0)
+		return;
+	fs->_group = __DECONST(char *,
+	    _bslurp_text_ref(b, &lens->ll_len[_LT_GROUP]));
+}
+
+EXPORT_SYM struct hdfs_listing_table *
+hdfs_listing_table_slurp(struct hdfs_heap_buf *rbuf)
+{
+	struct hdfs_listing_table *res = NULL;
+	struct hdfs_file_status *files = NULL;
+	struct _lt_lens *lens = NULL;
+	int32_t len, remaining;
+	int alloced = 0;
+
+	len = _bslurp_s32(rbuf);
+	if (rbuf->used < 0)
+		return NULL;
+	if (len < 0) {
+		rbuf->used = _H_PARSE_ERROR;
+		return NULL;
+	}
+
+	for (int i = 0; i < len; i++) {
+		// Grown as entries arrive, rather than trusting 'len'
+		if (i == alloced) {
+			alloced = alloced ? 2 * alloced : 64;
+			files = realloc(files, alloced * sizeof(*files));
+			lens = realloc(lens, alloced * sizeof(*lens));
+			ASSERT(files && lens);
+		}
+
+		memset(&files[i], 0, sizeof(files[i]));
+		_lt_slurp_file_status(rbuf, &files[i], &lens[i]);
+		if (rbuf->used < 0)
+			goto out;
+	}
+
+	remaining = _bslurp_s32(rbuf);
+	if (rbuf->used < 0)
+		goto out;
+	if (remaining < 0) {
+		rbuf->used = _H_PARSE_ERROR;
+		goto out;
+	}
+
+	res = _lt_build(files, lens, len, (uint32_t)remaining);
+
+out:
+	free(files);
+	free(lens);
+	return res;
+}
+
+EXPORT_SYM const char *
+hdfs_listing_table_from_proto(const void *buf, size_t len,
+	struct hdfs_listing_table **table_out)
+{
+	struct hdfs_file_status *files = NULL;
+	uint32_t remaining;
+	int nfiles = 0;
+	bool found;
+	char *copy;
+
+	*table_out = NULL;
+
+	// One spare byte, to terminate a string that ends the message.
+	copy = malloc(len + 1);
+	ASSERT(copy);
+	memcpy(copy, buf, len);
+
+	if (!_pbwire_listing_files(copy, len, &files, &nfiles, &remaining,
+	    &found)) {
+		free(copy);
+		return "Invalid GetListingResponseProto";
+	}
+
+	if (found)
+		*table_out = _lt_build(files, NULL, nfiles, remaining);
+	free(files);
+	free(copy);
+	return NULL;
+}
+
+EXPORT_SYM void
+hdfs_listing_table_free(struct hdfs_listing_table *lt)
+{
+
+	free(lt);
+}
+
+EXPORT_SYM const char *
+hdfs_listing_table_name(const struct hdfs_listing_table *lt, int i)
+{
+
+	return lt->_names + lt->_entries[i]._name;
+}
+
+EXPORT_SYM const char *
+hdfs_listing_table_owner(const struct hdfs_listing_table *lt, int i)
+{
+
+	return lt->_users[lt->_entries[i]._owner];
+}
+
+EXPORT_SYM const char *
+hdfs_listing_table_group(const struct hdfs_listing_table *lt, int i)
+{
+
+	return lt->_users[lt->_entries[i]._group];
+}
+
+EXPORT_SYM const char *
+hdfs_listing_table_symlink_target(const struct hdfs_listing_table *lt, int i)
+{
+
+	if (lt->_entries[i]._symlink_target == HDFS_LISTING_NONE)
+		return NULL;
+	return lt->_names + lt->_entries[i]._symlink_target;
+}
+
+EXPORT_SYM struct hdfs_object *
+hdfs_listing_table_file_status(const struct hdfs_listing_table *lt, int i)
+{
+	const struct hdfs_listing_entry *le;
+	struct hdfs_file_status *fs;
+	struct hdfs_object *res;
+	const char *target;
+
+	ASSERT(i >= 0 && i < lt->_num_files);
+	le = &lt->_entries[i];
+
+	res = hdfs_file_status_new_ex(hdfs_listing_table_name(lt, i),
+	    le->_size, le->_directory, le->_replication, le->_block_size,
+	    le->_mtime, le->_atime, le->_permissions,
+	    hdfs_listing_table_owner(lt, i), hdfs_listing_table_group(lt, i));
+
+	fs = &res->ob_val._file_status;
+	fs->_type = le->_type;
+	fs->_fileid = le->_fileid;
+	fs->_num_children = le->_num_children;
+
+	target = hdfs_listing_table_symlink_target(lt, i);
+	if (target) {
+		fs->_symlink_target = strdup(target);
+		ASSERT(fs->_symlink_target);
+	}
+	return res;
+}
+
+EXPORT_SYM struct hdfs_object *
+hdfs_listing_table_directory_listing(const struct hdfs_listing_table *lt)
+{
+	struct hdfs_object *res;
+
+	res = hdfs_directory_listing_new();
+	for (int i = 0; i < lt->_num_files; i++)
+		hdfs_directory_listing_append_file_status(res,
+		    hdfs_listing_table_file_status(lt, i), NULL);
+	res->ob_val._directory_listing._remaining_entries =
+	    lt->_remaining_entries;
+	return res;
+}
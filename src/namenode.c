@@ -1,6 +1,7 @@
+#include <sys/uio.h>
+
 #include <errno.h>
 #include <fcntl.h>
-#include <poll.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -10,26 +11,36 @@
 
 #include "net.h"
 #include "objects-internal.h"
+#include "pending.h"
 #include "pthread_wrappers.h"
+#include "reactor.h"
 #include "rpc2-internal.h"
+#include "sendq.h"
 #include "util.h"
 
 static struct hdfs_namenode *	_namenode_copyref_unlocked(struct hdfs_namenode *);
 static void			_namenode_decref(struct hdfs_namenode *);
 static void *			_namenode_recv_worker(void *);
 
-static void	_namenode_pending_insert_unlocked(struct hdfs_namenode *n,
-		int64_t msgno, struct hdfs_rpc_response_future *future,
-		hdfs_object_slurper slurper);
-
-static struct hdfs_rpc_response_future *
-		_namenode_pending_remove(struct hdfs_namenode *n, int64_t msgno);
+static const char *	_namenode_invoke(struct hdfs_namenode *n,
+			struct hdfs_object **rpcs, int count,
+			struct hdfs_rpc_response_future **futures,
+			hdfs_rpc_callback cb, void *cbctx);
+static bool	_namenode_pending_remove(struct hdfs_namenode *n, int64_t msgno,
+		struct _hdfs_pending *pd);
+static void	_namenode_fail_pending(struct hdfs_namenode *n, const char *why);
+static void	_namenode_set_error(struct hdfs_namenode *n, int error);
 
 static void	_future_complete(struct hdfs_rpc_response_future *future,
 		struct hdfs_object *obj);
+static void	_future_complete_raw(struct hdfs_rpc_response_future *future,
+		struct _hdfs_result *result,
+		struct hdfs_object *(*slurper)(struct hdfs_heap_buf *, bool));
+static void	_future_finish(struct hdfs_rpc_response_future *future,
+		struct hdfs_object **object, void **raw_out, size_t *rawlen_out);
 
 // SASL helpers
-static void	_conn_try_desasl(struct hdfs_namenode *n);
+static void	_conn_try_desasl(struct hdfs_namenode *n, size_t hiwat);
 static int	_getssf(sasl_conn_t *);
 static void	_sasl_interacts(sasl_interact_t *);
 
@@ -48,7 +59,6 @@ EXPORT_SYM void
 hdfs_namenode_init(struct hdfs_namenode *n, enum hdfs_kerb kerb_prefs)
 {
 	n->nn_lock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
-	n->nn_sendlock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
 	n->nn_refs = 1;
 	n->nn_sock = -1;
 	n->nn_dead = false;
@@ -57,19 +67,21 @@ hdfs_namenode_init(struct hdfs_namenode *n, enum hdfs_kerb kerb_prefs)
 	n->nn_destroy_cb = NULL;
 	n->nn_pending = NULL;
 	n->nn_pending_len = 0;
+	n->nn_pending_size = 0;
 	n->nn_recver_started = false;
+	n->nn_reactor = NULL;
+	n->nn_recv_detached = false;
 
 	n->nn_kerb = kerb_prefs;
 	n->nn_sasl_ctx = NULL;
 	n->nn_sasl_ssf = 0;
 
-	n->nn_recvbuf = NULL;
-	n->nn_recvbuf_used = 0;
-	n->nn_recvbuf_size = 0;
-
-	n->nn_objbuf = NULL;
-	n->nn_objbuf_used = 0;
-	n->nn_objbuf_size = 0;
+	memset(&n->nn_recvbuf, 0, sizeof(n->nn_recvbuf));
+	memset(&n->nn_objbuf, 0, sizeof(n->nn_objbuf));
+	memset(&n->nn_v1_scan, 0, sizeof(n->nn_v1_scan));
+	n->nn_recvbuf_hiwat = HDFS_NN_RECVBUF_HIWAT;
+	n->nn_arena_results = false;
+	n->nn_lazy_decode = false;
 
 	n->nn_proto = HDFS_NN_v1;
 	memset(n->nn_client_id, 0, sizeof(n->nn_client_id));
@@ -333,22 +345,111 @@ hdfs_namenode_get_msgno(struct hdfs_namenode *n)
 	return res;
 }
 
+EXPORT_SYM const char *
+hdfs_namenode_get_error(struct hdfs_namenode *n)
+{
+	const char *res = NULL;
+
+	_lock(&n->nn_lock);
+	if (n->nn_error)
+		res = strerror(n->nn_error);
+	else if (n->nn_sock == -1)
+		res = "Not connected";
+	_unlock(&n->nn_lock);
+
+	if (res == NULL)
+		res = __atomic_load_n(&n->nn_send_error, __ATOMIC_SEQ_CST);
+	return res;
+}
+
+EXPORT_SYM void
+hdfs_namenode_set_reactor(struct hdfs_namenode *n, struct hdfs_reactor *r)
+{
+
+	_lock(&n->nn_lock);
+	ASSERT(!n->nn_recver_started);
+	n->nn_reactor = r;
+	_unlock(&n->nn_lock);
+}
+
+EXPORT_SYM void
+hdfs_namenode_set_recvbuf_hiwat(struct hdfs_namenode *n, size_t hiwat)
+{
+
+	_lock(&n->nn_lock);
+	n->nn_recvbuf_hiwat = hiwat;
+	_unlock(&n->nn_lock);
+}
+
+EXPORT_SYM void
+hdfs_namenode_set_arena_results(struct hdfs_namenode *n, bool arena)
+{
+
+	_lock(&n->nn_lock);
+	n->nn_arena_results = arena;
+	_unlock(&n->nn_lock);
+}
+
+EXPORT_SYM void
+hdfs_namenode_set_lazy_decode(struct hdfs_namenode *n, bool lazy)
+{
+
+	_lock(&n->nn_lock);
+	n->nn_lazy_decode = lazy;
+	_unlock(&n->nn_lock);
+}
+
 EXPORT_SYM const char *
 hdfs_namenode_invoke(struct hdfs_namenode *n, struct hdfs_object *rpc,
 	struct hdfs_rpc_response_future *future)
 {
+
+	return hdfs_namenode_invoke_batch(n, &rpc, &future, 1);
+}
+
+EXPORT_SYM const char *
+hdfs_namenode_invoke_batch(struct hdfs_namenode *n, struct hdfs_object **rpcs,
+	struct hdfs_rpc_response_future **futures, int count)
+{
+
+	ASSERT(count > 0);
+	for (int i = 0; i < count; i++) {
+		ASSERT(futures[i]);
+		ASSERT(!futures[i]->fu_namenode);
+	}
+
+	return _namenode_invoke(n, rpcs, count, futures, NULL, NULL);
+}
+
+EXPORT_SYM const char *
+hdfs_namenode_invoke_cb(struct hdfs_namenode *n, struct hdfs_object *rpc,
+	hdfs_rpc_callback cb, void *cbctx)
+{
+
+	ASSERT(cb);
+
+	return _namenode_invoke(n, &rpc, 1, NULL, cb, cbctx);
+}
+
+// Responses to rpcs[i] complete futures[i] or, if futures is NULL, are passed
+// to cb.
+static const char *
+_namenode_invoke(struct hdfs_namenode *n, struct hdfs_object **rpcs, int count,
+	struct hdfs_rpc_response_future **futures, hdfs_rpc_callback cb,
+	void *cbctx)
+{
 	const char *error = NULL;
 	bool nnlocked, needs_kick;
 	int64_t msgno;
-	struct hdfs_heap_buf hbuf = { 0 };
+	struct _hdfs_sendq_frame *f, *newest, *oldest;
 
 	needs_kick = false;
 
-	ASSERT(future);
-	ASSERT(!future->fu_namenode);
-
-	ASSERT(rpc);
-	ASSERT(rpc->ob_type == H_RPC_INVOCATION);
+	ASSERT(count > 0);
+	for (int i = 0; i < count; i++) {
+		ASSERT(rpcs[i]);
+		ASSERT(rpcs[i]->ob_type == H_RPC_INVOCATION);
+	}
 
 	_lock(&n->nn_lock);
 	nnlocked = true;
@@ -364,14 +465,31 @@ hdfs_namenode_invoke(struct hdfs_namenode *n, struct hdfs_object *rpc,
 		error = "Not authenticated";
 		goto out;
 	}
+	if (n->nn_error) {
+		error = strerror(n->nn_error);
+		goto out;
+	}
 
-	// Take a number
+	// Take a (contiguous) range of numbers
 	msgno = n->nn_msgno;
-	n->nn_msgno++;
-
-	future->fu_namenode = _namenode_copyref_unlocked(n);
-	_namenode_pending_insert_unlocked(n, msgno, future,
-	    _rpc2_slurper_for_rpc(rpc));
+	n->nn_msgno += count;
+
+	for (int i = 0; i < count; i++) {
+		struct _hdfs_pending pd = {
+			.pd_msgno = msgno + i,
+			.pd_slurper = _rpc2_slurper_for_rpc(rpcs[i]),
+		};
+
+		// Callbacks don't hold a reference; see _namenode_decref().
+		if (futures) {
+			futures[i]->fu_namenode = _namenode_copyref_unlocked(n);
+			pd.pd_future = futures[i];
+		} else {
+			pd.pd_cb = cb;
+			pd.pd_cbctx = cbctx;
+		}
+		_pending_insert(n, &pd);
+	}
 
 	if (!n->nn_recver_started)
 		n->nn_recver_started = needs_kick = true;
@@ -382,28 +500,38 @@ hdfs_namenode_invoke(struct hdfs_namenode *n, struct hdfs_object *rpc,
 	if (needs_kick) {
 		int rc;
 
-		rc = pipe(n->nn_recv_sigpipe);
-		ASSERT(rc == 0);
-		rc = pthread_create(&n->nn_recv_thr, NULL,
-		    _namenode_recv_worker, n);
-		ASSERT(rc == 0);
+		if (n->nn_reactor)
+			_reactor_attach(n->nn_reactor, n);
+		else {
+			rc = pthread_create(&n->nn_recv_thr, NULL,
+			    _namenode_recv_worker, n);
+			ASSERT(rc == 0);
+		}
 	}
 
-	// Serialize rpc and transmit
-	_rpc_invocation_set_msgno(rpc, msgno);
-	_rpc_invocation_set_proto(rpc, n->nn_proto);
-	_rpc_invocation_set_clientid(rpc, n->nn_client_id);
-
-	hdfs_object_serialize(&hbuf, rpc);
-
-	if (n->nn_sasl_ssf > 0)
-		_sasl_encode_inplace(n->nn_sasl_ctx, &hbuf);
-
-	_lock(&n->nn_sendlock);
-	error = _write_all(n->nn_sock, hbuf.buf, hbuf.used);
-	_unlock(&n->nn_sendlock);
+	// Serialize rpcs into a chain of frames, newest first ...
+	newest = oldest = NULL;
+	for (int i = 0; i < count; i++) {
+		_rpc_invocation_set_msgno(rpcs[i], msgno + i);
+		_rpc_invocation_set_proto(rpcs[i], n->nn_proto);
+		_rpc_invocation_set_clientid(rpcs[i], n->nn_client_id);
+
+		f = malloc(sizeof(*f));
+		ASSERT(f);
+		memset(f, 0, sizeof(*f));
+		hdfs_object_serialize(&f->sf_buf, rpcs[i]);
+
+		f->sf_next = newest;
+		newest = f;
+		if (oldest == NULL)
+			oldest = f;
+	}
 
-	free(hbuf.buf);
+	// ... and hand them to the sender (possibly us). SASL wrapping happens
+	// there, in wire order. A failed write breaks the connection, which
+	// fails these rpcs along with everything else pending.
+	_sendq_push(n, newest, oldest);
+	_sendq_flush(n);
 
 out:
 	if (nnlocked)
@@ -416,13 +544,24 @@ hdfs_future_get(struct hdfs_rpc_response_future *future, struct hdfs_object **ob
 {
 
 	_lock(&future->fu_lock);
-	while (!future->fu_res)
+	while (!future->fu_res && !future->fu_raw)
 		_wait(&future->fu_lock, &future->fu_cond);
 	_unlock(&future->fu_lock);
-	*object = future->fu_res;
 
-	_namenode_decref(future->fu_namenode);
-	memset(future, 0, sizeof *future);
+	_future_finish(future, object, NULL, NULL);
+}
+
+EXPORT_SYM void
+hdfs_future_get_raw(struct hdfs_rpc_response_future *future,
+	struct hdfs_object **object, void **raw_out, size_t *rawlen_out)
+{
+
+	_lock(&future->fu_lock);
+	while (!future->fu_res && !future->fu_raw)
+		_wait(&future->fu_lock, &future->fu_cond);
+	_unlock(&future->fu_lock);
+
+	_future_finish(future, object, raw_out, rawlen_out);
 }
 
 EXPORT_SYM bool
@@ -432,17 +571,15 @@ hdfs_future_get_timeout(struct hdfs_rpc_response_future *future, struct hdfs_obj
 
 	absms = _now_ms() + ms;
 	_lock(&future->fu_lock);
-	while (!future->fu_res && _now_ms() < absms)
+	while (!future->fu_res && !future->fu_raw && _now_ms() < absms)
 		_waitlimit(&future->fu_lock, &future->fu_cond, absms);
-	if (!future->fu_res) {
+	if (!future->fu_res && !future->fu_raw) {
 		_unlock(&future->fu_lock);
 		return false;
 	}
 	_unlock(&future->fu_lock);
-	*object = future->fu_res;
 
-	_namenode_decref(future->fu_namenode);
-	memset(future, 0, sizeof *future);
+	_future_finish(future, object, NULL, NULL);
 	return true;
 }
 
@@ -489,23 +626,27 @@ _namenode_decref(struct hdfs_namenode *n)
 
 		ASSERT(n->nn_dead);
 		if (n->nn_recver_started) {
-			rc = write(n->nn_recv_sigpipe[1], "a", 1);
-			ASSERT(rc == 1);
-
-			rc = pthread_join(n->nn_recv_thr, NULL);
-			ASSERT(rc == 0);
+			// Wake the receiver out of recv(2)
+			_lock(&n->nn_lock);
+			if (n->nn_sock != -1)
+				shutdown(n->nn_sock, SHUT_RDWR);
+			_unlock(&n->nn_lock);
 
-			close(n->nn_recv_sigpipe[1]);
-			close(n->nn_recv_sigpipe[0]);
+			if (n->nn_reactor)
+				_reactor_wait_detached(n->nn_reactor, n);
+			else {
+				rc = pthread_join(n->nn_recv_thr, NULL);
+				ASSERT(rc == 0);
+			}
 		}
 		if (n->nn_sock != -1)
 			close(n->nn_sock);
-		if (n->nn_pending)
-			free(n->nn_pending);
-		if (n->nn_recvbuf)
-			free(n->nn_recvbuf);
-		if (n->nn_objbuf)
-			free(n->nn_objbuf);
+		ASSERT(n->nn_sendq == NULL);
+		// Futures hold a reference, so only callbacks can be left over.
+		_namenode_fail_pending(n,
+		    "Namenode connection was destroyed before the RPC completed");
+		free(n->nn_recvbuf.rb_buf);
+		free(n->nn_objbuf.rb_buf);
 		if (n->nn_destroy_cb)
 			dcb = n->nn_destroy_cb;
 		if (n->nn_sasl_ctx)
@@ -516,193 +657,287 @@ _namenode_decref(struct hdfs_namenode *n)
 	}
 }
 
-static void *
-_namenode_recv_worker(void *v_nn)
+static inline char *
+_rbuf_data(struct _hdfs_rbuf *rb)
+{
+
+	return rb->rb_buf + rb->rb_off;
+}
+
+static inline size_t
+_rbuf_len(struct _hdfs_rbuf *rb)
+{
+
+	return rb->rb_used - rb->rb_off;
+}
+
+// Mark 'len' bytes at the front of the buffer consumed. No data is moved.
+static void
+_rbuf_consume(struct _hdfs_rbuf *rb, size_t len)
+{
+
+	ASSERT(len <= _rbuf_len(rb));
+	rb->rb_off += len;
+	if (rb->rb_off == rb->rb_used)
+		rb->rb_off = rb->rb_used = 0;
+}
+
+// Make room for at least 'want' more bytes after rb_used. Unconsumed bytes
+// (at most one partial frame) are only slid to the front when we run out of
+// tail room. A buffer that an oversized frame grew past 'hiwat' is trimmed
+// back down once that frame is gone.
+static void
+_rbuf_reserve(struct _hdfs_rbuf *rb, size_t want, size_t hiwat)
+{
+	size_t len, newsize;
+
+	if (rb->rb_size - rb->rb_used >= want && rb->rb_size <= hiwat)
+		return;
+
+	len = _rbuf_len(rb);
+	if (rb->rb_off > 0) {
+		if (len > 0)
+			memmove(rb->rb_buf, _rbuf_data(rb), len);
+		rb->rb_off = 0;
+		rb->rb_used = len;
+	}
+
+	newsize = rb->rb_size;
+	if (newsize < hiwat || len + want <= hiwat)
+		newsize = hiwat;
+	while (newsize < len + want)
+		newsize = newsize ? 2 * newsize : want;
+
+	if (newsize != rb->rb_size) {
+		rb->rb_buf = realloc(rb->rb_buf, newsize);
+		ASSERT(rb->rb_buf);
+		rb->rb_size = newsize;
+	}
+}
+
+// Results of _namenode_recv_step()
+#define _RECV_MORE	0	/* made progress; call again */
+#define _RECV_AGAIN	1	/* nothing to do without blocking */
+#define _RECV_DONE	2	/* connection is finished; stop receiving */
+
+// Completes one response if a whole one is buffered; otherwise reads from the
+// socket once (without blocking if 'nonblock').
+static int
+_namenode_recv_step(struct hdfs_namenode *n, bool nonblock)
 {
-	const size_t RESIZE = 16*1024;
+	// Minimum tail room to offer recv(2)
+	const size_t RECV_MIN = 16*1024;
 
-	bool nnlocked = false;
 	int sock, obj_size;
+	size_t hiwat;
 
 	struct _hdfs_result *result;
-	struct hdfs_rpc_response_future *future;
-	struct hdfs_namenode *n = v_nn;
+	struct _hdfs_pending pd;
+	struct _hdfs_rbuf *objbuf;
+	bool found;
 
-	while (true) {
-		char *objbuffer;
-		size_t *objused;
+	_lock(&n->nn_lock);
+	sock = n->nn_sock;
+	hiwat = n->nn_recvbuf_hiwat;
 
-		_lock(&n->nn_lock);
-		nnlocked = true;
-		sock = n->nn_sock;
+	// If hdfs_namenode_destroy() happened, die:
+	if (n->nn_dead && n->nn_refs == 0) {
+		_unlock(&n->nn_lock);
+		return _RECV_DONE;
+	}
+	_unlock(&n->nn_lock);
 
-		// If hdfs_namenode_destroy() happened, die:
-		if (n->nn_dead && n->nn_refs == 0)
-			break;
+	ASSERT(sock != -1);
 
-		_unlock(&n->nn_lock);
-		nnlocked = false;
+	// Decoded responses come straight out of the receive buffer, unless
+	// the connection is SASL-wrapped.
+	if (n->nn_sasl_ssf > 0)
+		objbuf = &n->nn_objbuf;
+	else
+		objbuf = &n->nn_recvbuf;
 
-		ASSERT(sock != -1);
+	if (n->nn_proto == HDFS_NN_v1) {
+		// Don't decode (and throw away) a partial response every time
+		// more of it arrives.
+		result = NULL;
+		if (_hdfs_result_scan(&n->nn_v1_scan, _rbuf_data(objbuf),
+		    _rbuf_len(objbuf)))
+			result = _hdfs_result_deserialize(_rbuf_data(objbuf),
+			    _rbuf_len(objbuf), &obj_size);
+	} else if (n->nn_proto == HDFS_NN_v2)
+		result = _hdfs_result_deserialize_v2(_rbuf_data(objbuf),
+		    _rbuf_len(objbuf), &obj_size, n);
+	else if (n->nn_proto == HDFS_NN_v2_2)
+		result = _hdfs_result_deserialize_v2_2(_rbuf_data(objbuf),
+		    _rbuf_len(objbuf), &obj_size, n);
+	else
+		ASSERT(false);
 
-		if (n->nn_sasl_ssf > 0) {
-			objbuffer = n->nn_objbuf;
-			objused = &n->nn_objbuf_used;
-		} else {
-			objbuffer = n->nn_recvbuf;
-			objused = &n->nn_recvbuf_used;
-		}
+	if (!result) {
+		ssize_t r;
 
-		if (n->nn_proto == HDFS_NN_v1)
-			result = _hdfs_result_deserialize(objbuffer, *objused,
-			    &obj_size);
-		else if (n->nn_proto == HDFS_NN_v2) {
-			_lock(&n->nn_lock);
-			result = _hdfs_result_deserialize_v2(objbuffer,
-			    *objused, &obj_size, n->nn_pending,
-			    n->nn_pending_len);
-			_unlock(&n->nn_lock);
-		} else if (n->nn_proto == HDFS_NN_v2_2) {
+		_rbuf_reserve(&n->nn_recvbuf, RECV_MIN, hiwat);
+
+		// hdfs_namenode_destroy() shuts the socket down to wake us.
+		r = recv(sock, n->nn_recvbuf.rb_buf + n->nn_recvbuf.rb_used,
+		    n->nn_recvbuf.rb_size - n->nn_recvbuf.rb_used,
+		    nonblock ? MSG_DONTWAIT : 0);
+		if (r == 0) {
+			// Unless we shut it down ourselves, the namenode went
+			// away.
 			_lock(&n->nn_lock);
-			result = _hdfs_result_deserialize_v2_2(objbuffer,
-			    *objused, &obj_size, n->nn_pending,
-			    n->nn_pending_len);
+			if (!n->nn_dead)
+				_namenode_set_error(n, ECONNRESET);
 			_unlock(&n->nn_lock);
-		} else
-			ASSERT(false);
+			return _RECV_DONE;
+		}
+		if (r > 0) {
+			n->nn_recvbuf.rb_used += r;
+			if (n->nn_sasl_ssf > 0)
+				_conn_try_desasl(n, hiwat);
+			return _RECV_MORE;
+		}
 
-		if (!result) {
-			ssize_t r, remain = n->nn_recvbuf_size - n->nn_recvbuf_used;
+		if (errno == EINTR)
+			return _RECV_MORE;
+		if (nonblock && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return _RECV_AGAIN;
 
-			if (remain < 4*1024) {
-				n->nn_recvbuf_size += RESIZE;
-				n->nn_recvbuf = realloc(n->nn_recvbuf, n->nn_recvbuf_size);
-				ASSERT(n->nn_recvbuf);
-				remain = n->nn_recvbuf_size - n->nn_recvbuf_used;
-			}
+		// bail on socket errors
+		_lock(&n->nn_lock);
+		_namenode_set_error(n, errno);
+		_unlock(&n->nn_lock);
+		return _RECV_DONE;
+	}
 
-			r = recv(sock, n->nn_recvbuf + n->nn_recvbuf_used,
-			    remain, MSG_DONTWAIT);
-			if (r == 0)
-				goto out;
-			if (r > 0) {
-				n->nn_recvbuf_used += r;
-				if (n->nn_sasl_ssf > 0)
-					_conn_try_desasl(n);
-			} else {
-				int serrno;
-
-				serrno = errno;
-				if (errno == EAGAIN || errno == EWOULDBLOCK) {
-					struct pollfd pfds[] = { {
-						.fd = sock,
-						.events = POLLIN,
-					}, {
-						.fd = n->nn_recv_sigpipe[0],
-						.events = POLLIN,
-					} };
-					int rc;
-
-					do {
-						rc = poll(pfds, nelem(pfds),
-						    -1 /* infinite */);
-					} while (rc < 0 && errno == EINTR);
-					ASSERT(rc > 0);
-
-					continue;
-				}
-				// bail on socket errors
-				_lock(&n->nn_lock);
-				n->nn_error = serrno;
-				close(n->nn_sock);
-				n->nn_sock = -1;
-				n->nn_dead = true;
-				_unlock(&n->nn_lock);
-				break;
-			}
-			continue;
-		}
+	if (result == _HDFS_INVALID_PROTO) {
+		// bail on protocol errors
+		_lock(&n->nn_lock);
+		_namenode_set_error(n, EBADMSG);
+		_unlock(&n->nn_lock);
+		return _RECV_DONE;
+	}
 
-		if (result == _HDFS_INVALID_PROTO) {
-			// bail on protocol errors
-			_lock(&n->nn_lock);
-			n->nn_error = EBADMSG;
-			close(n->nn_sock);
-			n->nn_sock = -1;
-			n->nn_dead = true;
-			_unlock(&n->nn_lock);
-			break;
-		}
+	// if we got here, we have read a valid / complete hdfs result
+	// off the wire; skip the buffer forward:
+	_rbuf_consume(objbuf, obj_size);
+	memset(&n->nn_v1_scan, 0, sizeof(n->nn_v1_scan));
 
-		// if we got here, we have read a valid / complete hdfs result
-		// off the wire; skip the buffer forward:
+	found = _namenode_pending_remove(n, result->rs_msgno, &pd);
+	ASSERT(found); // got a response to a msgno we didn't request
 
-		*objused -= obj_size;
-		if (*objused)
-			memmove(objbuffer, objbuffer + obj_size, *objused);
+	if (pd.pd_cb)
+		pd.pd_cb(result->rs_obj, pd.pd_cbctx);
+	else if (result->rs_raw)
+		_future_complete_raw(pd.pd_future, result, pd.pd_slurper);
+	else
+		_future_complete(pd.pd_future, result->rs_obj);
 
-		future = _namenode_pending_remove(n, result->rs_msgno);
-		ASSERT(future); // got a response to a msgno we didn't request
+	// don't free the object (or raw response) we just handed the user:
+	result->rs_obj = NULL;
+	result->rs_raw = NULL;
+	_hdfs_result_free(result);
 
-		_future_complete(future, result->rs_obj);
+	return _RECV_MORE;
+}
 
-		// don't free the object we just handed the user:
-		result->rs_obj = NULL;
-		_hdfs_result_free(result);
-	}
+// Caller must hold nn_lock. Marks the connection broken: no new RPCs are
+// accepted, and the socket is shut down (but left open, as a sender may still
+// be using it). _namenode_recv_finish() fails whatever was already pending.
+static void
+_namenode_set_error(struct hdfs_namenode *n, int error)
+{
 
-out:
-	if (nnlocked)
-		_unlock(&n->nn_lock);
+	ASSERT(error != 0);
+	if (n->nn_error == 0)
+		n->nn_error = error;
+	shutdown(n->nn_sock, SHUT_RDWR);
+}
+
+static void
+_namenode_recv_finish(struct hdfs_namenode *n)
+{
+	char why[128];
+	int error;
+
+	_lock(&n->nn_lock);
+	error = n->nn_error;
+	_unlock(&n->nn_lock);
+
+	// Otherwise, the connection was destroyed and _namenode_decref() does
+	// this.
+	if (error == 0)
+		return;
+
+	snprintf(why, sizeof(why), "Namenode connection lost: %s",
+	    strerror(error));
+	_namenode_fail_pending(n, why);
+}
 
-	/*
-	 * Until Namenode communication error is plumbed up to the user, it
-	 * doesn't do them any good to wait on a response to RPC that is never
-	 * coming.
-	 */
-	ASSERT(n->nn_error == 0);
+static void *
+_namenode_recv_worker(void *v_nn)
+{
+	struct hdfs_namenode *n = v_nn;
+
+	while (_namenode_recv_step(n, false) != _RECV_DONE)
+		;
 
+	_namenode_recv_finish(n);
 	return NULL;
 }
 
-static void
-_namenode_pending_insert_unlocked(struct hdfs_namenode *n, int64_t msgno,
-	struct hdfs_rpc_response_future *future, hdfs_object_slurper slurper)
+void
+_namenode_reactor_service(struct hdfs_namenode *n)
 {
-	const int RESIZE_FACTOR = 16;
+	int r;
 
-	if (n->nn_pending_len % RESIZE_FACTOR == 0) {
-		n->nn_pending = realloc(n->nn_pending,
-		    (n->nn_pending_len + RESIZE_FACTOR) * sizeof *n->nn_pending);
-		ASSERT(n->nn_pending);
+	do {
+		r = _namenode_recv_step(n, true);
+	} while (r == _RECV_MORE);
+
+	if (r == _RECV_AGAIN) {
+		_reactor_rearm(n->nn_reactor, n);
+		return;
 	}
 
-	n->nn_pending[n->nn_pending_len].pd_msgno = msgno;
-	n->nn_pending[n->nn_pending_len].pd_future = future;
-	n->nn_pending[n->nn_pending_len].pd_slurper = slurper;
-	n->nn_pending_len++;
+	_namenode_recv_finish(n);
+	_reactor_detach(n->nn_reactor, n);
 }
 
-static struct hdfs_rpc_response_future *
-_namenode_pending_remove(struct hdfs_namenode *n, int64_t msgno)
+static bool
+_namenode_pending_remove(struct hdfs_namenode *n, int64_t msgno,
+	struct _hdfs_pending *pd)
 {
-	struct hdfs_rpc_response_future *res = NULL;
+	bool res;
 
 	_lock(&n->nn_lock);
+	res = _pending_remove(n, msgno, pd);
+	_unlock(&n->nn_lock);
 
-	for (int i = 0; i < n->nn_pending_len; i++) {
-		if (n->nn_pending[i].pd_msgno == msgno) {
-			res = n->nn_pending[i].pd_future;
-			if (i != n->nn_pending_len - 1)
-				n->nn_pending[i] = n->nn_pending[n->nn_pending_len - 1];
-			n->nn_pending_len--;
-			break;
-		}
-	}
+	return res;
+}
+
+// Completes every pending RPC with an H_IPC_EXCEPTION; they will never get a
+// response.
+static void
+_namenode_fail_pending(struct hdfs_namenode *n, const char *why)
+{
+	struct _hdfs_pending *pds;
+	struct hdfs_object *exc;
+	int npds;
 
+	_lock(&n->nn_lock);
+	pds = _pending_take_all(n, &npds);
 	_unlock(&n->nn_lock);
 
-	return res;
+	for (int i = 0; i < npds; i++) {
+		exc = hdfs_protocol_exception_new(H_IPC_EXCEPTION, why);
+		if (pds[i].pd_cb)
+			pds[i].pd_cb(exc, pds[i].pd_cbctx);
+		else
+			_future_complete(pds[i].pd_future, exc);
+	}
+	free(pds);
 }
 
 static void
@@ -719,6 +954,59 @@ _future_complete(struct hdfs_rpc_response_future *f, struct hdfs_object *o)
 	_unlock(&f->fu_lock);
 }
 
+static void
+_future_complete_raw(struct hdfs_rpc_response_future *f,
+	struct _hdfs_result *r,
+	struct hdfs_object *(*slurper)(struct hdfs_heap_buf *, bool))
+{
+	ASSERT(r->rs_raw);
+
+	_lock(&f->fu_lock);
+
+	ASSERT(!f->fu_res && !f->fu_raw);
+	f->fu_slurper = slurper;
+	f->fu_arena = r->rs_arena;
+	f->fu_rawlen = r->rs_rawlen;
+	f->fu_raw = r->rs_raw;
+	_notifyall(&f->fu_cond);
+
+	_unlock(&f->fu_lock);
+}
+
+// Hands a completed future's result to the caller, decoding it here (on the
+// caller's thread) if it was left for lazy decode and the caller didn't ask
+// for the raw response. Then releases the future.
+static void
+_future_finish(struct hdfs_rpc_response_future *f, struct hdfs_object **object,
+	void **raw_out, size_t *rawlen_out)
+{
+	struct hdfs_heap_buf rbuf;
+
+	if (raw_out) {
+		*raw_out = f->fu_raw;
+		*rawlen_out = f->fu_rawlen;
+		*object = f->fu_res;
+	} else if (f->fu_raw) {
+		rbuf = (struct hdfs_heap_buf) {
+			.buf = f->fu_raw,
+			.used = 0,
+			.size = f->fu_rawlen,
+		};
+		*object = f->fu_slurper(&rbuf, f->fu_arena);
+		// The connection can't be failed from here, as it is when an
+		// eager decode hits garbage; just this rpc is.
+		if (*object == NULL)
+			*object = hdfs_protocol_exception_new(
+			    H_PROTOCOL_EXCEPTION,
+			    "Invalid response from namenode");
+		free(f->fu_raw);
+	} else
+		*object = f->fu_res;
+
+	_namenode_decref(f->fu_namenode);
+	memset(f, 0, sizeof *f);
+}
+
 static int
 _getssf(sasl_conn_t *ctx)
 {
@@ -745,40 +1033,32 @@ _sasl_interacts(sasl_interact_t *in)
 // Attempt to de-sasl data from recvbuf to objbuf. Assume ssf > 0. On bad data,
 // aborts.
 static void
-_conn_try_desasl(struct hdfs_namenode *n)
+_conn_try_desasl(struct hdfs_namenode *n, size_t hiwat)
 {
-	size_t o = 0;
-	while (o + 4 <= n->nn_recvbuf_used) {
+	struct _hdfs_rbuf *rb = &n->nn_recvbuf;
+
+	while (_rbuf_len(rb) >= 4) {
 		uint32_t clen;
 		int r;
 		const char *out;
 		unsigned outlen;
 
-		clen = _be32dec(n->nn_recvbuf);
+		clen = _be32dec(_rbuf_data(rb));
 		ASSERT(clen <= INT32_MAX);
 
 		// did we get an incomplete sasl chunk?
-		if (clen > n->nn_recvbuf_used - o - 4)
+		if (clen > _rbuf_len(rb) - 4)
 			break;
 
-		r = sasl_decode(n->nn_sasl_ctx, n->nn_recvbuf + o + 4, clen,
+		r = sasl_decode(n->nn_sasl_ctx, _rbuf_data(rb) + 4, clen,
 		    &out, &outlen);
 		if (r != SASL_OK)
 			abort();
 
-		if (outlen > n->nn_objbuf_size - n->nn_objbuf_used) {
-			n->nn_objbuf_size = n->nn_objbuf_used + outlen + 4*1024;
-			n->nn_objbuf = realloc(n->nn_objbuf, n->nn_objbuf_size);
-			ASSERT(n->nn_objbuf);
-		}
-
-		memcpy(n->nn_objbuf + n->nn_objbuf_used, out, outlen);
-		n->nn_objbuf_used += outlen;
-	}
+		_rbuf_reserve(&n->nn_objbuf, outlen, hiwat);
+		memcpy(n->nn_objbuf.rb_buf + n->nn_objbuf.rb_used, out, outlen);
+		n->nn_objbuf.rb_used += outlen;
 
-	if (o > 0) {
-		n->nn_recvbuf_used -= o;
-		if (n->nn_recvbuf_used > 0)
-			memmove(n->nn_recvbuf, n->nn_recvbuf + o, n->nn_recvbuf_used);
+		_rbuf_consume(rb, 4 + clen);
 	}
 }
@@ -1,3 +1,8 @@
+#ifdef __linux__
+// For splice(2)
+# define _GNU_SOURCE
+#endif
+
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #ifdef __linux__
@@ -6,6 +11,8 @@
 #include <sys/uio.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -13,6 +20,11 @@
 #include "net.h"
 #include "util.h"
 
+// glibc only exposes IOV_MAX with _XOPEN_SOURCE; this is its value on Linux.
+#ifndef IOV_MAX
+# define IOV_MAX 1024
+#endif
+
 const char *
 _connect(int *s, const char *host, const char *port)
 {
@@ -107,6 +119,27 @@ _read_to_hbuf(int s, struct hdfs_heap_buf *h)
 	return NULL;
 }
 
+// As _read_to_hbuf(), but stops once 'h' holds 'want' bytes, so nothing past
+// them is consumed from the socket.
+const char *
+_read_to_hbuf_n(int s, struct hdfs_heap_buf *h, int want)
+{
+	int rc;
+
+	while (h->used < want) {
+		_hbuf_reserve(h, want - h->used);
+
+		rc = read(s, h->buf + h->used, want - h->used);
+		if (rc == 0)
+			return "EOS";
+		if (rc < 0)
+			return strerror(errno);
+
+		h->used += rc;
+	}
+	return NULL;
+}
+
 const char *
 _pread_all(int fd, void *vbuf, size_t len, off_t offset)
 {
@@ -125,6 +158,24 @@ _pread_all(int fd, void *vbuf, size_t len, off_t offset)
 	return NULL;
 }
 
+const char *
+_pwrite_all(int fd, const void *vbuf, size_t len, off_t offset)
+{
+	const char *buf = vbuf;
+	ssize_t rc;
+	while (len > 0) {
+		rc = pwrite(fd, buf, len, offset);
+		if (rc == -1)
+			return strerror(errno);
+		if (rc == 0)
+			return "EOF writing to fd; bailing";
+		len -= rc;
+		buf += rc;
+		offset += rc;
+	}
+	return NULL;
+}
+
 const char *
 _read_all(int fd, void *vbuf, size_t len)
 {
@@ -142,6 +193,38 @@ _read_all(int fd, void *vbuf, size_t len)
 	return NULL;
 }
 
+// Fills every iovec in turn; 'iov' is advanced past what was read.
+const char *
+_readv_all(int s, struct iovec *iov, int iovcnt)
+{
+	ssize_t rc;
+
+	while (iovcnt > 0) {
+		if (iov->iov_len == 0) {
+			iov++;
+			iovcnt--;
+			continue;
+		}
+
+		rc = readv(s, iov, _min(iovcnt, IOV_MAX));
+		if (rc == 0)
+			return "EOS";
+		if (rc < 0)
+			return strerror(errno);
+
+		while (iovcnt > 0 && rc >= (ssize_t)iov->iov_len) {
+			rc -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (rc > 0) {
+			iov->iov_base = (char*)iov->iov_base + rc;
+			iov->iov_len -= rc;
+		}
+	}
+	return NULL;
+}
+
 const char *
 _writev_all(int s, struct iovec *iov, int iovcnt)
 {
@@ -157,11 +240,45 @@ _writev_all(int s, struct iovec *iov, int iovcnt)
 			iov->iov_len -= rc;
 		}
 
-		rc = writev(s, iov, iovcnt);
+		rc = writev(s, iov, _min(iovcnt, IOV_MAX));
+		if (rc == -1)
+			return strerror(errno);
+		if (rc == 0)
+			return "EOS writing packet; aborting write";
+	}
+	return NULL;
+}
+
+// As _writev_all(), but via sendmsg(2) with 'flags'. If 'ncalls' is non-NULL,
+// it is incremented once per syscall made.
+const char *
+_sendmsg_all(int s, struct iovec *iov, int iovcnt, int flags,
+	uint64_t *ncalls)
+{
+	struct msghdr msg = { 0 };
+	ssize_t rc;
+
+	while (iovcnt > 0) {
+		msg.msg_iov = iov;
+		msg.msg_iovlen = _min(iovcnt, IOV_MAX);
+
+		rc = sendmsg(s, &msg, flags);
+		if (ncalls)
+			(*ncalls)++;
 		if (rc == -1)
 			return strerror(errno);
 		if (rc == 0)
 			return "EOS writing packet; aborting write";
+
+		while (iovcnt > 0 && rc >= (ssize_t)iov->iov_len) {
+			rc -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (rc > 0) {
+			iov->iov_base = (char*)iov->iov_base + rc;
+			iov->iov_len -= rc;
+		}
 	}
 	return NULL;
 }
@@ -186,6 +303,37 @@ _sendfile_all(int s, int fd, off_t offset, size_t tosend)
 	return NULL;
 }
 
+// Moves 'len' bytes from socket 's' to 'fd' at 'offset', through the pipe
+// 'pipefds' (which should start and is left empty), without copying them to
+// userspace.
+const char *
+_splice_all(int s, const int pipefds[2], int fd, off_t offset, size_t len)
+{
+	ssize_t rc, inpipe;
+
+	while (len > 0) {
+		inpipe = splice(s, NULL, pipefds[1], NULL, len,
+		    SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (inpipe == -1)
+			return strerror(errno);
+		if (inpipe == 0)
+			return "EOS";
+		len -= inpipe;
+
+		while (inpipe > 0) {
+			rc = splice(pipefds[0], NULL, fd, &offset, inpipe,
+			    SPLICE_F_MOVE);
+			if (rc == -1)
+				return strerror(errno);
+			if (rc == 0)
+				return "EOF splicing to fd; bailing";
+			inpipe -= rc;
+		}
+	}
+
+	return NULL;
+}
+
 #elif defined(__FreeBSD__)
 
 const char *
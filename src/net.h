@@ -8,14 +8,29 @@
 
 #include "heapbuf.h"
 
+// Only Linux has MSG_MORE; elsewhere, just send immediately.
+#ifndef MSG_MORE
+# define MSG_MORE 0
+#endif
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
 const char *	_connect(int *s, const char *host, const char *port);
 const char *	_write_all(int s, void *buf, int buflen);
 const char *	_read_to_hbuf(int s, struct hdfs_heap_buf *);
+const char *	_read_to_hbuf_n(int s, struct hdfs_heap_buf *, int want);
 const char *	_pread_all(int fd, void *buf, size_t len, off_t offset);
 const char *	_read_all(int fd, void *buf, size_t len);
+const char *	_pwrite_all(int fd, const void *buf, size_t len, off_t offset);
+const char *	_readv_all(int s, struct iovec *iov, int iovcnt);
 const char *	_writev_all(int s, struct iovec *iov, int iovcnt);
+const char *	_sendmsg_all(int s, struct iovec *iov, int iovcnt, int flags,
+		uint64_t *ncalls);
 #if defined(__linux__)
 const char *	_sendfile_all(int s, int fd, off_t offset, size_t tosend);
+const char *	_splice_all(int s, const int pipefds[2], int fd, off_t offset,
+		size_t len);
 #elif defined(__FreeBSD__)
 const char *	_sendfile_all_bsd(int s, int fd, off_t offset, size_t tosend,
 		struct iovec *hdrs, int hdrcnt);
@@ -58,14 +58,23 @@
 struct _hdfs_result {
 	int64_t rs_msgno;
 	struct hdfs_object *rs_obj;
+	// Lazy decode: rs_obj is NULL, and the undecoded response is here
+	void *rs_raw;
+	size_t rs_rawlen;
+	bool rs_arena;
 };
 
 struct _hdfs_pending {
 	int64_t pd_msgno;
 	struct hdfs_rpc_response_future *pd_future;
-	struct hdfs_object *(*pd_slurper)(struct hdfs_heap_buf *);
+	struct hdfs_object *(*pd_slurper)(struct hdfs_heap_buf *, bool);
+	// RPCs invoked with hdfs_namenode_invoke_cb() have no future:
+	void (*pd_cb)(struct hdfs_object *, void *);
+	void *pd_cbctx;
 };
 
+void			_rpc_invocation_init(struct hdfs_object *,
+			enum hdfs_rpc_method, ...);
 void			_rpc_invocation_set_msgno(struct hdfs_object *, int32_t);
 void			_rpc_invocation_set_proto(struct hdfs_object *,
 			enum hdfs_namenode_proto pr);
@@ -73,18 +82,36 @@ void			_rpc_invocation_set_clientid(struct hdfs_object *, uint8_t *);
 
 void			_authheader_set_clientid(struct hdfs_object *, uint8_t *);
 
+// A reference to a heap object, or for an arena object, a heap copy made with
+// 'copy' (so as not to keep the whole response alive).
+struct hdfs_object *	_hdfs_object_share(struct hdfs_object *,
+			struct hdfs_object *(*copy)(struct hdfs_object *));
+
 // Returns _HDFS_INVALID_PROTO if the buffer contains invalid protocol data.
 // Returns NULL if we can't decode a response from the available buffer.
 // Otherwise, returns a result object.
 struct _hdfs_result *	_hdfs_result_deserialize(char *buf, int buflen, int *obj_size);
+
+// HDFSv1 responses are not length-prefixed. Returns true if the buffer may
+// hold a whole response, i.e. once _hdfs_result_deserialize() is worth
+// calling. Large (array and listing) responses are scanned an element at a
+// time as they arrive, saving progress in the _hdfs_v1_scan, so that each byte
+// is only scanned once; zero it before each response.
+struct _hdfs_v1_scan;
+bool			_hdfs_result_scan(struct _hdfs_v1_scan *, char *buf, int buflen);
+struct hdfs_namenode;
+
+// The v2+ deserializers look up the response's slurper in the namenode's
+// pending table. They take nn_lock only for the lookup; the caller must not
+// hold it.
 struct _hdfs_result *	_hdfs_result_deserialize_v2(char *buf, int buflen, int *obj_size,
-			struct _hdfs_pending *pend, int npend);
+			struct hdfs_namenode *n);
 struct _hdfs_result *	_hdfs_result_deserialize_v2_2(char *buf, int buflen, int *obj_size,
-			struct _hdfs_pending *pend, int npend);
+			struct hdfs_namenode *n);
 
 void			_hdfs_result_free(struct _hdfs_result *);
 
-enum hdfs_object_type	_string_to_type(const char *);
+enum hdfs_object_type	_string_to_type(const char *, size_t);
 
 static inline bool
 streq(const char *a, const char *b)
@@ -94,18 +121,26 @@ streq(const char *a, const char *b)
 
 extern struct _hdfs_result *_HDFS_INVALID_PROTO;
 
-// HDFSv2+ protobuf-to-hdfs_object converters
+// HDFSv2+ protobuf-to-hdfs_object converters. Those taking an arena allocate
+// the result from it, if non-NULL (see arena.h).
 enum hdfs_checksum_type	_hdfs_csum_from_proto(ChecksumTypeProto);
+ChecksumTypeProto	_hdfs_csum_to_proto(enum hdfs_checksum_type);
 enum hdfs_file_type	_hdfs_file_type_from_proto(HdfsFileStatusProto__FileType);
 
 struct hdfs_object *	_hdfs_fsserverdefaults_new_proto(FsServerDefaultsProto *);
-struct hdfs_object *	_hdfs_directory_listing_new_proto(DirectoryListingProto *);
-struct hdfs_object *	_hdfs_file_status_new_proto(HdfsFileStatusProto *);
-struct hdfs_object *	_hdfs_located_blocks_new_proto(LocatedBlocksProto *);
-struct hdfs_object *	_hdfs_located_block_new_proto(LocatedBlockProto *);
+struct hdfs_object *	_hdfs_directory_listing_new_proto(DirectoryListingProto *,
+			struct _hdfs_arena *);
+struct hdfs_object *	_hdfs_file_status_new_proto(HdfsFileStatusProto *,
+			struct _hdfs_arena *);
+struct hdfs_object *	_hdfs_located_blocks_new_proto(LocatedBlocksProto *,
+			struct _hdfs_arena *);
+struct hdfs_object *	_hdfs_located_block_new_proto(LocatedBlockProto *,
+			struct _hdfs_arena *);
 struct hdfs_object *	_hdfs_boolean_new_proto(protobuf_c_boolean);
-struct hdfs_object *	_hdfs_token_new_proto(BlockTokenIdentifierProto *);
-struct hdfs_object *	_hdfs_datanode_info_new_proto(DatanodeInfoProto *);
+struct hdfs_object *	_hdfs_token_new_proto(BlockTokenIdentifierProto *,
+			struct _hdfs_arena *);
+struct hdfs_object *	_hdfs_datanode_info_new_proto(DatanodeInfoProto *,
+			struct _hdfs_arena *);
 struct hdfs_object *	_hdfs_content_summary_new_proto(ContentSummaryProto *);
 
 #endif
@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,9 +15,12 @@
 
 #include <hadoofus/highlevel.h>
 
+#include "arena.h"
 #include "heapbuf.h"
 #include "heapbufobjs.h"
 #include "objects-internal.h"
+#include "pending.h"
+#include "pthread_wrappers.h"
 #include "rpc2-internal.h"
 #include "util.h"
 
@@ -127,23 +131,82 @@ static struct {
 		.type = RPC_ENOENT_EXCEPTION_STR, },
 };
 
+/*
+ * v1 responses name the type of (nearly) every object they contain. Names are
+ * matched in place against object_types[], bucketed by length. Most of them
+ * share a long "org.apache.hadoop..." prefix and differ at the end, so the
+ * last character is checked first.
+ */
+#define _TYPE_NAME_MAX	64
+
+static struct _type_name {
+	const char *tn_name;
+	size_t tn_len;
+	enum hdfs_object_type tn_type;
+	struct _type_name *tn_next;
+} type_names[nelem(object_types)],
+  *type_names_by_len[_TYPE_NAME_MAX];
+static pthread_once_t type_names_once = PTHREAD_ONCE_INIT;
+
+static void
+_type_names_init(void)
+{
+	struct _type_name **tailp;
+	size_t len;
+
+	for (unsigned i = 0; i < nelem(object_types); i++) {
+		if (object_types[i].type == NULL)
+			continue;
+
+		len = strlen(object_types[i].type);
+		ASSERT(len > 0 && len < _TYPE_NAME_MAX);
+
+		// Earlier entries win (VOID_TYPE is NULL_TYPE1), so append.
+		for (tailp = &type_names_by_len[len]; *tailp;
+		    tailp = &(*tailp)->tn_next)
+			;
+		type_names[i] = (struct _type_name) {
+			.tn_name = object_types[i].type,
+			.tn_len = len,
+			.tn_type = _H_START + i,
+		};
+		*tailp = &type_names[i];
+	}
+}
+
+// 'otype' need not be NUL-terminated.
 enum hdfs_object_type
-_string_to_type(const char *otype)
+_string_to_type(const char *otype, size_t len)
 {
-	for (unsigned i = 0; i < nelem(object_types); i++)
-		if (streq(otype, object_types[i].type))
-			return _H_START + i;
+	struct _type_name *tn;
+	int rc;
+
+	if (len == 0 || len >= _TYPE_NAME_MAX)
+		return _H_INVALID;
+
+	rc = pthread_once(&type_names_once, _type_names_init);
+	ASSERT(rc == 0);
+
+	for (tn = type_names_by_len[len]; tn; tn = tn->tn_next)
+		if (tn->tn_name[len - 1] == otype[len - 1] &&
+		    memcmp(tn->tn_name, otype, len) == 0)
+			return tn->tn_type;
 
 	return _H_INVALID;
 }
 
+// Exceptions are rare; a linear search is fine.
 static enum hdfs_object_type
-_string_to_etype(const char *etype)
+_string_to_etype(const char *etype, size_t len)
 {
+	const char *t;
+
 	for (unsigned i = 1/*skip proto exception; never matches*/;
-	    i < nelem(exception_types); i++)
-		if (streq(etype, exception_types[i].type))
+	    i < nelem(exception_types); i++) {
+		t = exception_types[i].type;
+		if (strlen(t) == len && memcmp(etype, t, len) == 0)
 			return H_PROTOCOL_EXCEPTION + i;
+	}
 
 	return H_PROTOCOL_EXCEPTION;
 }
@@ -160,12 +223,37 @@ hdfs_etype_to_string(enum hdfs_object_type e)
 	return res;
 }
 
+static const char *const rpc_method_names[] = {
+#define _RPC_NAME(method) [HDFS_RPC_ ## method] = #method,
+	HDFS_RPC_METHODS(_RPC_NAME)
+#undef _RPC_NAME
+};
+
+EXPORT_SYM const char *
+hdfs_rpc_method_to_string(enum hdfs_rpc_method m)
+{
+
+	ASSERT(m != HDFS_RPC_UNKNOWN && (unsigned)m < _HDFS_RPC_END);
+	return rpc_method_names[m];
+}
+
+static enum hdfs_rpc_method
+_string_to_rpc_method(const char *name)
+{
+
+	for (unsigned i = HDFS_RPC_UNKNOWN + 1; i < _HDFS_RPC_END; i++)
+		if (streq(name, rpc_method_names[i]))
+			return i;
+
+	return HDFS_RPC_UNKNOWN;
+}
+
 static struct hdfs_object *
-_object_exception(const char *etype, const char *emsg)
+_object_exception(const char *etype, size_t etypelen, const char *emsg)
 {
 	enum hdfs_object_type realtype;
 
-	realtype = _string_to_etype(etype);
+	realtype = _string_to_etype(etype, etypelen);
 	return hdfs_protocol_exception_new(realtype, emsg);
 }
 
@@ -176,6 +264,18 @@ _timespec_to_ms(struct timespec ts)
 	    (((int64_t)ts.tv_nsec / 1000000ULL) % 1000UL);
 }
 
+// Caller loses references to objects that are being appended into other
+// objects.
+#define H_ARRAY_RESIZE 8
+#define H_ARRAY_APPEND(array, array_len, obj) do { \
+	if (array_len % H_ARRAY_RESIZE == 0) { \
+		array = realloc(array, (array_len+H_ARRAY_RESIZE) * sizeof(struct hdfs_object *)); \
+		ASSERT(array); \
+	} \
+	array[array_len] = obj; \
+	array_len += 1; \
+} while (0)
+
 static void *
 _objmalloc(void)
 {
@@ -185,6 +285,80 @@ _objmalloc(void)
 	return r;
 }
 
+/*
+ * Allocation for the *_new_proto() decoders: from the response's arena if it
+ * has one, or else the heap.
+ */
+static struct hdfs_object *
+_objalloc(struct _hdfs_arena *ar)
+{
+	struct hdfs_object *r;
+
+	if (ar == NULL)
+		return _objmalloc();
+
+	r = _arena_alloc(ar, sizeof(*r));
+	memset(r, 0, sizeof(*r));
+	r->ob_arena = ar;
+	return r;
+}
+
+static void *
+_ob_alloc(struct _hdfs_arena *ar, size_t sz)
+{
+	void *r;
+
+	if (ar)
+		return _arena_alloc(ar, sz);
+
+	r = malloc(sz);
+	ASSERT(r);
+	return r;
+}
+
+static char *
+_ob_memdup(struct _hdfs_arena *ar, const void *p, size_t len)
+{
+	char *r;
+
+	r = _ob_alloc(ar, len);
+	memcpy(r, p, len);
+	return r;
+}
+
+static char *
+_ob_strdup(struct _hdfs_arena *ar, const char *s)
+{
+
+	return _ob_memdup(ar, s, strlen(s) + 1);
+}
+
+static char *
+_ob_proto_str(struct _hdfs_arena *ar, ProtobufCBinaryData blob)
+{
+	char *r;
+
+	r = _ob_alloc(ar, blob.len + 1);
+	memcpy(r, blob.data, blob.len);
+	r[blob.len] = '\0';
+	return r;
+}
+
+/*
+ * An array for 'n' objects. Heap arrays are sized the way H_ARRAY_APPEND()
+ * expects, so that they can still be appended to.
+ */
+static struct hdfs_object **
+_ob_array(struct _hdfs_arena *ar, size_t n)
+{
+
+	if (n == 0)
+		return NULL;
+	if (ar == NULL)
+		n = (n + H_ARRAY_RESIZE - 1) / H_ARRAY_RESIZE * H_ARRAY_RESIZE;
+	return _ob_alloc(ar, n * sizeof(struct hdfs_object *));
+}
+
 EXPORT_SYM struct hdfs_object *
 hdfs_void_new()
 {
@@ -297,12 +471,20 @@ hdfs_token_new_empty()
 }
 
 struct hdfs_object *
-_hdfs_token_new_proto(BlockTokenIdentifierProto *pr)
+_hdfs_token_new_proto(BlockTokenIdentifierProto *pr, struct _hdfs_arena *ar)
 {
+	struct hdfs_object *r = _objalloc(ar);
 
-	return hdfs_token_new_nulsafe((void *)pr->identifier.data,
-	    pr->identifier.len, (void *)pr->password.data, pr->password.len,
-	    pr->kind, pr->service);
+	r->ob_type = H_TOKEN;
+	r->ob_val._token._lens[0] = pr->identifier.len;
+	r->ob_val._token._lens[1] = pr->password.len;
+	r->ob_val._token._strings[0] = _ob_memdup(ar, pr->identifier.data,
+	    pr->identifier.len);
+	r->ob_val._token._strings[1] = _ob_memdup(ar, pr->password.data,
+	    pr->password.len);
+	r->ob_val._token._strings[2] = _ob_strdup(ar, pr->kind);
+	r->ob_val._token._strings[3] = _ob_strdup(ar, pr->service);
+	return r;
 }
 
 EXPORT_SYM struct hdfs_object *
@@ -364,34 +546,33 @@ hdfs_located_block_new(int64_t blkid, int64_t len, int64_t generation, int64_t o
 }
 
 struct hdfs_object *
-_hdfs_located_block_new_proto(LocatedBlockProto *lb)
+_hdfs_located_block_new_proto(LocatedBlockProto *lb, struct _hdfs_arena *ar)
 {
-	struct hdfs_object *res;
+	struct hdfs_object *res = _objalloc(ar);
 	size_t i;
 
 	ASSERT(lb);
 	ASSERT(lb->b);
+	ASSERT(lb->n_locs <= INT_MAX);
 
-	res = hdfs_located_block_new(lb->b->blockid, 0, lb->b->generationstamp,
-	    lb->offset);
+	res->ob_type = H_LOCATED_BLOCK;
+	res->ob_val._located_block = (struct hdfs_located_block) {
+		._blockid = lb->b->blockid,
+		._generation = lb->b->generationstamp,
+		._offset = lb->offset,
+		._pool_id = _ob_strdup(ar, lb->b->poolid),
+		._corrupt = lb->corrupt,
+		._token = _hdfs_token_new_proto(lb->blocktoken, ar),
+		._locs = _ob_array(ar, lb->n_locs),
+		._num_locs = lb->n_locs,
+	};
 
 	if (lb->b->has_numbytes)
 		res->ob_val._located_block._len = lb->b->numbytes;
 
-	res->ob_val._located_block._pool_id = strdup(lb->b->poolid);
-	ASSERT(res->ob_val._located_block._pool_id);
-
-	res->ob_val._located_block._corrupt = lb->corrupt;
-	res->ob_val._located_block._token =
-	    _hdfs_token_new_proto(lb->blocktoken);
-
-	ASSERT(lb->n_locs <= INT_MAX);
-	for (i = 0; i < lb->n_locs; i++) {
-		struct hdfs_object *dni;
-
-		dni = _hdfs_datanode_info_new_proto(lb->locs[i]);
-		hdfs_located_block_append_datanode_info(res, dni);
-	}
+	for (i = 0; i < lb->n_locs; i++)
+		res->ob_val._located_block._locs[i] =
+		    _hdfs_datanode_info_new_proto(lb->locs[i], ar);
 	return res;
 }
 
@@ -420,8 +601,9 @@ hdfs_located_block_copy(struct hdfs_object *src)
 
 
 		for (int i = 0; i < nlocs; i++)
-			arr_locs[i] = hdfs_datanode_info_copy(
-			    src->ob_val._located_block._locs[i]);
+			arr_locs[i] = _hdfs_object_share(
+			    src->ob_val._located_block._locs[i],
+			    hdfs_datanode_info_copy);
 	}
 
 	r->ob_type = H_LOCATED_BLOCK;
@@ -432,7 +614,8 @@ hdfs_located_block_copy(struct hdfs_object *src)
 		._num_locs = nlocs,
 		._locs = arr_locs,
 		._offset = src->ob_val._located_block._offset,
-		._token = hdfs_token_copy(src->ob_val._located_block._token),
+		._token = _hdfs_object_share(src->ob_val._located_block._token,
+		    hdfs_token_copy),
 		._pool_id = pool_id,
 	};
 	return r;
@@ -451,26 +634,30 @@ hdfs_located_blocks_new(bool beingcreated, int64_t size)
 }
 
 struct hdfs_object *
-_hdfs_located_blocks_new_proto(LocatedBlocksProto *lb)
+_hdfs_located_blocks_new_proto(LocatedBlocksProto *lb, struct _hdfs_arena *ar)
 {
-	struct hdfs_object *res;
+	struct hdfs_object *res = _objalloc(ar);
 	size_t i;
 
 	ASSERT(lb);
+	ASSERT(lb->n_blocks <= INT_MAX);
+
+	res->ob_type = H_LOCATED_BLOCKS;
+	res->ob_val._located_blocks = (struct hdfs_located_blocks) {
+		._being_written = lb->underconstruction,
+		._size = lb->filelength,
+		._last_block_complete = lb->islastblockcomplete,
+		._blocks = _ob_array(ar, lb->n_blocks),
+		._num_blocks = lb->n_blocks,
+	};
 
-	res = hdfs_located_blocks_new(lb->underconstruction, lb->filelength);
 	if (lb->lastblock)
 		res->ob_val._located_blocks._last_block =
-		    _hdfs_located_block_new_proto(lb->lastblock);
-	res->ob_val._located_blocks._last_block_complete =
-	    lb->islastblockcomplete;
+		    _hdfs_located_block_new_proto(lb->lastblock, ar);
 
-	for (i = 0; i < lb->n_blocks; i++) {
-		struct hdfs_object *b;
-
-		b = _hdfs_located_block_new_proto(lb->blocks[i]);
-		hdfs_located_blocks_append_located_block(res, b);
-	}
+	for (i = 0; i < lb->n_blocks; i++)
+		res->ob_val._located_blocks._blocks[i] =
+		    _hdfs_located_block_new_proto(lb->blocks[i], ar);
 
 	return res;
 }
@@ -497,13 +684,16 @@ hdfs_directory_listing_new()
 }
 
 struct hdfs_object *
-_hdfs_directory_listing_new_proto(DirectoryListingProto *list)
+_hdfs_directory_listing_new_proto(DirectoryListingProto *list,
+	struct _hdfs_arena *ar)
 {
-	struct hdfs_object *res;
+	struct hdfs_object *res = _objalloc(ar);
+	struct hdfs_directory_listing *dl;
 	bool has_locations;
 	size_t i;
 
 	ASSERT(list);
+	ASSERT(list->n_partiallisting <= INT_MAX);
 
 	has_locations = false;
 	for (i = 0; i < list->n_partiallisting; i++) {
@@ -513,25 +703,30 @@ _hdfs_directory_listing_new_proto(DirectoryListingProto *list)
 		}
 	}
 
-	res = _hdfs_directory_listing_new(has_locations);
+	res->ob_type = H_DIRECTORY_LISTING;
+	dl = &res->ob_val._directory_listing;
+	*dl = (struct hdfs_directory_listing) {
+		._has_locations = has_locations,
+		._files = _ob_array(ar, list->n_partiallisting),
+		._num_files = list->n_partiallisting,
+		._remaining_entries = list->remainingentries,
+	};
+	if (has_locations)
+		dl->_located_blocks = _ob_array(ar, list->n_partiallisting);
+
 	for (i = 0; i < list->n_partiallisting; i++) {
 		HdfsFileStatusProto *fs;
-		struct hdfs_object *fso, *lbo;
 
 		fs = list->partiallisting[i];
-		fso = _hdfs_file_status_new_proto(fs);
+		dl->_files[i] = _hdfs_file_status_new_proto(fs, ar);
 
-		lbo = NULL;
 		if (has_locations) {
 			ASSERT(fs->locations);
-			lbo = _hdfs_located_blocks_new_proto(fs->locations);
+			dl->_located_blocks[i] =
+			    _hdfs_located_blocks_new_proto(fs->locations, ar);
 		}
-
-		hdfs_directory_listing_append_file_status(res, fso, lbo);
 	}
 
-	res->ob_val._directory_listing._remaining_entries =
-	    list->remainingentries;
 	return res;
 }
 
@@ -559,8 +754,9 @@ hdfs_datanode_info_new(const char *host, const char *port, const char *rack,
 }
 
 struct hdfs_object *
-_hdfs_datanode_info_new_proto(DatanodeInfoProto *pr)
+_hdfs_datanode_info_new_proto(DatanodeInfoProto *pr, struct _hdfs_arena *ar)
 {
+	struct hdfs_object *r = _objalloc(ar);
 	char dn_port_str[14];
 
 	sprintf(dn_port_str, "%u", pr->id->xferport);
@@ -569,9 +765,14 @@ _hdfs_datanode_info_new_proto(DatanodeInfoProto *pr)
 	 * XXX: Maybe ipaddr would be better than hostname? They are the same
 	 * for our HDFS impl, but maybe not upstream.
 	 */
-	return hdfs_datanode_info_new(pr->id->hostname,
-	    dn_port_str, pr->location? pr->location : "",
-	    pr->id->ipcport);
+	r->ob_type = H_DATANODE_INFO;
+	r->ob_val._datanode_info = (struct hdfs_datanode_info) {
+		._location = _ob_strdup(ar, pr->location? pr->location : ""),
+		._hostname = _ob_strdup(ar, pr->id->hostname),
+		._port = _ob_strdup(ar, dn_port_str),
+		._namenodeport = pr->id->ipcport,
+	};
+	return r;
 }
 
 EXPORT_SYM struct hdfs_object *
@@ -640,7 +841,9 @@ hdfs_array_datanode_info_copy(struct hdfs_object *src)
 
 		for (int i = 0; i < n; i++)
 			r->ob_val._array_datanode_info._values[i] =
-			    hdfs_datanode_info_copy(src->ob_val._array_datanode_info._values[i]);
+			    _hdfs_object_share(
+				src->ob_val._array_datanode_info._values[i],
+				hdfs_datanode_info_copy);
 	}
 
 	return r;
@@ -721,22 +924,18 @@ _hdfs_file_type_from_proto(HdfsFileStatusProto__FileType pr)
 }
 
 struct hdfs_object *
-_hdfs_file_status_new_proto(HdfsFileStatusProto *fs)
+_hdfs_file_status_new_proto(HdfsFileStatusProto *fs, struct _hdfs_arena *ar)
 {
-	struct hdfs_object *r = _objmalloc();
+	struct hdfs_object *r = _objalloc(ar);
 	enum hdfs_file_type ft;
 	char *path_copy, *owner_copy, *group_copy;
 
 	ASSERT(fs);
 
 	ft = _hdfs_file_type_from_proto(fs->filetype);
-	path_copy = _proto_str(fs->path);
-	owner_copy = strdup(fs->owner);
-	group_copy = strdup(fs->group);
-
-	ASSERT(path_copy);
-	ASSERT(owner_copy);
-	ASSERT(group_copy);
+	path_copy = _ob_proto_str(ar, fs->path);
+	owner_copy = _ob_strdup(ar, fs->owner);
+	group_copy = _ob_strdup(ar, fs->group);
 
 	r->ob_type = H_FILE_STATUS;
 	r->ob_val._file_status = (struct hdfs_file_status) {
@@ -763,7 +962,8 @@ _hdfs_file_status_new_proto(HdfsFileStatusProto *fs)
 	if (fs->has_blocksize)
 		r->ob_val._file_status._block_size = fs->blocksize;
 	if (fs->has_symlink)
-		r->ob_val._file_status._symlink_target = _proto_str(fs->symlink);
+		r->ob_val._file_status._symlink_target =
+		    _ob_proto_str(ar, fs->symlink);
 	if (fs->has_fileid)
 		r->ob_val._file_status._fileid = fs->fileid;
 	if (fs->has_childrennum)
@@ -902,23 +1102,21 @@ hdfs_array_byte_copy(struct hdfs_object *src)
 	return r;
 }
 
-EXPORT_SYM struct hdfs_object *
-hdfs_rpc_invocation_new(const char *name, ...)
+static void
+_rpc_invocation_init_va(struct hdfs_object *r, enum hdfs_rpc_method id,
+	char *name, va_list ap)
 {
 	unsigned i;
-	char *meth_copy = strdup(name);
-	struct hdfs_object *r = _objmalloc();
-	va_list ap;
 	struct hdfs_object *arg;
 
-	ASSERT(meth_copy);
-
-	r->ob_type = H_RPC_INVOCATION;
-	r->ob_val._rpc_invocation = (struct hdfs_rpc_invocation) {
-		._method = meth_copy,
+	*r = (struct hdfs_object) {
+		.ob_type = H_RPC_INVOCATION,
+		.ob_val._rpc_invocation = {
+			._method_id = id,
+			._method = name,
+		},
 	};
 
-	va_start(ap, name);
 	i = 0;
 	while (true) {
 		arg = va_arg(ap, struct hdfs_object *);
@@ -930,8 +1128,65 @@ hdfs_rpc_invocation_new(const char *name, ...)
 		ASSERT(i < nelem(r->ob_val._rpc_invocation._args));
 	}
 	r->ob_val._rpc_invocation._nargs = i;
+}
+
+static struct hdfs_object *
+_rpc_invocation_new_va(enum hdfs_rpc_method id, char *name, va_list ap)
+{
+	struct hdfs_object *r = _objmalloc();
+
+	_rpc_invocation_init_va(r, id, name, ap);
+	return r;
+}
+
+// Like hdfs_rpc_invocation_new_method(), but into caller storage (usually the
+// stack) and without taking ownership of the arguments; the caller must not
+// hdfs_object_free() it. Good for rpcs that are invoked and then dropped.
+void
+_rpc_invocation_init(struct hdfs_object *r, enum hdfs_rpc_method id, ...)
+{
+	va_list ap;
+
+	va_start(ap, id);
+	_rpc_invocation_init_va(r, id,
+	    __DECONST(char *, hdfs_rpc_method_to_string(id)), ap);
+	va_end(ap);
+}
+
+EXPORT_SYM struct hdfs_object *
+hdfs_rpc_invocation_new_method(enum hdfs_rpc_method id, ...)
+{
+	struct hdfs_object *r;
+	va_list ap;
+
+	va_start(ap, id);
+	r = _rpc_invocation_new_va(id,
+	    __DECONST(char *, hdfs_rpc_method_to_string(id)), ap);
 	va_end(ap);
+	return r;
+}
 
+// Compatibility with callers that name methods by string; methods this
+// library doesn't know about can still be invoked over HDFSv1.
+EXPORT_SYM struct hdfs_object *
+hdfs_rpc_invocation_new(const char *name, ...)
+{
+	enum hdfs_rpc_method id;
+	struct hdfs_object *r;
+	char *meth;
+	va_list ap;
+
+	id = _string_to_rpc_method(name);
+	if (id != HDFS_RPC_UNKNOWN)
+		meth = __DECONST(char *, rpc_method_names[id]);
+	else {
+		meth = strdup(name);
+		ASSERT(meth);
+	}
+
+	va_start(ap, name);
+	r = _rpc_invocation_new_va(id, meth, ap);
+	va_end(ap);
 	return r;
 }
 
@@ -1151,6 +1406,14 @@ _hdfs_csum_from_proto(ChecksumTypeProto pr)
 	return (unsigned)pr;
 }
 
+ChecksumTypeProto
+_hdfs_csum_to_proto(enum hdfs_checksum_type csum)
+{
+
+	ASSERT(HDFS_CSUM_NULL <= csum && csum <= HDFS_CSUM_CRC32C);
+	return (ChecksumTypeProto)csum;
+}
+
 struct hdfs_object *
 _hdfs_fsserverdefaults_new_proto(FsServerDefaultsProto *pr)
 {
@@ -1248,18 +1511,6 @@ hdfs_array_string_copy(struct hdfs_object *src)
 	return r;
 }
 
-// Caller loses references to objects that are being appended into other
-// objects.
-#define H_ARRAY_RESIZE 8
-#define H_ARRAY_APPEND(array, array_len, obj) do { \
-	if (array_len % H_ARRAY_RESIZE == 0) { \
-		array = realloc(array, (array_len+H_ARRAY_RESIZE) * sizeof(struct hdfs_object *)); \
-		ASSERT(array); \
-	} \
-	array[array_len] = obj; \
-	array_len += 1; \
-} while (0)
-
 EXPORT_SYM void
 hdfs_located_block_append_datanode_info(struct hdfs_object *located_block,
 	struct hdfs_object *datanode_info)
@@ -1355,10 +1606,79 @@ hdfs_array_string_add(struct hdfs_object *o, const char *s)
 	free(array); \
 } while (0)
 
+// Drops a reference from a count of references beyond the first; true if it
+// was the last. The sole owner of an object is the only one who can be
+// touching its count, so that case needs no atomic update.
+static bool
+_obj_release(uint32_t *refs)
+{
+
+	if (__atomic_load_n(refs, __ATOMIC_ACQUIRE) == 0)
+		return true;
+	return __atomic_fetch_sub(refs, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+// Drops a reference taken on a non-root arena object, if it has any left;
+// false if not, in which case only the root owns it.
+static bool
+_obj_unshare(uint32_t *refs)
+{
+	uint32_t n;
+
+	n = __atomic_load_n(refs, __ATOMIC_RELAXED);
+	do {
+		if (n == 0)
+			return false;
+	} while (!__atomic_compare_exchange_n(refs, &n, n - 1, false,
+	    __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return true;
+}
+
+EXPORT_SYM struct hdfs_object *
+hdfs_object_ref(struct hdfs_object *obj)
+{
+
+	// An arena's objects share its count. The others of its tree also
+	// count their own references, so that only those can drop one.
+	if (obj->ob_arena) {
+		if (obj->ob_arena->ar_root != obj)
+			__atomic_add_fetch(&obj->ob_refs, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&obj->ob_arena->ar_refs, 1, __ATOMIC_RELAXED);
+	} else
+		__atomic_add_fetch(&obj->ob_refs, 1, __ATOMIC_RELAXED);
+	return obj;
+}
+
+struct hdfs_object *
+_hdfs_object_share(struct hdfs_object *obj,
+	struct hdfs_object *(*copy)(struct hdfs_object *))
+{
+
+	if (obj->ob_arena)
+		return copy(obj);
+	return hdfs_object_ref(obj);
+}
+
 // Recursively frees an object:
 EXPORT_SYM void
 hdfs_object_free(struct hdfs_object *obj)
 {
+
+	// Arena objects go all at once, with the root of their tree (unless
+	// references to them remain).
+	if (obj->ob_arena) {
+		struct _hdfs_arena *ar = obj->ob_arena;
+
+		if (ar->ar_root != obj && !_obj_unshare(&obj->ob_refs))
+			return;
+		if (_obj_release(&ar->ar_refs))
+			_arena_free(ar);
+		return;
+	}
+
+	if (!_obj_release(&obj->ob_refs))
+		return;
+
 	switch (obj->ob_type) {
 	case H_VOID: break; // NOOP
 	case H_NULL: break;
@@ -1418,7 +1738,8 @@ hdfs_object_free(struct hdfs_object *obj)
 			free(obj->ob_val._array_byte._bytes);
 		break;
 	case H_RPC_INVOCATION:
-		free(obj->ob_val._rpc_invocation._method);
+		if (obj->ob_val._rpc_invocation._method_id == HDFS_RPC_UNKNOWN)
+			free(obj->ob_val._rpc_invocation._method);
 		FREE_H_ARRAY_ELMS(obj->ob_val._rpc_invocation._args,
 		    obj->ob_val._rpc_invocation._nargs);
 		break;
@@ -1493,25 +1814,32 @@ _is_type_objtype(enum hdfs_object_type t)
 static void
 _serialize_rpc_v1(struct hdfs_heap_buf *dest, struct hdfs_rpc_invocation *rpc)
 {
-	struct hdfs_heap_buf rbuf = { 0 };
+	size_t start, end;
+
+	/* Room for the frame of a typical call; the size is patched in below */
+	_hbuf_reserve(dest, 256);
 
-	_bappend_s32(&rbuf, rpc->_msgno);
-	_bappend_string(&rbuf, rpc->_method);
-	_bappend_s32(&rbuf, rpc->_nargs);
+	start = dest->used;
+	_bappend_s32(dest, 0);
+
+	_bappend_s32(dest, rpc->_msgno);
+	_bappend_string(dest, rpc->_method);
+	_bappend_s32(dest, rpc->_nargs);
 	for (int i = 0; i < rpc->_nargs; i++) {
 		struct hdfs_object *aobj = rpc->_args[i];
 
-		_bappend_string(&rbuf, _typestring(aobj));
+		_bappend_string(dest, _typestring(aobj));
 		if (_is_object_objtype(aobj))
-			_bappend_string(&rbuf, _typestring(aobj));
+			_bappend_string(dest, _typestring(aobj));
 		if (aobj->ob_type == H_NULL || aobj->ob_type == H_VOID)
-			_bappend_string(&rbuf, NULL_TYPE2);
-		hdfs_object_serialize(&rbuf, aobj);
+			_bappend_string(dest, NULL_TYPE2);
+		hdfs_object_serialize(dest, aobj);
 	}
 
-	_bappend_s32(dest, rbuf.used);
-	_bappend_mem(dest, rbuf.used, rbuf.buf);
-	free(rbuf.buf);
+	end = dest->used;
+	dest->used = start;
+	_bappend_s32(dest, end - start - 4);
+	dest->used = end;
 }
 
 static void
@@ -1600,65 +1928,47 @@ _serialize_rpc_v2_2(struct hdfs_heap_buf *dest, struct hdfs_rpc_invocation *rpc)
 	 * |-----------------------------------------------------------------|
 	 * | sizeof:varint | hdfs:*RequestProto    "method"                  |
 	 * +-----------------------------------------------------------------+
+	 *
+	 * Only the call id differs between calls on a connection (and only the
+	 * method between connections), so the header is written from a byte
+	 * template and the rpcwrapper comes from a per-method cache. Everything
+	 * lands directly in dest; the sizes are patched in afterwards.
 	 */
 
-	struct hdfs_heap_buf method_buf = { 0 },
-			     method_len_buf = { 0 },
-			     rpcwrapper_buf = { 0 },
-			     header_buf = { 0 };
-	Hadoop__Common__RequestHeaderProto rpcwrapper =
-	    HADOOP__COMMON__REQUEST_HEADER_PROTO__INIT;
-	Hadoop__Common__RpcRequestHeaderProto header =
-	    HADOOP__COMMON__RPC_REQUEST_HEADER_PROTO__INIT;
-	size_t rpcwrapper_sz, header_sz;
-
-	_rpc2_request_serialize(&method_buf, rpc);
-	_bappend_vlint(&method_len_buf, method_buf.used);
-
-	rpcwrapper.methodname = rpc->_method;
-	rpcwrapper.declaringclassprotocolname =
-	    __DECONST(char *, CLIENT_PROTOCOL);
-	rpcwrapper.clientprotocolversion = 1;
-	rpcwrapper_sz =
-	    hadoop__common__request_header_proto__get_packed_size(&rpcwrapper);
+	/* rpckind: RPC_PROTOCOL_BUFFER, rpcop: RPC_FINAL_PACKET, callid: */
+	static const uint8_t hdr_prefix[] = { 0x08, 0x02, 0x10, 0x00, 0x18 };
+	/* clientid: (16 bytes) */
+	static const uint8_t hdr_clientid[] = { 0x22, _HDFS_CLIENT_ID_LEN };
+	/* retrycount: 0 */
+	static const uint8_t hdr_suffix[] = { 0x28, 0x00 };
 
-	_bappend_vlint(&rpcwrapper_buf, rpcwrapper_sz);
-	_hbuf_reserve(&rpcwrapper_buf, rpcwrapper_sz);
-	hadoop__common__request_header_proto__pack(&rpcwrapper,
-	    (void *)&rpcwrapper_buf.buf[rpcwrapper_buf.used]);
-	rpcwrapper_buf.used += rpcwrapper_sz;
+	size_t start, hdr_start, end;
+	uint32_t callid;
 
-	header.has_rpckind = true;
-	header.rpckind = HADOOP__COMMON__RPC_KIND_PROTO__RPC_PROTOCOL_BUFFER;
-	header.has_rpcop = true;
-	header.rpcop =
-	    HADOOP__COMMON__RPC_REQUEST_HEADER_PROTO__OPERATION_PROTO__RPC_FINAL_PACKET;
-	header.callid = rpc->_msgno;
-	header.clientid.len = _HDFS_CLIENT_ID_LEN;
-	header.clientid.data = rpc->_client_id;
-	header.has_retrycount = true;
-	header.retrycount = 0;
+	/* Room for the frame of a typical call */
+	_hbuf_reserve(dest, 256);
 
-	header_sz =
-	    hadoop__common__rpc_request_header_proto__get_packed_size(&header);
+	start = dest->used;
+	_bappend_s32(dest, 0);
 
-	_bappend_vlint(&header_buf, header_sz);
-	_hbuf_reserve(&header_buf, header_sz);
-	hadoop__common__rpc_request_header_proto__pack(&header,
-	    (void *)&header_buf.buf[header_buf.used]);
-	header_buf.used += header_sz;
+	/* The header is always < 128 bytes, so its size is a 1-byte varint */
+	_bappend_s8(dest, 0);
+	hdr_start = dest->used;
+	_bappend_mem(dest, sizeof(hdr_prefix), hdr_prefix);
+	callid = ((uint32_t)rpc->_msgno << 1) ^ (uint32_t)(rpc->_msgno >> 31);
+	_bappend_vlint(dest, callid);
+	_bappend_mem(dest, sizeof(hdr_clientid), hdr_clientid);
+	_bappend_mem(dest, _HDFS_CLIENT_ID_LEN, rpc->_client_id);
+	_bappend_mem(dest, sizeof(hdr_suffix), hdr_suffix);
+	ASSERT(dest->used - hdr_start < 0x80);
+	dest->buf[hdr_start - 1] = (char)(dest->used - hdr_start);
 
-	_bappend_s32(dest, header_buf.used + rpcwrapper_buf.used +
-	    method_len_buf.used + method_buf.used);
-	_bappend_mem(dest, header_buf.used, header_buf.buf);
-	_bappend_mem(dest, rpcwrapper_buf.used, rpcwrapper_buf.buf);
-	_bappend_mem(dest, method_len_buf.used, method_len_buf.buf);
-	_bappend_mem(dest, method_buf.used, method_buf.buf);
+	_rpc2_2_request_serialize(dest, rpc);
 
-	free(header_buf.buf);
-	free(method_buf.buf);
-	free(method_len_buf.buf);
-	free(rpcwrapper_buf.buf);
+	end = dest->used;
+	dest->used = start;
+	_bappend_s32(dest, end - start - 4);
+	dest->used = end;
 }
 
 static void
@@ -1987,14 +2297,52 @@ hdfs_object_serialize(struct hdfs_heap_buf *dest, struct hdfs_object *obj)
 	}
 }
 
+static struct _hdfs_result *
+_hdfs_result_new(int64_t msgno, struct hdfs_object *obj)
+{
+	struct _hdfs_result *r;
+
+	r = malloc(sizeof *r);
+	ASSERT(r);
+	r->rs_msgno = msgno;
+	r->rs_obj = obj;
+	r->rs_raw = NULL;
+	r->rs_rawlen = 0;
+	r->rs_arena = false;
+	return r;
+}
+
+// Lazy decode: instead of an object, the result carries a copy of the
+// response message, for hdfs_future_get() to decode.
+static struct _hdfs_result *
+_hdfs_result_new_raw(int64_t msgno, struct hdfs_heap_buf *rbuf, bool arena)
+{
+	struct _hdfs_result *r;
+	size_t len;
+
+	len = rbuf->size - rbuf->used;
+	r = _hdfs_result_new(msgno, NULL);
+	// (One spare byte, so that an empty message isn't a NULL buffer.)
+	r->rs_raw = malloc(len + 1);
+	ASSERT(r->rs_raw);
+	memcpy(r->rs_raw, rbuf->buf + rbuf->used, len);
+	r->rs_rawlen = len;
+	r->rs_arena = arena;
+
+	rbuf->used = rbuf->size;
+	return r;
+}
+
 void
 _hdfs_result_free(struct _hdfs_result *r)
 {
 	if (r->rs_obj)
 		hdfs_object_free(r->rs_obj);
+	free(r->rs_raw);
 	free(r);
 }
 
+// Type names are parsed in place; only exception messages are copied out.
 struct _hdfs_result *
 _hdfs_result_deserialize(char *buf, int buflen, int *obj_size)
 {
@@ -2007,8 +2355,9 @@ _hdfs_result_deserialize(char *buf, int buflen, int *obj_size)
 	};
 
 	int32_t msgno, status;
-	char *etype = NULL, *emsg = NULL;
-	char *otype = NULL, *ttype = NULL;
+	const char *etype, *otype, *ttype;
+	size_t etypelen, otypelen, ttypelen;
+	char *emsg = NULL;
 	enum hdfs_object_type realtype;
 
 	msgno = _bslurp_s32(&rbuf);
@@ -2020,26 +2369,24 @@ _hdfs_result_deserialize(char *buf, int buflen, int *obj_size)
 
 	// Parse exceptions
 	if (status != 0) {
-		etype = _bslurp_string32(&rbuf);
+		etype = _bslurp_string32_ref(&rbuf, &etypelen);
 		if (rbuf.used < 0)
 			goto out;
 		emsg = _bslurp_string32(&rbuf);
 		if (rbuf.used < 0)
 			goto out;
 
-		r = malloc(sizeof *r);
-		ASSERT(r);
-		r->rs_msgno = msgno;
-		r->rs_obj = _object_exception(etype, emsg);
+		r = _hdfs_result_new(msgno,
+		    _object_exception(etype, etypelen, emsg));
 		goto out;
 	}
 
 	// If we got this far we're reading a normal object
-	otype = _bslurp_string(&rbuf);
+	otype = _bslurp_string_ref(&rbuf, &otypelen);
 	if (rbuf.used < 0)
 		goto out;
 
-	realtype = _string_to_type(otype);
+	realtype = _string_to_type(otype, otypelen);
 	if (realtype == _H_INVALID) {
 		rbuf.used = _H_PARSE_ERROR;
 		goto out;
@@ -2050,38 +2397,31 @@ _hdfs_result_deserialize(char *buf, int buflen, int *obj_size)
 	// or implementing class of an interface, but in practice it's always
 	// the same)
 	if (_is_type_objtype(realtype)) {
-		ttype = _bslurp_string(&rbuf);
+		ttype = _bslurp_string_ref(&rbuf, &ttypelen);
 		if (rbuf.used < 0)
 			goto out;
-		ASSERT(streq(ttype, otype));
+		ASSERT(ttypelen == otypelen &&
+		    memcmp(ttype, otype, otypelen) == 0);
 	} else if (realtype == H_VOID) {
 		realtype = H_NULL;
 	}
 
 	if (realtype == H_NULL) {
 		// ttype for null values is NOT the same as its otype; it's another string.
-		ttype = _bslurp_string(&rbuf);
+		ttype = _bslurp_string_ref(&rbuf, &ttypelen);
 		if (rbuf.used < 0)
 			goto out;
-		ASSERT(streq(ttype, NULL_TYPE2));
+		ASSERT(ttypelen == strlen(NULL_TYPE2) &&
+		    memcmp(ttype, NULL_TYPE2, ttypelen) == 0);
 	}
 
 	o = hdfs_object_slurp(&rbuf, realtype);
 	if (rbuf.used < 0)
 		goto out;
 
-	r = malloc(sizeof *r);
-	ASSERT(r);
-	r->rs_msgno = msgno;
-	r->rs_obj = o;
+	r = _hdfs_result_new(msgno, o);
 
 out:
-	if (otype)
-		free(otype);
-	if (ttype)
-		free(ttype);
-	if (etype)
-		free(etype);
 	if (emsg)
 		free(emsg);
 
@@ -2096,9 +2436,148 @@ out:
 	return r;
 }
 
+static void
+_oskip_array_long_elem(struct hdfs_heap_buf *b)
+{
+
+	_bslurp_string_expect(b, LONG_TYPE);
+	if (b->used < 0)
+		return;
+	_bslurp_skip(b, 8);
+}
+
+static void
+_oskip_array_datanode_info_elem(struct hdfs_heap_buf *b)
+{
+
+	for (int j = 0; j < 2; j++) {
+		_bslurp_string_expect(b, DATANODEINFO_TYPE);
+		if (b->used < 0)
+			return;
+	}
+	_oskip_datanode_info(b);
+}
+
+// Response types that can grow large: a count of elements, with some fixed
+// bytes on either side.
+static const struct {
+	enum hdfs_object_type type;
+	int prefix,
+	    suffix;
+	void (*skip)(struct hdfs_heap_buf *);
+} v1_lists[] = {
+	{ H_DIRECTORY_LISTING, 0, 4/*remaining*/, _oskip_file_status, },
+	{ H_LOCATED_BLOCKS, 8/*size*/ + 1/*under construction*/, 0,
+		_oskip_located_block, },
+	{ H_ARRAY_LONG, 0, 0, _oskip_array_long_elem, },
+	{ H_ARRAY_DATANODE_INFO, 0, 0, _oskip_array_datanode_info_elem, },
+};
+
+bool
+_hdfs_result_scan(struct _hdfs_v1_scan *s, char *buf, int buflen)
+{
+	struct hdfs_heap_buf rbuf = {
+		.buf = buf,
+		.used = 0,
+		.size = buflen,
+	};
+
+	enum hdfs_object_type realtype;
+	const char *otype;
+	size_t otypelen;
+	int32_t status, n;
+	unsigned i;
+
+	if (s->vs_off == 0) {
+		/*msgno = */_bslurp_s32(&rbuf);
+		if (rbuf.used < 0)
+			goto out;
+		status = _bslurp_s32(&rbuf);
+		if (rbuf.used < 0)
+			goto out;
+		if (status != 0)
+			return true;
+
+		otype = _bslurp_string_ref(&rbuf, &otypelen);
+		if (rbuf.used < 0)
+			goto out;
+		realtype = _string_to_type(otype, otypelen);
+
+		for (i = 0; i < nelem(v1_lists); i++)
+			if (v1_lists[i].type == realtype)
+				break;
+		// Everything else is small; just decode it.
+		if (i == nelem(v1_lists))
+			return true;
+
+		if (_is_type_objtype(realtype)) {
+			/*ttype = */_bslurp_string_ref(&rbuf, &otypelen);
+			if (rbuf.used < 0)
+				goto out;
+		}
+
+		s->vs_off = rbuf.used;
+		s->vs_list = i;
+		s->vs_left = -1;
+	}
+
+	rbuf.used = s->vs_off;
+	if (s->vs_left < 0) {
+		_bslurp_skip(&rbuf, v1_lists[s->vs_list].prefix);
+		if (rbuf.used < 0)
+			goto out;
+		n = _bslurp_s32(&rbuf);
+		if (rbuf.used < 0)
+			goto out;
+		// Let the real decoder judge
+		if (n < 0)
+			return true;
+
+		s->vs_off = rbuf.used;
+		s->vs_left = n;
+	}
+
+	for (; s->vs_left > 0; s->vs_left--) {
+		v1_lists[s->vs_list].skip(&rbuf);
+		if (rbuf.used < 0)
+			goto out;
+		s->vs_off = rbuf.used;
+	}
+
+	return buflen - s->vs_off >= v1_lists[s->vs_list].suffix;
+
+out:
+	// Invalid data is for _hdfs_result_deserialize() to report.
+	return rbuf.used == _H_PARSE_ERROR;
+}
+
+// Copies out the pending entry for 'msgno', in a short critical section: the
+// response itself is decoded without nn_lock, so that invokers never wait
+// behind a large decode. Only the receiver removes entries, so the RPC stays
+// outstanding until it is done.
+//
+// '*lazy' is set if the response should be left for hdfs_future_get() to
+// decode; callbacks are always completed with a decoded object.
+static bool
+_pending_get(struct hdfs_namenode *n, int64_t msgno, struct _hdfs_pending *pd,
+	bool *arena, bool *lazy)
+{
+	struct _hdfs_pending *pend;
+
+	_lock(&n->nn_lock);
+	pend = _pending_lookup(n, msgno);
+	if (pend)
+		*pd = *pend;
+	*arena = n->nn_arena_results;
+	*lazy = n->nn_lazy_decode && pend && pend->pd_future;
+	_unlock(&n->nn_lock);
+
+	return pend != NULL;
+}
+
 struct _hdfs_result *
 _hdfs_result_deserialize_v2(char *buf, int buflen, int *obj_size,
-	struct _hdfs_pending *pend, int npend)
+	struct hdfs_namenode *n)
 {
 	struct hdfs_heap_buf rbuf = {
 		.buf = buf,
@@ -2109,9 +2588,10 @@ _hdfs_result_deserialize_v2(char *buf, int buflen, int *obj_size,
 	struct _hdfs_result *result;
 	struct hdfs_object *obj;
 	int64_t resphdsz;
+	struct _hdfs_pending pend;
+	bool arena, lazy;
 	char *etype, *emsg;
 	int32_t respsz;
-	int i;
 
 	etype = emsg = NULL;
 	resphd = NULL;
@@ -2131,17 +2611,13 @@ _hdfs_result_deserialize_v2(char *buf, int buflen, int *obj_size,
 		goto out;
 	}
 
-	for (i = 0; i < npend; i++)
-		if (pend[i].pd_msgno == (int64_t)resphd->callid)
-			break;
-
 	// Got a response to an unexpected msgno
-	if (i == npend) {
+	if (!_pending_get(n, (int64_t)resphd->callid, &pend, &arena, &lazy)) {
 		rbuf.used = _H_PARSE_ERROR;
 		goto out;
 	}
 
-	ASSERT(pend[i].pd_slurper);
+	ASSERT(pend.pd_slurper);
 
 	if (resphd->status == RPC_STATUS_PROTO__ERROR) {
 		etype = _bslurp_string32(&rbuf);
@@ -2151,10 +2627,8 @@ _hdfs_result_deserialize_v2(char *buf, int buflen, int *obj_size,
 		if (rbuf.used < 0)
 			goto out;
 
-		result = malloc(sizeof(*result));
-		ASSERT(result);
-		result->rs_msgno = (int64_t)resphd->callid;
-		result->rs_obj = _object_exception(etype, emsg);
+		result = _hdfs_result_new((int64_t)resphd->callid,
+		    _object_exception(etype, strlen(etype), emsg));
 		goto out;
 	} else if (resphd->status == RPC_STATUS_PROTO__FATAL) {
 		/* This shouldn't happen. */
@@ -2170,16 +2644,19 @@ _hdfs_result_deserialize_v2(char *buf, int buflen, int *obj_size,
 		goto out;
 
 	rbuf.size = rbuf.used + respsz;
-	obj = pend[i].pd_slurper(&rbuf);
+	if (lazy) {
+		result = _hdfs_result_new_raw((int64_t)resphd->callid, &rbuf,
+		    arena);
+		goto out;
+	}
+
+	obj = pend.pd_slurper(&rbuf, arena);
 	if (obj == NULL) {
 		rbuf.used = _H_PARSE_ERROR;
 		goto out;
 	}
 
-	result = malloc(sizeof(*result));
-	ASSERT(result);
-	result->rs_msgno = (int64_t)resphd->callid;
-	result->rs_obj = obj;
+	result = _hdfs_result_new((int64_t)resphd->callid, obj);
 
 out:
 	if (resphd)
@@ -2201,7 +2678,7 @@ out:
 
 struct _hdfs_result *
 _hdfs_result_deserialize_v2_2(char *buf, int buflen, int *obj_size,
-	struct _hdfs_pending *pend, int npend)
+	struct hdfs_namenode *n)
 {
 	struct hdfs_heap_buf rbuf = {
 		.buf = buf,
@@ -2211,8 +2688,9 @@ _hdfs_result_deserialize_v2_2(char *buf, int buflen, int *obj_size,
 	Hadoop__Common__RpcResponseHeaderProto *resphd;
 	struct _hdfs_result *result;
 	struct hdfs_object *obj;
+	struct _hdfs_pending pend;
+	bool arena, lazy;
 	int64_t resphdsz, totalsz, respsz;
-	int i;
 
 	resphd = NULL;
 	result = NULL;
@@ -2237,26 +2715,20 @@ _hdfs_result_deserialize_v2_2(char *buf, int buflen, int *obj_size,
 		goto out;
 	}
 
-	for (i = 0; i < npend; i++)
-		if (pend[i].pd_msgno == (int64_t)resphd->callid)
-			break;
-
 	// Got a response to an unexpected msgno
-	if (i == npend) {
+	if (!_pending_get(n, (int64_t)resphd->callid, &pend, &arena, &lazy)) {
 		rbuf.used = _H_PARSE_ERROR;
 		goto out;
 	}
 
-	ASSERT(pend[i].pd_slurper);
+	ASSERT(pend.pd_slurper);
 
 	if (resphd->status ==
 	    HADOOP__COMMON__RPC_RESPONSE_HEADER_PROTO__RPC_STATUS_PROTO__ERROR) {
-		result = malloc(sizeof(*result));
-		ASSERT(result);
-		result->rs_msgno = (int64_t)resphd->callid;
 		/* XXX: errordetail also potentially interesting */
-		result->rs_obj = _object_exception(resphd->exceptionclassname,
-		    resphd->errormsg);
+		result = _hdfs_result_new((int64_t)resphd->callid,
+		    _object_exception(resphd->exceptionclassname,
+		    strlen(resphd->exceptionclassname), resphd->errormsg));
 		goto out;
 	} else if (resphd->status ==
 	    HADOOP__COMMON__RPC_RESPONSE_HEADER_PROTO__RPC_STATUS_PROTO__FATAL) {
@@ -2274,16 +2746,19 @@ _hdfs_result_deserialize_v2_2(char *buf, int buflen, int *obj_size,
 		goto out;
 
 	rbuf.size = rbuf.used + respsz;
-	obj = pend[i].pd_slurper(&rbuf);
+	if (lazy) {
+		result = _hdfs_result_new_raw((int64_t)resphd->callid, &rbuf,
+		    arena);
+		goto out;
+	}
+
+	obj = pend.pd_slurper(&rbuf, arena);
 	if (obj == NULL) {
 		rbuf.used = _H_PARSE_ERROR;
 		goto out;
 	}
 
-	result = malloc(sizeof(*result));
-	ASSERT(result);
-	result->rs_msgno = (int64_t)resphd->callid;
-	result->rs_obj = obj;
+	result = _hdfs_result_new((int64_t)resphd->callid, obj);
 
 out:
 	if (resphd)
@@ -0,0 +1,847 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hadoofus/objects.h>
+
+#include "arena.h"
+#include "pbwire.h"
+#include "util.h"
+
+//
+// A minimal protobuf wire reader, and decoders built on it for the messages
+// in hdfs.proto that dominate response volume (file status, located blocks,
+// directory listings). Field numbers are from hdfs.proto.
+//
+// Strings are borrowed from the arena's copy of the message. The byte just
+// past a string is always the next tag (or past the end of the message, which
+// is why the copy has one spare byte), so once that tag has been read the
+// string can be terminated in place. Repeated fields are counted before they
+// are decoded, so that their arrays are allocated once at the right size.
+//
+
+#define PBW_VARINT	0
+#define PBW_FIXED64	1
+#define PBW_LEN		2
+#define PBW_FIXED32	5
+
+#define PBW_TAG(field, wt)	((uint32_t)(field) << 3 | (wt))
+
+struct _pbw {
+	uint8_t *pw_p,			/* cursor */
+		*pw_end;		/* end of the current message */
+	char *pw_nul;			/* pending string terminator */
+	struct _hdfs_arena *pw_ar;
+	bool pw_err;
+};
+
+static uint64_t
+_pbw_varint(struct _pbw *r)
+{
+	uint64_t v = 0;
+	uint8_t b;
+
+	for (unsigned shift = 0; shift < 64 && r->pw_p < r->pw_end;
+	    shift += 7) {
+		b = *r->pw_p++;
+		v |= (uint64_t)(b & 0x7f) << shift;
+		if ((b & 0x80) == 0)
+			return v;
+	}
+
+	r->pw_err = true;
+	return 0;
+}
+
+static void
+_pbw_flush(struct _pbw *r)
+{
+
+	if (r->pw_nul) {
+		*r->pw_nul = '\0';
+		r->pw_nul = NULL;
+	}
+}
+
+// Returns the next tag in the current message, or 0 at its end (or on error).
+static uint32_t
+_pbw_next(struct _pbw *r)
+{
+	uint64_t tag;
+
+	if (r->pw_err || r->pw_p >= r->pw_end)
+		return 0;
+
+	tag = _pbw_varint(r);
+	// The previous field is behind us now; safe to terminate it.
+	_pbw_flush(r);
+
+	if ((tag >> 3) == 0 || tag > UINT32_MAX)
+		r->pw_err = true;
+	if (r->pw_err)
+		return 0;
+	return (uint32_t)tag;
+}
+
+static uint8_t *
+_pbw_bytes(struct _pbw *r, size_t *len_out)
+{
+	uint8_t *res;
+	uint64_t len;
+
+	len = _pbw_varint(r);
+	if (r->pw_err || len > (uint64_t)(r->pw_end - r->pw_p)) {
+		r->pw_err = true;
+		*len_out = 0;
+		return NULL;
+	}
+
+	res = r->pw_p;
+	r->pw_p += len;
+	*len_out = len;
+	return res;
+}
+
+static char *
+_pbw_str(struct _pbw *r)
+{
+	size_t len;
+	char *res;
+
+	res = (char *)_pbw_bytes(r, &len);
+	if (res)
+		r->pw_nul = res + len;
+	return res;
+}
+
+static void
+_pbw_skip(struct _pbw *r, uint32_t tag)
+{
+	size_t len;
+
+	switch (tag & 7) {
+	case PBW_VARINT:
+		(void)_pbw_varint(r);
+		break;
+	case PBW_LEN:
+		(void)_pbw_bytes(r, &len);
+		break;
+	case PBW_FIXED64:
+	case PBW_FIXED32:
+		len = ((tag & 7) == PBW_FIXED64)? 8 : 4;
+		if ((size_t)(r->pw_end - r->pw_p) < len)
+			r->pw_err = true;
+		else
+			r->pw_p += len;
+		break;
+	default:
+		/* Groups are long deprecated and unused by HDFS */
+		r->pw_err = true;
+		break;
+	}
+}
+
+// Narrows the reader to the embedded message at the cursor. Returns the
+// enclosing message's end, for _pbw_leave().
+static uint8_t *
+_pbw_enter(struct _pbw *r)
+{
+	uint8_t *oend = r->pw_end,
+		*msg;
+	size_t len;
+
+	msg = _pbw_bytes(r, &len);
+	if (msg) {
+		r->pw_p = msg;
+		r->pw_end = msg + len;
+	}
+	return oend;
+}
+
+static void
+_pbw_leave(struct _pbw *r, uint8_t *oend)
+{
+
+	r->pw_p = r->pw_end;
+	r->pw_end = oend;
+}
+
+// Counts the occurrences of 'tag' in the rest of the current message. Errors
+// are left for the real decode to find.
+static size_t
+_pbw_count(struct _pbw r, uint32_t want)
+{
+	size_t res = 0;
+	uint32_t tag;
+
+	r.pw_nul = NULL;
+	while ((tag = _pbw_next(&r)) != 0) {
+		if (tag == want)
+			res++;
+		_pbw_skip(&r, tag);
+	}
+	return res;
+}
+
+static struct hdfs_object *
+_pbw_obj(struct _pbw *r, enum hdfs_object_type type)
+{
+	struct hdfs_object *res;
+
+	res = _arena_alloc(r->pw_ar, sizeof(*res));
+	memset(res, 0, sizeof(*res));
+	res->ob_type = type;
+	res->ob_arena = r->pw_ar;
+	return res;
+}
+
+static struct hdfs_object **
+_pbw_array(struct _pbw *r, size_t n)
+{
+
+	if (n == 0)
+		return NULL;
+	return _arena_alloc(r->pw_ar, n * sizeof(struct hdfs_object *));
+}
+
+// 'req' is a mask of (1 << field) for the message's required fields.
+static bool
+_pbw_check(struct _pbw *r, unsigned have, unsigned req)
+{
+
+	if ((have & req) != req)
+		r->pw_err = true;
+	return !r->pw_err;
+}
+
+#define _PBW_REQ2(a, b)		(1u << (a) | 1u << (b))
+#define _PBW_REQ3(a, b, c)	(_PBW_REQ2(a, b) | 1u << (c))
+
+/*
+ * LocatedBlockProto's blockToken: a BlockTokenIdentifierProto in our hdfs.proto,
+ * laid out field for field like hadoop.common.TokenProto.
+ */
+static struct hdfs_object *
+_pbw_token(struct _pbw *r)
+{
+	struct hdfs_object *res;
+	struct hdfs_token *t;
+	unsigned have = 0;
+	uint32_t tag;
+	size_t len;
+
+	res = _pbw_obj(r, H_TOKEN);
+	t = &res->ob_val._token;
+
+	while ((tag = _pbw_next(r)) != 0) {
+		switch (tag) {
+		case PBW_TAG(1, PBW_LEN):
+			t->_strings[0] = (char *)_pbw_bytes(r, &len);
+			t->_lens[0] = len;
+			break;
+		case PBW_TAG(2, PBW_LEN):
+			t->_strings[1] = (char *)_pbw_bytes(r, &len);
+			t->_lens[1] = len;
+			break;
+		case PBW_TAG(3, PBW_LEN):
+			t->_strings[2] = _pbw_str(r);
+			break;
+		case PBW_TAG(4, PBW_LEN):
+			t->_strings[3] = _pbw_str(r);
+			break;
+		default:
+			_pbw_skip(r, tag);
+			continue;
+		}
+		have |= 1u << (tag >> 3);
+	}
+
+	if (!_pbw_check(r, have, _PBW_REQ2(1, 2) | _PBW_REQ2(3, 4)))
+		return NULL;
+	return res;
+}
+
+// The datanode port as a string, as hdfs_datanode_info has it. (snprintf()
+// would be a good part of the cost of decoding a datanode.)
+static char *
+_pbw_port_str(struct _pbw *r, uint64_t port)
+{
+	char digits[12], *res;
+	unsigned n = 0;
+	uint32_t v;
+
+	v = (uint32_t)port;
+	do {
+		digits[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v > 0);
+
+	res = _arena_alloc(r->pw_ar, n + 1);
+	for (unsigned i = 0; i < n; i++)
+		res[i] = digits[n - 1 - i];
+	res[n] = '\0';
+	return res;
+}
+
+/* DatanodeIDProto, into the caller's datanode info */
+static void
+_pbw_datanode_id(struct _pbw *r, struct hdfs_datanode_info *dn)
+{
+	unsigned have = 0;
+	uint32_t tag;
+
+	while ((tag = _pbw_next(r)) != 0) {
+		switch (tag) {
+		case PBW_TAG(1, PBW_LEN):
+		case PBW_TAG(3, PBW_LEN):
+		case PBW_TAG(5, PBW_VARINT):
+			_pbw_skip(r, tag);
+			break;
+		case PBW_TAG(2, PBW_LEN):
+			dn->_hostname = _pbw_str(r);
+			break;
+		case PBW_TAG(4, PBW_VARINT):
+			dn->_port = _pbw_port_str(r, _pbw_varint(r));
+			break;
+		case PBW_TAG(6, PBW_VARINT):
+			dn->_namenodeport = _pbw_varint(r);
+			break;
+		default:
+			_pbw_skip(r, tag);
+			continue;
+		}
+		have |= 1u << (tag >> 3);
+	}
+
+	(void)_pbw_check(r, have, _PBW_REQ3(1, 2, 3) | _PBW_REQ3(4, 5, 6));
+}
+
+/* DatanodeInfoProto */
+static struct hdfs_object *
+_pbw_datanode_info(struct _pbw *r)
+{
+	struct hdfs_datanode_info *dn;
+	struct hdfs_object *res;
+	unsigned have = 0;
+	uint32_t tag;
+	uint8_t *oend;
+
+	res = _pbw_obj(r, H_DATANODE_INFO);
+	dn = &res->ob_val._datanode_info;
+
+	while ((tag = _pbw_next(r)) != 0) {
+		switch (tag) {
+		case PBW_TAG(1, PBW_LEN):
+			oend = _pbw_enter(r);
+			_pbw_datanode_id(r, dn);
+			_pbw_leave(r, oend);
+			break;
+		case PBW_TAG(8, PBW_LEN):
+			dn->_location = _pbw_str(r);
+			break;
+		default:
+			_pbw_skip(r, tag);
+			continue;
+		}
+		have |= 1u << (tag >> 3);
+	}
+
+	if (!_pbw_check(r, have, 1u << 1))
+		return NULL;
+
+	if (dn->_location == NULL) {
+		dn->_location = _arena_alloc(r->pw_ar, 1);
+		dn->_location[0] = '\0';
+	}
+	return res;
+}
+
+/* ExtendedBlockProto, into the caller's located block */
+static void
+_pbw_extended_block(struct _pbw *r, struct hdfs_located_block *lb)
+{
+	unsigned have = 0;
+	uint32_t tag;
+
+	while ((tag = _pbw_next(r)) != 0) {
+		switch (tag) {
+		case PBW_TAG(1, PBW_LEN):
+			lb->_pool_id = _pbw_str(r);
+			break;
+		case PBW_TAG(2, PBW_VARINT):
+			lb->_blockid = _pbw_varint(r);
+			break;
+		case PBW_TAG(3, PBW_VARINT):
+			lb->_generation = _pbw_varint(r);
+			break;
+		case PBW_TAG(4, PBW_VARINT):
+			lb->_len = _pbw_varint(r);
+			break;
+		default:
+			_pbw_skip(r, tag);
+			continue;
+		}
+		have |= 1u << (tag >> 3);
+	}
+
+	(void)_pbw_check(r, have, _PBW_REQ3(1, 2, 3));
+}
+
+/* LocatedBlockProto */
+static struct hdfs_object *
+_pbw_located_block(struct _pbw *r)
+{
+	struct hdfs_located_block *lb;
+	struct hdfs_object *res, *o;
+	unsigned have = 0;
+	uint8_t *oend;
+	uint32_t tag;
+	size_t n, i;
+
+	n = _pbw_count(*r, PBW_TAG(3, PBW_LEN));
+	if (n > INT32_MAX) {
+		r->pw_err = true;
+		return NULL;
+	}
+
+	res = _pbw_obj(r, H_LOCATED_BLOCK);
+	lb = &res->ob_val._located_block;
+	lb->_locs = _pbw_array(r, n);
+	i = 0;
+
+	while ((tag = _pbw_next(r)) != 0) {
+		switch (tag) {
+		case PBW_TAG(1, PBW_LEN):
+			oend = _pbw_enter(r);
+			_pbw_extended_block(r, lb);
+			_pbw_leave(r, oend);
+			break;
+		case PBW_TAG(2, PBW_VARINT):
+			lb->_offset = _pbw_varint(r);
+			break;
+		case PBW_TAG(3, PBW_LEN):
+			oend = _pbw_enter(r);
+			o = _pbw_datanode_info(r);
+			_pbw_leave(r, oend);
+			if (o && i < n)
+				lb->_locs[i++] = o;
+			break;
+		case PBW_TAG(4, PBW_VARINT):
+			lb->_corrupt = (_pbw_varint(r) != 0);
+			break;
+		case PBW_TAG(5, PBW_LEN):
+			oend = _pbw_enter(r);
+			lb->_token = _pbw_token(r);
+			_pbw_leave(r, oend);
+			break;
+		default:
+			_pbw_skip(r, tag);
+			continue;
+		}
+		have |= 1u << (tag >> 3);
+	}
+
+	if (!_pbw_check(r, have, _PBW_REQ2(1, 2) | _PBW_REQ2(4, 5)))
+		return NULL;
+	lb->_num_locs = i;
+	return res;
+}
+
+/* LocatedBlocksProto */
+static struct hdfs_object *
+_pbw_located_blocks(struct _pbw *r)
+{
+	struct hdfs_located_blocks *lbs;
+	struct hdfs_object *res, *o;
+	unsigned have = 0;
+	uint8_t *oend;
+	uint32_t tag;
+	size_t n, i;
+
+	n = _pbw_count(*r, PBW_TAG(2, PBW_LEN));
+	if (n > INT32_MAX) {
+		r->pw_err = true;
+		return NULL;
+	}
+
+	res = _pbw_obj(r, H_LOCATED_BLOCKS);
+	lbs = &res->ob_val._located_blocks;
+	lbs->_blocks = _pbw_array(r, n);
+	i = 0;
+
+	while ((tag = _pbw_next(r)) != 0) {
+		switch (tag) {
+		case PBW_TAG(1, PBW_VARINT):
+			lbs->_size = _pbw_varint(r);
+			break;
+		case PBW_TAG(2, PBW_LEN):
+			oend = _pbw_enter(r);
+			o = _pbw_located_block(r);
+			_pbw_leave(r, oend);
+			if (o && i < n)
+				lbs->_blocks[i++] = o;
+			break;
+		case PBW_TAG(3, PBW_VARINT):
+			lbs->_being_written = (_pbw_varint(r) != 0);
+			break;
+		case PBW_TAG(4, PBW_LEN):
+			oend = _pbw_enter(r);
+			lbs->_last_block = _pbw_located_block(r);
+			_pbw_leave(r, oend);
+			break;
+		case PBW_TAG(5, PBW_VARINT):
+			lbs->_last_block_complete = (_pbw_varint(r) != 0);
+			break;
+		default:
+			_pbw_skip(r, tag);
+			continue;
+		}
+		have |= 1u << (tag >> 3);
+	}
+
+	if (!_pbw_check(r, have, _PBW_REQ3(1, 3, 5)))
+		return NULL;
+	lbs->_num_blocks = i;
+	return res;
+}
+
+/* FsPermissionProto */
+static int16_t
+_pbw_permission(struct _pbw *r)
+{
+	unsigned have = 0;
+	int16_t res = 0;
+	uint32_t tag;
+
+	while ((tag = _pbw_next(r)) != 0) {
+		if (tag != PBW_TAG(1, PBW_VARINT)) {
+			_pbw_skip(r, tag);
+			continue;
+		}
+		res = (int16_t)_pbw_varint(r);
+		have |= 1u << 1;
+	}
+
+	(void)_pbw_check(r, have, 1u << 1);
+	return res;
+}
+
+/*
+ * HdfsFileStatusProto, into 'fs'. If 'locs_out' is non-NULL, the file's block
+ * locations (if any) are decoded into it; otherwise they are ignored, like the
+ * protobuf-c path does.
+ */
+static bool
+_pbw_file_status_fields(struct _pbw *r, struct hdfs_file_status *fs,
+	struct hdfs_object **locs_out)
+{
+	unsigned have = 0;
+	uint8_t *oend;
+	uint32_t tag;
+	uint64_t v;
+
+	fs->_num_children = -1;
+
+	while ((tag = _pbw_next(r)) != 0) {
+		switch (tag) {
+		case PBW_TAG(1, PBW_VARINT):
+			v = _pbw_varint(r);
+			if (v < HDFS_FT_DIR || v > HDFS_FT_SYMLINK)
+				r->pw_err = true;
+			fs->_type = v;
+			fs->_directory = (v == HDFS_FT_DIR);
+			break;
+		case PBW_TAG(2, PBW_LEN):
+			fs->_file = _pbw_str(r);
+			break;
+		case PBW_TAG(3, PBW_VARINT):
+			fs->_size = _pbw_varint(r);
+			break;
+		case PBW_TAG(4, PBW_LEN):
+			oend = _pbw_enter(r);
+			fs->_permissions = _pbw_permission(r);
+			_pbw_leave(r, oend);
+			break;
+		case PBW_TAG(5, PBW_LEN):
+			fs->_owner = _pbw_str(r);
+			break;
+		case PBW_TAG(6, PBW_LEN):
+			fs->_group = _pbw_str(r);
+			break;
+		case PBW_TAG(7, PBW_VARINT):
+			fs->_mtime = _pbw_varint(r);
+			break;
+		case PBW_TAG(8, PBW_VARINT):
+			fs->_atime = _pbw_varint(r);
+			break;
+		case PBW_TAG(9, PBW_LEN):
+			fs->_symlink_target = _pbw_str(r);
+			break;
+		case PBW_TAG(10, PBW_VARINT):
+			fs->_replication = (int16_t)_pbw_varint(r);
+			break;
+		case PBW_TAG(11, PBW_VARINT):
+			fs->_block_size = _pbw_varint(r);
+			break;
+		case PBW_TAG(12, PBW_LEN):
+			if (locs_out == NULL) {
+				_pbw_skip(r, tag);
+				break;
+			}
+			oend = _pbw_enter(r);
+			*locs_out = _pbw_located_blocks(r);
+			_pbw_leave(r, oend);
+			break;
+		case PBW_TAG(13, PBW_VARINT):
+			fs->_fileid = _pbw_varint(r);
+			break;
+		case PBW_TAG(14, PBW_VARINT):
+			fs->_num_children = (int32_t)_pbw_varint(r);
+			break;
+		default:
+			_pbw_skip(r, tag);
+			continue;
+		}
+		have |= 1u << (tag >> 3);
+	}
+
+	return _pbw_check(r, have, _PBW_REQ2(1, 2) | _PBW_REQ3(3, 4, 5) |
+	    _PBW_REQ3(6, 7, 8));
+}
+
+static struct hdfs_object *
+_pbw_file_status(struct _pbw *r, struct hdfs_object **locs_out)
+{
+	struct hdfs_object *res;
+
+	res = _pbw_obj(r, H_FILE_STATUS);
+	if (!_pbw_file_status_fields(r, &res->ob_val._file_status, locs_out))
+		return NULL;
+	return res;
+}
+
+// Whether any entry of the DirectoryListingProto at the cursor has locations.
+static bool
+_pbw_listing_has_locations(struct _pbw r)
+{
+	uint8_t *oend;
+	uint32_t tag;
+
+	r.pw_nul = NULL;
+	while ((tag = _pbw_next(&r)) != 0) {
+		if (tag != PBW_TAG(1, PBW_LEN)) {
+			_pbw_skip(&r, tag);
+			continue;
+		}
+
+		oend = _pbw_enter(&r);
+		if (_pbw_count(r, PBW_TAG(12, PBW_LEN)) > 0)
+			return true;
+		_pbw_leave(&r, oend);
+	}
+	return false;
+}
+
+/* DirectoryListingProto */
+static struct hdfs_object *
+_pbw_directory_listing(struct _pbw *r)
+{
+	struct hdfs_directory_listing *dl;
+	struct hdfs_object *res, *o, *locs;
+	unsigned have = 0;
+	uint8_t *oend;
+	uint32_t tag;
+	size_t n, i;
+
+	n = _pbw_count(*r, PBW_TAG(1, PBW_LEN));
+	if (n > INT32_MAX) {
+		r->pw_err = true;
+		return NULL;
+	}
+
+	res = _pbw_obj(r, H_DIRECTORY_LISTING);
+	dl = &res->ob_val._directory_listing;
+	dl->_has_locations = _pbw_listing_has_locations(*r);
+	dl->_files = _pbw_array(r, n);
+	if (dl->_has_locations)
+		dl->_located_blocks = _pbw_array(r, n);
+	i = 0;
+
+	while ((tag = _pbw_next(r)) != 0) {
+		switch (tag) {
+		case PBW_TAG(1, PBW_LEN):
+			locs = NULL;
+			oend = _pbw_enter(r);
+			o = _pbw_file_status(r,
+			    dl->_has_locations? &locs : NULL);
+			_pbw_leave(r, oend);
+
+			// Like the protobuf-c path, all or nothing.
+			if (dl->_has_locations && o && locs == NULL)
+				r->pw_err = true;
+			if (o && i < n) {
+				dl->_files[i] = o;
+				if (dl->_has_locations)
+					dl->_located_blocks[i] = locs;
+				i++;
+			}
+			break;
+		case PBW_TAG(2, PBW_VARINT):
+			dl->_remaining_entries = _pbw_varint(r);
+			break;
+		default:
+			_pbw_skip(r, tag);
+			continue;
+		}
+		have |= 1u << (tag >> 3);
+	}
+
+	if (!_pbw_check(r, have, 1u << 2))
+		return NULL;
+	dl->_num_files = i;
+	return res;
+}
+
+static struct hdfs_object *
+_pbw_response(struct _hdfs_arena *ar, const void *buf, size_t len,
+	enum hdfs_object_type type, bool required)
+{
+	struct hdfs_object *res = NULL;
+	struct _pbw r = { 0 };
+	uint8_t *copy, *oend;
+	uint32_t tag;
+
+	// One spare byte, to terminate a string that ends the message.
+	copy = _arena_alloc(ar, len + 1);
+	memcpy(copy, buf, len);
+
+	r.pw_p = copy;
+	r.pw_end = copy + len;
+	r.pw_ar = ar;
+
+	while ((tag = _pbw_next(&r)) != 0) {
+		if (tag != PBW_TAG(1, PBW_LEN)) {
+			_pbw_skip(&r, tag);
+			continue;
+		}
+
+		oend = _pbw_enter(&r);
+		switch (type) {
+		case H_DIRECTORY_LISTING:
+			res = _pbw_directory_listing(&r);
+			break;
+		case H_FILE_STATUS:
+			res = _pbw_file_status(&r, NULL);
+			break;
+		case H_LOCATED_BLOCKS:
+			res = _pbw_located_blocks(&r);
+			break;
+		case H_LOCATED_BLOCK:
+			res = _pbw_located_block(&r);
+			break;
+		default:
+			ASSERT(false);
+		}
+		_pbw_leave(&r, oend);
+	}
+	_pbw_flush(&r);
+
+	if (r.pw_err || (res == NULL && required))
+		return NULL;
+	if (res == NULL)
+		res = hdfs_null_new(type);
+	return res;
+}
+
+struct hdfs_object *
+_pbwire_directory_listing(struct _hdfs_arena *ar, const void *buf, size_t len)
+{
+
+	return _pbw_response(ar, buf, len, H_DIRECTORY_LISTING, false);
+}
+
+struct hdfs_object *
+_pbwire_file_status(struct _hdfs_arena *ar, const void *buf, size_t len)
+{
+
+	return _pbw_response(ar, buf, len, H_FILE_STATUS, false);
+}
+
+struct hdfs_object *
+_pbwire_located_blocks(struct _hdfs_arena *ar, const void *buf, size_t len)
+{
+
+	return _pbw_response(ar, buf, len, H_LOCATED_BLOCKS, false);
+}
+
+struct hdfs_object *
+_pbwire_located_block(struct _hdfs_arena *ar, const void *buf, size_t len)
+{
+
+	return _pbw_response(ar, buf, len, H_LOCATED_BLOCK, true);
+}
+
+bool
+_pbwire_listing_files(void *buf, size_t len, struct hdfs_file_status **files_out,
+	int *nfiles_out, uint32_t *remaining_out, bool *found_out)
+{
+	struct hdfs_file_status *files = NULL;
+	struct _pbw r = { 0 };
+	uint8_t *oend, *loend;
+	uint32_t tag, ltag;
+	size_t n = 0, i = 0;
+
+	r.pw_p = buf;
+	r.pw_end = (uint8_t *)buf + len;
+	*remaining_out = 0;
+	*found_out = false;
+
+	while ((tag = _pbw_next(&r)) != 0) {
+		if (tag != PBW_TAG(1, PBW_LEN) || *found_out) {
+			_pbw_skip(&r, tag);
+			continue;
+		}
+
+		/* DirectoryListingProto */
+		*found_out = true;
+		oend = _pbw_enter(&r);
+		n = _pbw_count(r, PBW_TAG(1, PBW_LEN));
+		if (n > INT32_MAX) {
+			r.pw_err = true;
+			break;
+		}
+		if (n > 0) {
+			files = calloc(n, sizeof(*files));
+			ASSERT(files);
+		}
+
+		while ((ltag = _pbw_next(&r)) != 0) {
+			switch (ltag) {
+			case PBW_TAG(1, PBW_LEN):
+				loend = _pbw_enter(&r);
+				if (i < n)
+					(void)_pbw_file_status_fields(&r,
+					    &files[i++], NULL);
+				_pbw_leave(&r, loend);
+				break;
+			case PBW_TAG(2, PBW_VARINT):
+				*remaining_out = _pbw_varint(&r);
+				break;
+			default:
+				_pbw_skip(&r, ltag);
+				break;
+			}
+		}
+		_pbw_leave(&r, oend);
+	}
+	_pbw_flush(&r);
+
+	if (r.pw_err) {
+		free(files);
+		return false;
+	}
+	*files_out = files;
+	*nfiles_out = i;
+	return true;
+}
@@ -0,0 +1,41 @@
+#ifndef _HADOOFUS_PBWIRE_H
+#define _HADOOFUS_PBWIRE_H
+
+#include <stddef.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct _hdfs_arena;
+struct hdfs_file_status;
+struct hdfs_object;
+
+// Decoders for the hottest HDFSv2 responses, straight from the protobuf wire
+// format rather than through protobuf-c. The message is copied into the arena
+// once, and the result's strings and token bytes point into that copy instead
+// of being duplicated; everything lives until the arena's root is freed.
+//
+// Each takes a whole <Foo>ResponseProto whose field 1 holds the named message.
+// They return NULL if the message is malformed, and a (heap) H_NULL object of
+// the appropriate type if an optional result is absent.
+
+struct hdfs_object *	_pbwire_directory_listing(struct _hdfs_arena *,
+			const void *, size_t);
+struct hdfs_object *	_pbwire_file_status(struct _hdfs_arena *,
+			const void *, size_t);
+struct hdfs_object *	_pbwire_located_blocks(struct _hdfs_arena *,
+			const void *, size_t);
+struct hdfs_object *	_pbwire_located_block(struct _hdfs_arena *,
+			const void *, size_t);
+
+// Decodes just the file statuses of a GetListingResponseProto, into a
+// malloc'd array (NULL if there are none) whose strings point into 'buf'.
+// 'buf' is modified to terminate them, and must have one spare byte past
+// 'len'. Locations are ignored. *found_out is false if the response has no
+// listing (the directory doesn't exist). Returns false if the message is
+// malformed.
+bool	_pbwire_listing_files(void *buf, size_t len,
+	struct hdfs_file_status **files_out, int *nfiles_out,
+	uint32_t *remaining_out, bool *found_out);
+
+#endif
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+
+#include <hadoofus/lowlevel.h>
+
+#include "objects-internal.h"
+#include "pending.h"
+#include "util.h"
+
+// Marks an unused slot. Msgnos are never negative.
+#define PD_FREE		(-1)
+
+// Fibonacci hashing. Masking the msgno directly would be cheaper, but then
+// the most recent (and mostly still outstanding) msgnos form one dense run of
+// slots and linear probing degrades badly at high depths.
+static inline int
+_pending_slot(int64_t msgno, int size)
+{
+
+	return (int)(((uint64_t)msgno * UINT64_C(0x9e3779b97f4a7c15)) >>
+	    (64 - __builtin_ctz(size)));
+}
+
+static void
+_pending_alloc(struct hdfs_namenode *n, int size)
+{
+
+	n->nn_pending = malloc(size * sizeof *n->nn_pending);
+	ASSERT(n->nn_pending);
+	n->nn_pending_size = size;
+
+	for (int i = 0; i < size; i++)
+		n->nn_pending[i].pd_msgno = PD_FREE;
+}
+
+// Place an entry known not to be in the table into a table with room for it.
+static void
+_pending_place(struct _hdfs_pending *tbl, int size,
+	const struct _hdfs_pending *pd)
+{
+	int i;
+
+	for (i = _pending_slot(pd->pd_msgno, size);
+	    tbl[i].pd_msgno != PD_FREE;
+	    i = (i + 1) & (size - 1))
+		;
+
+	tbl[i] = *pd;
+}
+
+static void
+_pending_resize(struct hdfs_namenode *n, int newsize)
+{
+	struct _hdfs_pending *old;
+	int oldsize;
+
+	old = n->nn_pending;
+	oldsize = n->nn_pending_size;
+
+	_pending_alloc(n, newsize);
+	for (int i = 0; i < oldsize; i++)
+		if (old[i].pd_msgno != PD_FREE)
+			_pending_place(n->nn_pending, newsize, &old[i]);
+
+	free(old);
+}
+
+void
+_pending_insert(struct hdfs_namenode *n, const struct _hdfs_pending *pd)
+{
+
+	ASSERT(pd->pd_msgno >= 0);
+
+	if (n->nn_pending == NULL)
+		_pending_alloc(n, _PENDING_MIN_SIZE);
+	// Keep the load factor at or below 1/2 so probe sequences stay short.
+	else if (2 * (n->nn_pending_len + 1) > n->nn_pending_size)
+		_pending_resize(n, 2 * n->nn_pending_size);
+
+	_pending_place(n->nn_pending, n->nn_pending_size, pd);
+	n->nn_pending_len++;
+}
+
+static int
+_pending_find(struct hdfs_namenode *n, int64_t msgno)
+{
+	int i, mask;
+
+	if (n->nn_pending_len == 0 || msgno < 0)
+		return -1;
+
+	mask = n->nn_pending_size - 1;
+	for (i = _pending_slot(msgno, n->nn_pending_size);
+	    n->nn_pending[i].pd_msgno != PD_FREE;
+	    i = (i + 1) & mask) {
+		if (n->nn_pending[i].pd_msgno == msgno)
+			return i;
+	}
+
+	return -1;
+}
+
+struct _hdfs_pending *
+_pending_lookup(struct hdfs_namenode *n, int64_t msgno)
+{
+	int i;
+
+	i = _pending_find(n, msgno);
+	if (i < 0)
+		return NULL;
+	return &n->nn_pending[i];
+}
+
+bool
+_pending_remove(struct hdfs_namenode *n, int64_t msgno,
+	struct _hdfs_pending *out)
+{
+	struct _hdfs_pending *tbl;
+	int i, j, k, mask;
+
+	i = _pending_find(n, msgno);
+	if (i < 0)
+		return false;
+
+	tbl = n->nn_pending;
+	mask = n->nn_pending_size - 1;
+	if (out)
+		*out = tbl[i];
+
+	// Backward-shift deletion: pull later members of the probe run into
+	// the hole if their home slot doesn't lie cyclically in (i, j]. This
+	// keeps lookups correct without tombstones.
+	for (j = (i + 1) & mask; tbl[j].pd_msgno != PD_FREE; j = (j + 1) & mask) {
+		k = _pending_slot(tbl[j].pd_msgno, n->nn_pending_size);
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		tbl[i] = tbl[j];
+		i = j;
+	}
+	tbl[i].pd_msgno = PD_FREE;
+	n->nn_pending_len--;
+
+	// Give memory back after a burst of outstanding RPCs drains.
+	if (n->nn_pending_size > _PENDING_MIN_SIZE &&
+	    8 * n->nn_pending_len < n->nn_pending_size)
+		_pending_resize(n, n->nn_pending_size / 2);
+
+	return true;
+}
+
+struct _hdfs_pending *
+_pending_take_all(struct hdfs_namenode *n, int *countp)
+{
+	struct _hdfs_pending *tbl;
+	int size, count = 0;
+
+	tbl = n->nn_pending;
+	size = n->nn_pending_size;
+
+	n->nn_pending = NULL;
+	n->nn_pending_len = n->nn_pending_size = 0;
+
+	// Compact the live entries to the front of the old table.
+	for (int i = 0; i < size; i++)
+		if (tbl[i].pd_msgno != PD_FREE)
+			tbl[count++] = tbl[i];
+
+	*countp = count;
+	return tbl;
+}
+
+void
+_pending_free(struct hdfs_namenode *n)
+{
+
+	free(n->nn_pending);
+	n->nn_pending = NULL;
+	n->nn_pending_len = n->nn_pending_size = 0;
+}
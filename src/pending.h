@@ -0,0 +1,41 @@
+#ifndef _HADOOFUS_PENDING_H
+#define _HADOOFUS_PENDING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <hadoofus/lowlevel.h>
+
+#include "objects-internal.h"
+
+// Table of in-flight RPCs on a namenode connection, keyed by msgno.
+//
+// This is an open-addressed (linear probing) hash table, sized to a power of
+// two and kept at most half full. Insert, lookup and remove are all O(1)
+// expected, independent of the number of outstanding RPCs.
+//
+// All functions must be called with n->nn_lock held.
+
+#define _PENDING_MIN_SIZE	16
+
+// Copies *pd (keyed by pd->pd_msgno) into the table.
+void			_pending_insert(struct hdfs_namenode *n,
+			const struct _hdfs_pending *pd);
+
+// Returns NULL if msgno isn't outstanding. The returned pointer is only valid
+// until the next insert or remove.
+struct _hdfs_pending *	_pending_lookup(struct hdfs_namenode *n, int64_t msgno);
+
+// Copies the entry into *out (if non-NULL) and removes it. Returns false if
+// msgno isn't outstanding.
+bool			_pending_remove(struct hdfs_namenode *n, int64_t msgno,
+			struct _hdfs_pending *out);
+
+// Empties the table. The removed entries are returned as a malloc'd array of
+// *countp elements (or NULL), so that the caller can complete them after
+// dropping nn_lock.
+struct _hdfs_pending *	_pending_take_all(struct hdfs_namenode *n, int *countp);
+
+void			_pending_free(struct hdfs_namenode *n);
+
+#endif
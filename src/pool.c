@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <hadoofus/highlevel.h>
+
+#include "pthread_wrappers.h"
+#include "util.h"
+
+//
+// A fixed number of connections to one namenode. Each invoke goes to the
+// member with the fewest outstanding RPCs; members whose connection breaks
+// are replaced by a background thread.
+//
+// Members are refcounted by their in-progress users (pm_users), so that a
+// replaced connection is only destroyed once nobody is invoking on it. RPCs
+// already in flight on it keep it alive as usual (futures hold a reference;
+// callbacks are failed on destroy).
+//
+
+struct _hdfs_pool_member {
+	struct hdfs_namenode *pm_nn;
+	struct _hdfs_pool_member *pm_next;	/* retired list */
+	int pm_users;
+	bool pm_retired;
+};
+
+struct hdfs_namenode_pool {
+	pthread_mutex_t np_lock;
+	pthread_cond_t np_cond;
+	struct _hdfs_pool_member **np_members,
+				 *np_retired;
+	int np_nconns;
+	bool np_stop,
+	     np_kick;
+	pthread_t np_thr;
+
+	char *np_host,
+	     *np_port,
+	     *np_user;
+	enum hdfs_kerb np_kerb;
+	enum hdfs_namenode_proto np_vers;
+};
+
+static void *	_pool_reconnect_worker(void *);
+
+static struct _hdfs_pool_member *
+_pool_member_new(struct hdfs_namenode *nn)
+{
+	struct _hdfs_pool_member *pm;
+
+	pm = malloc(sizeof(*pm));
+	ASSERT(pm);
+	memset(pm, 0, sizeof(*pm));
+	pm->pm_nn = nn;
+	return pm;
+}
+
+static char *
+_strdup(const char *s)
+{
+	char *res;
+
+	res = strdup(s);
+	ASSERT(res);
+	return res;
+}
+
+static void
+_pool_free(struct hdfs_namenode_pool *p)
+{
+	struct _hdfs_pool_member *pm;
+
+	for (int i = 0; i < p->np_nconns; i++) {
+		ASSERT(p->np_members[i]->pm_users == 0);
+		hdfs_namenode_delete(p->np_members[i]->pm_nn);
+		free(p->np_members[i]);
+	}
+	while ((pm = p->np_retired) != NULL) {
+		ASSERT(pm->pm_users == 0);
+		p->np_retired = pm->pm_next;
+		hdfs_namenode_delete(pm->pm_nn);
+		free(pm);
+	}
+
+	free(p->np_members);
+	free(p->np_host);
+	free(p->np_port);
+	free(p->np_user);
+	free(p);
+}
+
+EXPORT_SYM struct hdfs_namenode_pool *
+hdfs_namenode_pool_new(const char *host, const char *port,
+	const char *username, enum hdfs_kerb kerb_pref,
+	enum hdfs_namenode_proto vers, int nconns, const char **error_out)
+{
+	struct hdfs_namenode_pool *p;
+	struct hdfs_namenode *nn;
+	int rc;
+
+	ASSERT(nconns > 0);
+
+	p = malloc(sizeof(*p));
+	ASSERT(p);
+	memset(p, 0, sizeof(*p));
+
+	p->np_lock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+	p->np_cond = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+	p->np_host = _strdup(host);
+	p->np_port = _strdup(port);
+	p->np_user = _strdup(username);
+	p->np_kerb = kerb_pref;
+	p->np_vers = vers;
+
+	p->np_members = malloc(nconns * sizeof(*p->np_members));
+	ASSERT(p->np_members);
+
+	for (p->np_nconns = 0; p->np_nconns < nconns; p->np_nconns++) {
+		nn = hdfs_namenode_new_version(host, port, username, kerb_pref,
+		    vers, error_out);
+		if (nn == NULL) {
+			_pool_free(p);
+			return NULL;
+		}
+		p->np_members[p->np_nconns] = _pool_member_new(nn);
+	}
+
+	rc = pthread_create(&p->np_thr, NULL, _pool_reconnect_worker, p);
+	ASSERT(rc == 0);
+	return p;
+}
+
+// Caller must not have any invokes in progress, or namenodes gotten from the
+// pool, when deleting it.
+EXPORT_SYM void
+hdfs_namenode_pool_delete(struct hdfs_namenode_pool *p)
+{
+	int rc;
+
+	_lock(&p->np_lock);
+	p->np_stop = true;
+	_notifyall(&p->np_cond);
+	_unlock(&p->np_lock);
+
+	rc = pthread_join(p->np_thr, NULL);
+	ASSERT(rc == 0);
+
+	_pool_free(p);
+}
+
+// Returns the number of RPCs outstanding on (or about to be invoked on) a
+// member, or -1 if its connection is broken. (Cheaper than asking
+// hdfs_namenode_get_error() separately; this runs on every invoke.)
+static int
+_pool_member_load(struct _hdfs_pool_member *pm)
+{
+	struct hdfs_namenode *n = pm->pm_nn;
+	int res;
+
+	_lock(&n->nn_lock);
+	res = n->nn_pending_len;
+	if (n->nn_error || n->nn_sock == -1)
+		res = -1;
+	_unlock(&n->nn_lock);
+
+	if (res < 0 || __atomic_load_n(&n->nn_send_error, __ATOMIC_RELAXED))
+		return -1;
+
+	// Count callers about to invoke too, so that a burst of concurrent
+	// invokes spreads out before any of it reaches the pending table.
+	return res + pm->pm_users;
+}
+
+// Picks the least loaded healthy member and takes a use of it. Caller must
+// hold np_lock.
+static struct _hdfs_pool_member *
+_pool_pick(struct hdfs_namenode_pool *p)
+{
+	struct _hdfs_pool_member *best = NULL;
+	int load, best_load = 0;
+
+	for (int i = 0; i < p->np_nconns; i++) {
+		struct _hdfs_pool_member *pm = p->np_members[i];
+
+		load = _pool_member_load(pm);
+		if (load < 0)
+			continue;
+		if (best == NULL || load < best_load) {
+			best = pm;
+			best_load = load;
+		}
+	}
+
+	if (best)
+		best->pm_users++;
+	else {
+		// Everything is broken; don't wait out the reconnect interval.
+		p->np_kick = true;
+		_notifyall(&p->np_cond);
+	}
+	return best;
+}
+
+// Returns the member to destroy, if the caller was its last user.
+static struct _hdfs_pool_member *
+_pool_release_locked(struct hdfs_namenode_pool *p, struct _hdfs_pool_member *pm)
+{
+	struct _hdfs_pool_member **pp;
+
+	ASSERT(pm->pm_users > 0);
+	pm->pm_users--;
+	if (!pm->pm_retired || pm->pm_users > 0)
+		return NULL;
+
+	for (pp = &p->np_retired; *pp != pm; pp = &(*pp)->pm_next)
+		ASSERT(*pp);
+	*pp = pm->pm_next;
+	return pm;
+}
+
+static void
+_pool_release(struct hdfs_namenode_pool *p, struct _hdfs_pool_member *pm,
+	bool broken)
+{
+	struct _hdfs_pool_member *dead;
+
+	_lock(&p->np_lock);
+	dead = _pool_release_locked(p, pm);
+	if (broken) {
+		p->np_kick = true;
+		_notifyall(&p->np_cond);
+	}
+	_unlock(&p->np_lock);
+
+	if (dead) {
+		hdfs_namenode_delete(dead->pm_nn);
+		free(dead);
+	}
+}
+
+EXPORT_SYM const char *
+hdfs_namenode_pool_invoke(struct hdfs_namenode_pool *p,
+	struct hdfs_object *rpc, struct hdfs_rpc_response_future *future)
+{
+	struct _hdfs_pool_member *pm;
+	const char *error;
+
+	_lock(&p->np_lock);
+	pm = _pool_pick(p);
+	_unlock(&p->np_lock);
+
+	if (pm == NULL)
+		return "No namenode connection available";
+
+	error = hdfs_namenode_invoke(pm->pm_nn, rpc, future);
+	_pool_release(p, pm, error != NULL);
+	return error;
+}
+
+EXPORT_SYM struct hdfs_namenode *
+hdfs_namenode_pool_get(struct hdfs_namenode_pool *p)
+{
+	struct _hdfs_pool_member *pm;
+
+	_lock(&p->np_lock);
+	pm = _pool_pick(p);
+	_unlock(&p->np_lock);
+
+	if (pm == NULL)
+		return NULL;
+	return pm->pm_nn;
+}
+
+EXPORT_SYM void
+hdfs_namenode_pool_put(struct hdfs_namenode_pool *p, struct hdfs_namenode *nn)
+{
+	struct _hdfs_pool_member *pm = NULL;
+
+	_lock(&p->np_lock);
+	for (int i = 0; i < p->np_nconns && pm == NULL; i++)
+		if (p->np_members[i]->pm_nn == nn)
+			pm = p->np_members[i];
+	for (struct _hdfs_pool_member *r = p->np_retired; r && pm == NULL;
+	    r = r->pm_next)
+		if (r->pm_nn == nn)
+			pm = r;
+	ASSERT(pm);
+	_unlock(&p->np_lock);
+
+	_pool_release(p, pm, hdfs_namenode_get_error(nn) != NULL);
+}
+
+// Replace broken members. Connecting is slow, so it happens without np_lock
+// held; the new connection is swapped in afterwards.
+static void
+_pool_reconnect(struct hdfs_namenode_pool *p)
+{
+	struct _hdfs_pool_member *old, *dead;
+	struct hdfs_namenode *nn;
+	const char *error;
+
+	for (int i = 0; i < p->np_nconns; i++) {
+		_lock(&p->np_lock);
+		old = p->np_members[i];
+		_unlock(&p->np_lock);
+
+		if (hdfs_namenode_get_error(old->pm_nn) == NULL)
+			continue;
+
+		nn = hdfs_namenode_new_version(p->np_host, p->np_port,
+		    p->np_user, p->np_kerb, p->np_vers, &error);
+		if (nn == NULL)
+			continue;
+
+		dead = NULL;
+		_lock(&p->np_lock);
+		p->np_members[i] = _pool_member_new(nn);
+		if (old->pm_users > 0) {
+			old->pm_retired = true;
+			old->pm_next = p->np_retired;
+			p->np_retired = old;
+		} else
+			dead = old;
+		_unlock(&p->np_lock);
+
+		if (dead) {
+			hdfs_namenode_delete(dead->pm_nn);
+			free(dead);
+		}
+	}
+}
+
+static void *
+_pool_reconnect_worker(void *v_p)
+{
+	struct hdfs_namenode_pool *p = v_p;
+
+	_lock(&p->np_lock);
+	while (!p->np_stop) {
+		if (!p->np_kick)
+			_waitlimit(&p->np_lock, &p->np_cond,
+			    _now_ms() + HDFS_POOL_RECONNECT_MS);
+		if (p->np_stop)
+			break;
+		p->np_kick = false;
+
+		_unlock(&p->np_lock);
+		_pool_reconnect(p);
+		_lock(&p->np_lock);
+	}
+	_unlock(&p->np_lock);
+
+	return NULL;
+}
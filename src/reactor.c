@@ -0,0 +1,254 @@
+#ifdef __linux__
+# include <sys/epoll.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <hadoofus/lowlevel.h>
+
+#include "pthread_wrappers.h"
+#include "reactor.h"
+#include "util.h"
+
+#ifdef __linux__
+
+//
+// A fixed pool of threads sharing one epoll set. Namenode sockets are
+// registered EPOLLONESHOT, so each connection is serviced by at most one
+// thread at a time and responses are still completed in order.
+//
+
+struct hdfs_reactor {
+	pthread_mutex_t re_lock;
+	pthread_cond_t re_cond;
+	int re_epfd,
+	    re_stoppipe[2],
+	    re_nthreads,
+	    re_nconns;
+	pthread_t *re_threads;
+};
+
+static void *	_reactor_worker(void *);
+
+EXPORT_SYM struct hdfs_reactor *
+hdfs_reactor_new(int nthreads, const char **error_out)
+{
+	struct hdfs_reactor *r;
+	struct epoll_event ev = { 0 };
+	int rc;
+
+	ASSERT(nthreads > 0);
+
+	r = malloc(sizeof(*r));
+	ASSERT(r);
+	memset(r, 0, sizeof(*r));
+
+	r->re_lock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+	r->re_cond = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+	r->re_nthreads = nthreads;
+	r->re_nconns = 0;
+	r->re_stoppipe[0] = r->re_stoppipe[1] = -1;
+
+	r->re_epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (r->re_epfd == -1)
+		goto err;
+
+	rc = pipe(r->re_stoppipe);
+	if (rc == -1)
+		goto err;
+
+	// Level-triggered, so that one write stops every thread:
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	rc = epoll_ctl(r->re_epfd, EPOLL_CTL_ADD, r->re_stoppipe[0], &ev);
+	if (rc == -1)
+		goto err;
+
+	r->re_threads = malloc(nthreads * sizeof(*r->re_threads));
+	ASSERT(r->re_threads);
+	for (int i = 0; i < nthreads; i++) {
+		rc = pthread_create(&r->re_threads[i], NULL, _reactor_worker, r);
+		ASSERT(rc == 0);
+	}
+
+	return r;
+
+err:
+	*error_out = strerror(errno);
+	if (r->re_stoppipe[0] != -1) {
+		close(r->re_stoppipe[0]);
+		close(r->re_stoppipe[1]);
+	}
+	if (r->re_epfd != -1)
+		close(r->re_epfd);
+	free(r);
+	return NULL;
+}
+
+EXPORT_SYM void
+hdfs_reactor_destroy(struct hdfs_reactor *r)
+{
+	ssize_t w;
+	int rc;
+
+	_lock(&r->re_lock);
+	ASSERT(r->re_nconns == 0);
+	_unlock(&r->re_lock);
+
+	w = write(r->re_stoppipe[1], "a", 1);
+	ASSERT(w == 1);
+
+	for (int i = 0; i < r->re_nthreads; i++) {
+		rc = pthread_join(r->re_threads[i], NULL);
+		ASSERT(rc == 0);
+	}
+
+	close(r->re_stoppipe[0]);
+	close(r->re_stoppipe[1]);
+	close(r->re_epfd);
+	free(r->re_threads);
+	free(r);
+}
+
+static void *
+_reactor_worker(void *v_r)
+{
+	struct hdfs_reactor *r = v_r;
+	struct epoll_event evs[16];
+	int nev;
+
+	while (true) {
+		nev = epoll_wait(r->re_epfd, evs, nelem(evs), -1);
+		if (nev == -1) {
+			ASSERT(errno == EINTR);
+			continue;
+		}
+
+		for (int i = 0; i < nev; i++) {
+			// hdfs_reactor_destroy()
+			if (evs[i].data.ptr == NULL)
+				return NULL;
+
+			_namenode_reactor_service(evs[i].data.ptr);
+		}
+	}
+}
+
+static void
+_reactor_ctl(struct hdfs_reactor *r, struct hdfs_namenode *n, int op)
+{
+	struct epoll_event ev = { 0 };
+	int rc;
+
+	ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+	ev.data.ptr = n;
+
+	rc = epoll_ctl(r->re_epfd, op, n->nn_sock, &ev);
+	ASSERT(rc == 0);
+}
+
+void
+_reactor_attach(struct hdfs_reactor *r, struct hdfs_namenode *n)
+{
+
+	_lock(&r->re_lock);
+	r->re_nconns++;
+	n->nn_recv_detached = false;
+	_unlock(&r->re_lock);
+
+	_reactor_ctl(r, n, EPOLL_CTL_ADD);
+}
+
+void
+_reactor_rearm(struct hdfs_reactor *r, struct hdfs_namenode *n)
+{
+
+	_reactor_ctl(r, n, EPOLL_CTL_MOD);
+}
+
+void
+_reactor_detach(struct hdfs_reactor *r, struct hdfs_namenode *n)
+{
+
+	// If the socket was closed on error, epoll already forgot about it.
+	if (n->nn_sock != -1)
+		(void)epoll_ctl(r->re_epfd, EPOLL_CTL_DEL, n->nn_sock, NULL);
+
+	// The namenode may be freed as soon as we drop re_lock, so this is the
+	// last time we touch it.
+	_lock(&r->re_lock);
+	r->re_nconns--;
+	n->nn_recv_detached = true;
+	_notifyall(&r->re_cond);
+	_unlock(&r->re_lock);
+}
+
+void
+_reactor_wait_detached(struct hdfs_reactor *r, struct hdfs_namenode *n)
+{
+
+	_lock(&r->re_lock);
+	while (!n->nn_recv_detached)
+		_wait(&r->re_lock, &r->re_cond);
+	_unlock(&r->re_lock);
+}
+
+#else /* !__linux__ */
+
+EXPORT_SYM struct hdfs_reactor *
+hdfs_reactor_new(int nthreads, const char **error_out)
+{
+
+	(void)nthreads;
+	*error_out = "hdfs_reactor is not supported on this platform";
+	return NULL;
+}
+
+EXPORT_SYM void
+hdfs_reactor_destroy(struct hdfs_reactor *r)
+{
+
+	(void)r;
+	ASSERT(false);
+}
+
+void
+_reactor_attach(struct hdfs_reactor *r, struct hdfs_namenode *n)
+{
+
+	(void)r;
+	(void)n;
+	ASSERT(false);
+}
+
+void
+_reactor_rearm(struct hdfs_reactor *r, struct hdfs_namenode *n)
+{
+
+	(void)r;
+	(void)n;
+	ASSERT(false);
+}
+
+void
+_reactor_detach(struct hdfs_reactor *r, struct hdfs_namenode *n)
+{
+
+	(void)r;
+	(void)n;
+	ASSERT(false);
+}
+
+void
+_reactor_wait_detached(struct hdfs_reactor *r, struct hdfs_namenode *n)
+{
+
+	(void)r;
+	(void)n;
+	ASSERT(false);
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _HADOOFUS_REACTOR_H
+#define _HADOOFUS_REACTOR_H
+
+#include <hadoofus/lowlevel.h>
+
+// Internal interface between namenode connections and the shared reactor.
+
+// Start servicing n's socket. Called once, on the first invoke.
+void	_reactor_attach(struct hdfs_reactor *, struct hdfs_namenode *);
+// Called by the servicing thread after a pass that drained the socket; the
+// caller must not touch the namenode after this returns.
+void	_reactor_rearm(struct hdfs_reactor *, struct hdfs_namenode *);
+// Called by the servicing thread once the connection is finished; the caller
+// must not touch the namenode after this returns.
+void	_reactor_detach(struct hdfs_reactor *, struct hdfs_namenode *);
+// Blocks until _reactor_detach() has been called for n.
+void	_reactor_wait_detached(struct hdfs_reactor *, struct hdfs_namenode *);
+
+// Implemented in namenode.c. Receives and completes whatever is available on
+// n's socket without blocking, then rearms or detaches.
+void	_namenode_reactor_service(struct hdfs_namenode *);
+
+#endif
@@ -1,21 +1,26 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <hadoofus/objects.h>
 
+#include "arena.h"
 #include "heapbuf.h"
 #include "objects-internal.h"
+#include "pbwire.h"
 #include "rpc2-internal.h"
 #include "util.h"
 
 #include "ClientNamenodeProtocol.pb-c.h"
+#include "ProtobufRpcEngine.pb-c.h"
 
 /* Support logic for v2+ Namenode RPC (requests) */
 
 #define ENCODE_PREAMBLE(lowerCamel, CamelCase, UPPER_CASE)		\
 static void								\
 _rpc2_encode_ ## lowerCamel (struct hdfs_heap_buf *dest,		\
-	struct hdfs_rpc_invocation *rpc)				\
+	struct hdfs_rpc_invocation *rpc, bool delimited)		\
 {									\
 	CamelCase ## RequestProto req =					\
 	    UPPER_CASE ## _REQUEST_PROTO__INIT;				\
@@ -28,6 +33,8 @@ _rpc2_encode_ ## lowerCamel (struct hdfs_heap_buf *dest,		\
 
 #define ENCODE_POSTSCRIPT(lower_case)					\
 	sz = lower_case ## _request_proto__get_packed_size(&req);	\
+	if (delimited)							\
+		_bappend_vlint(dest, sz);				\
 	_hbuf_reserve(dest, sz);					\
 	lower_case ## _request_proto__pack(&req,			\
 	    (void *)&dest->buf[dest->used]);				\
@@ -348,12 +355,10 @@ ENCODE_PREAMBLE(getLinkTarget, GetLinkTarget, GET_LINK_TARGET)
 }
 ENCODE_POSTSCRIPT(get_link_target)
 
-typedef void (*_rpc2_encoder)(struct hdfs_heap_buf *, struct hdfs_rpc_invocation *);
-static struct _rpc2_enc_lut {
-	const char *	re_method;
-	_rpc2_encoder	re_encoder;
-} rpc2_encoders[] = {
-#define _RENC(method)	{ #method , _rpc2_encode_ ## method , }
+typedef void (*_rpc2_encoder)(struct hdfs_heap_buf *,
+	struct hdfs_rpc_invocation *, bool);
+static const _rpc2_encoder rpc2_encoders[_HDFS_RPC_END] = {
+#define _RENC(method)	[HDFS_RPC_ ## method] = _rpc2_encode_ ## method
 	_RENC(getServerDefaults),
 	_RENC(getListing),
 	_RENC(getBlockLocations),
@@ -378,26 +383,90 @@ static struct _rpc2_enc_lut {
 	_RENC(getFileLinkInfo),
 	_RENC(createSymlink),
 	_RENC(getLinkTarget),
-	{ NULL, NULL, },
 #undef _RENC
 };
 
+/* v2.2 RequestHeaderProto per method; built on first use */
+static struct hdfs_heap_buf *rpc2_headers[_HDFS_RPC_END];
+
+static _rpc2_encoder
+_rpc2_encoder_for(struct hdfs_rpc_invocation *rpc)
+{
+	_rpc2_encoder enc;
+
+	ASSERT((unsigned)rpc->_method_id < _HDFS_RPC_END);
+	enc = rpc2_encoders[rpc->_method_id];
+
+	/* The method does not exist in HDFSv2, or it is not yet implemented. */
+	ASSERT(enc);
+	return enc;
+}
+
 void
 _rpc2_request_serialize(struct hdfs_heap_buf *dest,
 	struct hdfs_rpc_invocation *rpc)
 {
-	/* XXXPERF Could be a hash/rt/sorted table */
-	unsigned i;
-
-	for (i = 0; rpc2_encoders[i].re_method; i++) {
-		if (streq(rpc->_method, rpc2_encoders[i].re_method)) {
-			rpc2_encoders[i].re_encoder(dest, rpc);
-			return;
-		}
+
+	_rpc2_encoder_for(rpc)(dest, rpc, false);
+}
+
+/*
+ * The v2.2 RequestHeaderProto only names the method and protocol, so it is
+ * packed (with its varint size) once per method and copied thereafter. The
+ * cache is filled racily; losers free their copy.
+ */
+static const struct hdfs_heap_buf *
+_rpc2_request_header(enum hdfs_rpc_method method)
+{
+	Hadoop__Common__RequestHeaderProto rh =
+	    HADOOP__COMMON__REQUEST_HEADER_PROTO__INIT;
+	struct hdfs_heap_buf *hdr, *expect;
+	size_t sz;
+
+	hdr = __atomic_load_n(&rpc2_headers[method], __ATOMIC_ACQUIRE);
+	if (hdr)
+		return hdr;
+
+	rh.methodname = __DECONST(char *, hdfs_rpc_method_to_string(method));
+	rh.declaringclassprotocolname = __DECONST(char *, CLIENT_PROTOCOL);
+	rh.clientprotocolversion = 1;
+	sz = hadoop__common__request_header_proto__get_packed_size(&rh);
+
+	hdr = malloc(sizeof(*hdr));
+	ASSERT(hdr);
+	memset(hdr, 0, sizeof(*hdr));
+	_bappend_vlint(hdr, sz);
+	_hbuf_reserve(hdr, sz);
+	hadoop__common__request_header_proto__pack(&rh,
+	    (void *)&hdr->buf[hdr->used]);
+	hdr->used += sz;
+
+	expect = NULL;
+	if (!__atomic_compare_exchange_n(&rpc2_headers[method], &expect, hdr,
+	    false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		free(hdr->buf);
+		free(hdr);
+		hdr = expect;
 	}
+	return hdr;
+}
 
-	/* The method does not exist in HDFSv2, or it is not yet implemented. */
-	ASSERT(false);
+/*
+ * Appends the v2.2 RequestHeaderProto and hdfs:*RequestProto, each prefixed
+ * with its varint size.
+ */
+void
+_rpc2_2_request_serialize(struct hdfs_heap_buf *dest,
+	struct hdfs_rpc_invocation *rpc)
+{
+	_rpc2_encoder enc;
+	const struct hdfs_heap_buf *hdr;
+
+	enc = _rpc2_encoder_for(rpc);
+	hdr = _rpc2_request_header(rpc->_method_id);
+
+	_bappend_mem(dest, hdr->used, hdr->buf);
+	enc(dest, rpc, true);
 }
 
 /* Support logic for Namenode RPC response parsing */
@@ -405,47 +474,123 @@ _rpc2_request_serialize(struct hdfs_heap_buf *dest,
 /*
  * These slurpers expect exactly one protobuf in the heapbuf passed in, and
  * advance the cursor (->used) to the end (->size) after a successful parse.
+ *
+ * In arena mode, the protobuf is unpacked into an arena. If the result was
+ * built in the same arena ('ar'), the arena becomes the result's; otherwise it
+ * is thrown away with the unpacked message.
  */
 #define DECODE_PB_EX(lowerCamel, CamelCase, lower_case, objbuilder_ex)	\
 static struct hdfs_object *						\
-_oslurp_ ## lowerCamel (struct hdfs_heap_buf *buf)			\
+_oslurp_ ## lowerCamel (struct hdfs_heap_buf *buf, bool arena)	\
 {									\
 	CamelCase ## ResponseProto *resp;				\
 	struct hdfs_object *result;					\
+	struct _hdfs_arena *ar;						\
 									\
 	result = NULL;							\
+	ar = NULL;							\
+	if (arena)							\
+		ar = _arena_new(_DECODE_ARENA_RATIO *			\
+		    (buf->size - buf->used));				\
 									\
-	resp = lower_case ## _response_proto__unpack(NULL,		\
+	resp = lower_case ## _response_proto__unpack(			\
+	    ar? &ar->ar_pballoc : NULL,					\
 	    buf->size - buf->used, (void *)&buf->buf[buf->used]);	\
 	buf->used = buf->size;						\
 	if (resp == NULL) {						\
+		if (ar)							\
+			_arena_free(ar);				\
 		buf->used = _H_PARSE_ERROR;				\
 		return NULL;						\
 	}								\
 									\
 	objbuilder_ex;							\
 									\
-	lower_case ## _response_proto__free_unpacked(resp, NULL);	\
+	if (ar && result && result->ob_arena == ar)			\
+		ar->ar_root = result;					\
+	else if (ar)							\
+		_arena_free(ar);					\
+	else								\
+		lower_case ## _response_proto__free_unpacked(resp, NULL); \
 	return result;							\
 }
 
+/* Decoded object trees are a few times the size of their encoding */
+#define _DECODE_ARENA_RATIO	4
+
 #define DECODE_PB(lowerCamel, CamelCase, lower_case, objbuilder, respfield)	\
 	DECODE_PB_EX(lowerCamel, CamelCase, lower_case,				\
 	    result = _hdfs_ ## objbuilder ## _new_proto(resp->respfield))
 
+/* For builders that can allocate from the arena */
+#define DECODE_PB_ARENA(lowerCamel, CamelCase, lower_case, objbuilder, respfield) \
+	DECODE_PB_EX(lowerCamel, CamelCase, lower_case,				\
+	    result = _hdfs_ ## objbuilder ## _new_proto(resp->respfield, ar))
+
+/*
+ * For optional results: an absent one (e.g. getFileInfo on a path that doesn't
+ * exist) decodes as a heap H_NULL of the given type, as pbwire.c does.
+ */
+#define DECODE_PB_ARENA_OPT(lowerCamel, CamelCase, lower_case, objbuilder, respfield, htype) \
+	DECODE_PB_EX(lowerCamel, CamelCase, lower_case,				\
+	    if (resp->respfield)						\
+		result = _hdfs_ ## objbuilder ## _new_proto(resp->respfield, ar); \
+	    else								\
+		result = hdfs_null_new(htype))
+
 #define DECODE_PB_VOID(lowerCamel, CamelCase, lower_case)		\
 	DECODE_PB_EX(lowerCamel, CamelCase, lower_case,			\
 	    result = hdfs_void_new())
 
+/*
+ * In arena mode, the hottest responses skip protobuf-c and are decoded
+ * straight from the wire (pbwire.c), borrowing their strings from the arena.
+ */
+static struct hdfs_object *
+_rpc2_wire_slurp(struct hdfs_heap_buf *buf,
+	struct hdfs_object *(*decode)(struct _hdfs_arena *, const void *, size_t))
+{
+	struct hdfs_object *result;
+	struct _hdfs_arena *ar;
+	size_t len;
+
+	len = buf->size - buf->used;
+	ar = _arena_new(_DECODE_ARENA_RATIO * len);
+
+	result = decode(ar, &buf->buf[buf->used], len);
+	buf->used = buf->size;
+	if (result == NULL) {
+		_arena_free(ar);
+		buf->used = _H_PARSE_ERROR;
+		return NULL;
+	}
+
+	if (result->ob_arena == ar)
+		ar->ar_root = result;
+	else
+		_arena_free(ar);
+	return result;
+}
+
+#define DECODE_WIRE(lowerCamel, wiredecoder)				\
+static struct hdfs_object *						\
+_wslurp_ ## lowerCamel (struct hdfs_heap_buf *buf, bool arena)	\
+{									\
+									\
+	if (!arena)							\
+		return _oslurp_ ## lowerCamel(buf, false);		\
+	return _rpc2_wire_slurp(buf, _pbwire_ ## wiredecoder);		\
+}
+
 
 DECODE_PB(getServerDefaults, GetServerDefaults, get_server_defaults, fsserverdefaults, serverdefaults)
-DECODE_PB(getListing, GetListing, get_listing, directory_listing, dirlist)
-DECODE_PB(getBlockLocations, GetBlockLocations, get_block_locations, located_blocks, locations)
+DECODE_PB_ARENA_OPT(getListing, GetListing, get_listing, directory_listing, dirlist, H_DIRECTORY_LISTING)
+DECODE_PB_ARENA_OPT(getBlockLocations, GetBlockLocations, get_block_locations, located_blocks, locations, H_LOCATED_BLOCKS)
 #if 0
 DECODE_PB_EX(create, Create, create,
 	/* HDFSv2.2+ returns a FileStatus, while 2.0.x returns void. */
 	if (resp->fs)
-		result = _hdfs_file_status_new_proto(resp->fs);
+		result = _hdfs_file_status_new_proto(resp->fs, ar);
 	else
 		result = hdfs_void_new())
 #else
@@ -458,7 +603,7 @@ DECODE_PB_VOID(create, Create, create)
 DECODE_PB(delete, Delete, delete, boolean, result)
 DECODE_PB_EX(append, Append, append,
 	if (resp->block)
-		result = _hdfs_located_block_new_proto(resp->block);
+		result = _hdfs_located_block_new_proto(resp->block, ar);
 	else
 		result = hdfs_null_new(H_LOCATED_BLOCK))
 DECODE_PB(setReplication, SetReplication, set_replication, boolean, result)
@@ -466,7 +611,7 @@ DECODE_PB_VOID(setPermission, SetPermission, set_permission)
 DECODE_PB_VOID(setOwner, SetOwner, set_owner)
 DECODE_PB(complete, Complete, complete, boolean, result)
 DECODE_PB_VOID(abandonBlock, AbandonBlock, abandon_block)
-DECODE_PB(addBlock, AddBlock, add_block, located_block, block)
+DECODE_PB_ARENA(addBlock, AddBlock, add_block, located_block, block)
 DECODE_PB(rename, Rename, rename, boolean, result)
 DECODE_PB(mkdirs, Mkdirs, mkdirs, boolean, result)
 DECODE_PB_VOID(renewLease, RenewLease, renew_lease)
@@ -475,20 +620,24 @@ DECODE_PB(getContentSummary, GetContentSummary, get_content_summary, content_sum
 DECODE_PB_VOID(setQuota, SetQuota, set_quota)
 DECODE_PB_VOID(fsync, Fsync, fsync)
 DECODE_PB_VOID(setTimes, SetTimes, set_times)
-DECODE_PB(getFileInfo, GetFileInfo, get_file_info, file_status, fs)
-DECODE_PB(getFileLinkInfo, GetFileLinkInfo, get_file_link_info, file_status, fs)
+DECODE_PB_ARENA_OPT(getFileInfo, GetFileInfo, get_file_info, file_status, fs, H_FILE_STATUS)
+DECODE_PB_ARENA_OPT(getFileLinkInfo, GetFileLinkInfo, get_file_link_info, file_status, fs, H_FILE_STATUS)
 DECODE_PB_VOID(createSymlink, CreateSymlink, create_symlink)
 DECODE_PB_EX(getLinkTarget, GetLinkTarget, get_link_target,
 	result = hdfs_string_new(resp->targetpath))
 
-static struct _rpc2_dec_lut {
-	const char *		rd_method;
-	hdfs_object_slurper	rd_decoder;
-} rpc2_decoders[] = {
-#define _RDEC(method)	{ #method , _oslurp_ ## method , }
+DECODE_WIRE(getListing, directory_listing)
+DECODE_WIRE(getBlockLocations, located_blocks)
+DECODE_WIRE(addBlock, located_block)
+DECODE_WIRE(getFileInfo, file_status)
+DECODE_WIRE(getFileLinkInfo, file_status)
+
+static const hdfs_object_slurper rpc2_decoders[_HDFS_RPC_END] = {
+#define _RDEC(method)	[HDFS_RPC_ ## method] = _oslurp_ ## method
+#define _WDEC(method)	[HDFS_RPC_ ## method] = _wslurp_ ## method
 	_RDEC(getServerDefaults),
-	_RDEC(getListing),
-	_RDEC(getBlockLocations),
+	_WDEC(getListing),
+	_WDEC(getBlockLocations),
 	_RDEC(create),
 	_RDEC(delete),
 	_RDEC(append),
@@ -497,7 +646,7 @@ static struct _rpc2_dec_lut {
 	_RDEC(setOwner),
 	_RDEC(complete),
 	_RDEC(abandonBlock),
-	_RDEC(addBlock),
+	_WDEC(addBlock),
 	_RDEC(rename),
 	_RDEC(mkdirs),
 	_RDEC(renewLease),
@@ -506,30 +655,27 @@ static struct _rpc2_dec_lut {
 	_RDEC(setQuota),
 	_RDEC(fsync),
 	_RDEC(setTimes),
-	_RDEC(getFileInfo),
-	_RDEC(getFileLinkInfo),
+	_WDEC(getFileInfo),
+	_WDEC(getFileLinkInfo),
 	_RDEC(createSymlink),
 	_RDEC(getLinkTarget),
-	{ NULL, NULL, },
 #undef _RDEC
+#undef _WDEC
 };
 
 hdfs_object_slurper
 _rpc2_slurper_for_rpc(struct hdfs_object *rpc)
 {
-	/* XXXPERF s.a. */
-	unsigned i;
+	enum hdfs_rpc_method id;
 
 	ASSERT(rpc->ob_type == H_RPC_INVOCATION);
 
-	for (i = 0; rpc2_decoders[i].rd_method; i++)
-		if (streq(rpc->ob_val._rpc_invocation._method,
-		    rpc2_decoders[i].rd_method))
-			return rpc2_decoders[i].rd_decoder;
+	id = rpc->ob_val._rpc_invocation._method_id;
+	ASSERT((unsigned)id < _HDFS_RPC_END);
 
 	/*
-	 * The method does not exist in HDFSv2 (this function can be called for
-	 * HDFSv1 methods) or it is not yet implemented.
+	 * NULL if the method does not exist in HDFSv2 (this function can be
+	 * called for HDFSv1 methods) or it is not yet implemented.
 	 */
-	return NULL;
+	return rpc2_decoders[id];
 }
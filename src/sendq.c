@@ -0,0 +1,107 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <stdlib.h>
+
+#include <hadoofus/lowlevel.h>
+
+#include "heapbuf.h"
+#include "net.h"
+#include "sendq.h"
+#include "util.h"
+
+// Frames per sendmsg(2).
+#define _SENDQ_IOV	128
+
+void
+_sendq_push(struct hdfs_namenode *n, struct _hdfs_sendq_frame *newest,
+	struct _hdfs_sendq_frame *oldest)
+{
+	struct _hdfs_sendq_frame *head;
+
+	head = __atomic_load_n(&n->nn_sendq, __ATOMIC_RELAXED);
+	do {
+		oldest->sf_next = head;
+	} while (!__atomic_compare_exchange_n(&n->nn_sendq, &head, newest,
+	    true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+}
+
+static struct _hdfs_sendq_frame *
+_sendq_reverse(struct _hdfs_sendq_frame *f)
+{
+	struct _hdfs_sendq_frame *prev = NULL, *next;
+
+	while (f) {
+		next = f->sf_next;
+		f->sf_next = prev;
+		prev = f;
+		f = next;
+	}
+	return prev;
+}
+
+// Send (and free) a FIFO list of frames. Only ever runs on one thread at a
+// time per connection, which also keeps SASL sequence numbers in wire order.
+static void
+_sendq_send(struct hdfs_namenode *n, struct _hdfs_sendq_frame *f)
+{
+	struct _hdfs_sendq_frame *batch, *next;
+	struct iovec iov[_SENDQ_IOV];
+	const char *error;
+	int iovcnt, flags;
+
+	while (f) {
+		batch = f;
+		for (iovcnt = 0; f && iovcnt < _SENDQ_IOV; iovcnt++, f = f->sf_next) {
+			if (n->nn_sasl_ssf > 0)
+				_sasl_encode_inplace(n->nn_sasl_ctx, &f->sf_buf);
+
+			iov[iovcnt].iov_base = f->sf_buf.buf;
+			iov[iovcnt].iov_len = f->sf_buf.used;
+		}
+
+		// Let the kernel hold a partial segment back if we already
+		// know more is coming.
+		flags = MSG_NOSIGNAL;
+		if (f || __atomic_load_n(&n->nn_sendq, __ATOMIC_SEQ_CST))
+			flags |= MSG_MORE;
+
+		if (!__atomic_load_n(&n->nn_send_error, __ATOMIC_RELAXED)) {
+			error = _sendmsg_all(n->nn_sock, iov, iovcnt, flags,
+			    &n->nn_send_syscalls);
+			if (error) {
+				__atomic_store_n(&n->nn_send_error, error,
+				    __ATOMIC_SEQ_CST);
+				// Wake the receiver, which fails pending rpcs.
+				shutdown(n->nn_sock, SHUT_RDWR);
+			}
+		}
+
+		for (; batch != f; batch = next) {
+			next = batch->sf_next;
+			free(batch->sf_buf.buf);
+			free(batch);
+		}
+	}
+}
+
+void
+_sendq_flush(struct hdfs_namenode *n)
+{
+	struct _hdfs_sendq_frame *list;
+
+	// Re-check after giving up the sender role: frames pushed while we
+	// were finishing up would otherwise be stranded, since their owner saw
+	// us sending and left them to us.
+	while (__atomic_load_n(&n->nn_sendq, __ATOMIC_SEQ_CST) != NULL) {
+		if (__atomic_exchange_n(&n->nn_sending, true, __ATOMIC_SEQ_CST))
+			break;
+
+		while ((list = __atomic_exchange_n(&n->nn_sendq, NULL,
+		    __ATOMIC_SEQ_CST)) != NULL)
+			_sendq_send(n, _sendq_reverse(list));
+
+		__atomic_store_n(&n->nn_sending, false, __ATOMIC_SEQ_CST);
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef _HADOOFUS_SENDQ_H
+#define _HADOOFUS_SENDQ_H
+
+#include <hadoofus/lowlevel.h>
+#include <hadoofus/objects.h>
+
+// Outgoing frames on a namenode connection.
+//
+// Any number of threads push serialized (but not yet SASL-wrapped) frames onto
+// a lock-free stack. Whichever thread finds no send in progress becomes the
+// sender: it takes everything queued so far, restores FIFO order and writes
+// it out in as few syscalls as possible, repeating until the queue is empty.
+// Everyone else returns as soon as their frames are queued.
+//
+// None of these functions may be called with n->nn_lock held.
+
+struct _hdfs_sendq_frame {
+	struct _hdfs_sendq_frame *sf_next;
+	struct hdfs_heap_buf sf_buf;
+};
+
+// Queue the chain of frames from 'newest' to 'oldest' (linked by sf_next,
+// most recent first). They are sent oldest first, without frames from other
+// threads interleaved.
+void		_sendq_push(struct hdfs_namenode *n,
+		struct _hdfs_sendq_frame *newest, struct _hdfs_sendq_frame *oldest);
+
+// Make sure everything queued so far gets sent, by this thread if no other
+// thread is already sending. The first write error is recorded in
+// n->nn_send_error and shuts the socket down; after that, queued frames are
+// discarded.
+void		_sendq_flush(struct hdfs_namenode *n);
+
+#endif
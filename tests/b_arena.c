@@ -0,0 +1,175 @@
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <hadoofus/objects.h>
+
+#include "../src/arena.h"
+#include "../src/objects-internal.h"
+#include "../src/pbwire.h"
+
+#include "../src/ClientNamenodeProtocol.pb-c.h"
+
+#include "b_main.h"
+
+//
+// Building (and freeing) the hdfs_object tree for a located getListing
+// response, from an already-unpacked protobuf: one malloc per object and
+// string, versus one arena per response. Then whole decodes from the wire:
+// protobuf-c unpacking into an arena, versus pbwire.c.
+//
+
+#define B_NFILES	1000
+#define B_NLOCS		3
+
+static DirectoryListingProto *
+_listing_proto(void)
+{
+	static HdfsFileStatusProto fss[B_NFILES], *fsps[B_NFILES];
+	static LocatedBlocksProto lbss[B_NFILES];
+	static LocatedBlockProto lb, *lbp = &lb;
+	static DatanodeInfoProto dns[B_NLOCS], *dnps[B_NLOCS];
+	static DatanodeIDProto dnid = DATANODE_IDPROTO__INIT;
+	static ExtendedBlockProto eb = EXTENDED_BLOCK_PROTO__INIT;
+	static BlockTokenIdentifierProto tok = BLOCK_TOKEN_IDENTIFIER_PROTO__INIT;
+	static FsPermissionProto perm = FS_PERMISSION_PROTO__INIT;
+	static DirectoryListingProto dl = DIRECTORY_LISTING_PROTO__INIT;
+	static char names[B_NFILES][16];
+
+	dnid.ipaddr = "10.0.0.1";
+	dnid.hostname = "datanode.example.com";
+	dnid.storageid = "DS-1";
+	dnid.xferport = 50010;
+	dnid.ipcport = 50020;
+	for (int i = 0; i < B_NLOCS; i++) {
+		dns[i] = (DatanodeInfoProto)DATANODE_INFO_PROTO__INIT;
+		dns[i].id = &dnid;
+		dns[i].location = "/default-rack";
+		dnps[i] = &dns[i];
+	}
+
+	eb.poolid = "BP-1234567890-10.0.0.1-1400000000000";
+	tok.identifier.data = (void *)"0123456789abcdef";
+	tok.identifier.len = 16;
+	tok.password.data = (void *)"fedcba9876543210";
+	tok.password.len = 16;
+	tok.kind = "HDFS_BLOCK_TOKEN";
+	tok.service = "";
+
+	lb = (LocatedBlockProto)LOCATED_BLOCK_PROTO__INIT;
+	lb.b = &eb;
+	lb.blocktoken = &tok;
+	lb.n_locs = B_NLOCS;
+	lb.locs = dnps;
+
+	perm.perm = 0644;
+	for (int i = 0; i < B_NFILES; i++) {
+		lbss[i] = (LocatedBlocksProto)LOCATED_BLOCKS_PROTO__INIT;
+		lbss[i].n_blocks = 1;
+		lbss[i].blocks = &lbp;
+
+		fss[i] = (HdfsFileStatusProto)HDFS_FILE_STATUS_PROTO__INIT;
+		fss[i].filetype = HDFS_FILE_STATUS_PROTO__FILE_TYPE__IS_FILE;
+		fss[i].path.len = snprintf(names[i], sizeof(names[i]),
+		    "part-%05d", i);
+		fss[i].path.data = (void *)names[i];
+		fss[i].owner = "hdfs";
+		fss[i].group = "supergroup";
+		fss[i].permission = &perm;
+		fss[i].locations = &lbss[i];
+		fsps[i] = &fss[i];
+	}
+
+	dl.n_partiallisting = B_NFILES;
+	dl.partiallisting = fsps;
+	return &dl;
+}
+
+static void *
+_listing_wire(DirectoryListingProto *dl, size_t *len_out)
+{
+	GetListingResponseProto resp = GET_LISTING_RESPONSE_PROTO__INIT;
+	void *res;
+
+	resp.dirlist = dl;
+	*len_out = get_listing_response_proto__get_packed_size(&resp);
+	res = malloc(*len_out);
+	if (res == NULL)
+		err(1, "malloc");
+	get_listing_response_proto__pack(&resp, res);
+	return res;
+}
+
+static void
+_report(const char *what, uint64_t ns, int iters)
+{
+
+	printf("%d-entry located listing, %-12s: %7.0f ns/entry\n",
+	    B_NFILES, what, (double)ns / iters / B_NFILES);
+}
+
+void
+b_arena(void)
+{
+	const int iters = 200;
+
+	GetListingResponseProto *resp;
+	DirectoryListingProto *dl;
+	struct _hdfs_arena *ar;
+	struct hdfs_object *obj;
+	uint64_t ns;
+	size_t len;
+	void *wire;
+
+	dl = _listing_proto();
+
+	for (int arena = 0; arena < 2; arena++) {
+		ns = b_now_ns();
+		for (int i = 0; i < iters; i++) {
+			ar = NULL;
+			if (arena)
+				ar = _arena_new(64 * 1024);
+			obj = _hdfs_directory_listing_new_proto(dl, ar);
+			if (obj == NULL)
+				errx(1, "decode");
+			if (ar)
+				ar->ar_root = obj;
+			hdfs_object_free(obj);
+		}
+		ns = b_now_ns() - ns;
+
+		_report(arena? "arena" : "heap", ns, iters);
+	}
+
+	wire = _listing_wire(dl, &len);
+
+	ns = b_now_ns();
+	for (int i = 0; i < iters; i++) {
+		ar = _arena_new(4 * len);
+		resp = get_listing_response_proto__unpack(&ar->ar_pballoc, len,
+		    wire);
+		if (resp == NULL)
+			errx(1, "unpack");
+		obj = _hdfs_directory_listing_new_proto(resp->dirlist, ar);
+		ar->ar_root = obj;
+		hdfs_object_free(obj);
+	}
+	ns = b_now_ns() - ns;
+	_report("unpack+arena", ns, iters);
+
+	ns = b_now_ns();
+	for (int i = 0; i < iters; i++) {
+		ar = _arena_new(4 * len);
+		obj = _pbwire_directory_listing(ar, wire, len);
+		if (obj == NULL)
+			errx(1, "decode");
+		ar->ar_root = obj;
+		hdfs_object_free(obj);
+	}
+	ns = b_now_ns() - ns;
+	_report("wire", ns, iters);
+
+	free(wire);
+}
@@ -0,0 +1,142 @@
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hadoofus/objects.h>
+
+#include "b_main.h"
+
+//
+// Memory held by the block map of a large file as an hdfs_object tree versus
+// a block table, and the cost of finding the block for an offset in each.
+// Tree sizes count only requested bytes, not malloc overhead, so they are an
+// underestimate.
+//
+
+#define B_NBLOCKS	10000
+#define B_NLOCS		3
+#define B_NDATANODES	50
+#define B_BLOCKSIZE	(128*1024*1024LL)
+
+static size_t
+_strbytes(const char *s)
+{
+
+	return s ? strlen(s) + 1 : 0;
+}
+
+static size_t
+_tree_bytes(const struct hdfs_object *lbs)
+{
+	const struct hdfs_located_block *lb;
+	const struct hdfs_datanode_info *di;
+	const struct hdfs_token *tok;
+	size_t res;
+
+	res = sizeof(*lbs) + ((lbs->ob_val._located_blocks._num_blocks + 7) /
+	    8 * 8) * sizeof(struct hdfs_object *);
+	for (int i = 0; i < lbs->ob_val._located_blocks._num_blocks; i++) {
+		lb = &lbs->ob_val._located_blocks._blocks[i]->
+		    ob_val._located_block;
+		res += sizeof(struct hdfs_object) + _strbytes(lb->_pool_id) +
+		    (lb->_num_locs + 7) / 8 * 8 * sizeof(struct hdfs_object *);
+
+		tok = &lb->_token->ob_val._token;
+		res += sizeof(struct hdfs_object) + tok->_lens[0] +
+		    tok->_lens[1] + _strbytes(tok->_strings[2]) +
+		    _strbytes(tok->_strings[3]);
+
+		for (int j = 0; j < lb->_num_locs; j++) {
+			di = &lb->_locs[j]->ob_val._datanode_info;
+			res += sizeof(struct hdfs_object) +
+			    _strbytes(di->_hostname) + _strbytes(di->_port) +
+			    _strbytes(di->_location);
+		}
+	}
+	return res;
+}
+
+static int
+_tree_find(const struct hdfs_object *lbs, int64_t offset)
+{
+	const struct hdfs_located_block *lb;
+
+	for (int i = 0; i < lbs->ob_val._located_blocks._num_blocks; i++) {
+		lb = &lbs->ob_val._located_blocks._blocks[i]->
+		    ob_val._located_block;
+		if (offset >= lb->_offset && offset < lb->_offset + lb->_len)
+			return i;
+	}
+	return -1;
+}
+
+void
+b_blocktable(void)
+{
+	const int iters = 10000;
+
+	struct hdfs_block_table *bt;
+	struct hdfs_object *lbs, *lb;
+	char host[32];
+	uint64_t ns;
+	size_t tree;
+	int64_t off;
+	int found;
+
+	lbs = hdfs_located_blocks_new(false, B_NBLOCKS * B_BLOCKSIZE);
+	for (int i = 0; i < B_NBLOCKS; i++) {
+		lb = hdfs_located_block_new(1073741825 + i, B_BLOCKSIZE, 1001 + i,
+		    i * B_BLOCKSIZE);
+		lb->ob_val._located_block._pool_id =
+		    strdup("BP-1234567890-10.0.0.1-1400000000000");
+		hdfs_object_free(lb->ob_val._located_block._token);
+		lb->ob_val._located_block._token = hdfs_token_new_nulsafe(
+		    "0123456789abcdef", 16, "fedcba9876543210", 16,
+		    "HDFS_BLOCK_TOKEN", "");
+		for (int j = 0; j < B_NLOCS; j++) {
+			snprintf(host, sizeof(host), "10.0.%d.%d",
+			    (i + j) % B_NDATANODES / 10,
+			    (i + j) % B_NDATANODES);
+			hdfs_located_block_append_datanode_info(lb,
+			    hdfs_datanode_info_new(host, "50010",
+			    "/default-rack", 50020));
+		}
+		hdfs_located_blocks_append_located_block(lbs, lb);
+	}
+
+	tree = _tree_bytes(lbs);
+
+	ns = b_now_ns();
+	bt = hdfs_block_table_new(lbs);
+	ns = b_now_ns() - ns;
+	if (bt == NULL)
+		errx(1, "hdfs_block_table_new");
+
+	printf("%d-block map, tree : %8zu bytes (%5.1f/block)\n", B_NBLOCKS,
+	    tree, (double)tree / B_NBLOCKS);
+	printf("%d-block map, table: %8zu bytes (%5.1f/block), built in "
+	    "%.1f ms\n", B_NBLOCKS, bt->_bytes, (double)bt->_bytes / B_NBLOCKS,
+	    ns / 1e6);
+
+	for (int table = 0; table < 2; table++) {
+		found = 0;
+		ns = b_now_ns();
+		for (int i = 0; i < iters; i++) {
+			off = (int64_t)i * 7919 % B_NBLOCKS * B_BLOCKSIZE + 1;
+			found += (table ? hdfs_block_table_find(bt, off) :
+			    _tree_find(lbs, off)) >= 0;
+		}
+		ns = b_now_ns() - ns;
+		if (found != iters)
+			errx(1, "find");
+
+		printf("%d-block map, %-5s find: %8.1f ns\n", B_NBLOCKS,
+		    table ? "table" : "tree", (double)ns / iters);
+	}
+
+	hdfs_block_table_free(bt);
+	hdfs_object_free(lbs);
+}
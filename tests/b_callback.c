@@ -0,0 +1,171 @@
+#include <err.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <hadoofus/highlevel.h>
+#include <hadoofus/lowlevel.h>
+
+#include "b_main.h"
+
+//
+// Round-trip throughput against a loopback namenode (b_fakenn.c), keeping
+// 'window' RPCs outstanding: futures (invoke a window, wait on each) versus
+// callbacks (each completion invokes the next RPC from the receive thread).
+//
+
+static const int b_nrpcs = 200000;
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct hdfs_namenode *nn;
+	struct hdfs_object *rpc;
+	int sent,
+	    done;
+} cbst = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void
+_check_result(struct hdfs_object *obj)
+{
+
+	if (obj->ob_type != H_LONG || obj->ob_val._long._val != 61)
+		errx(1, "unexpected response (type %d)", (int)obj->ob_type);
+	hdfs_object_free(obj);
+}
+
+static uint64_t
+_run_futures(struct hdfs_namenode *nn, struct hdfs_object *rpc, int window)
+{
+	struct hdfs_rpc_response_future *futures, **fps;
+	struct hdfs_object **rpcs, *obj;
+	const char *error;
+	uint64_t start;
+
+	futures = malloc(window * sizeof(*futures));
+	fps = malloc(window * sizeof(*fps));
+	rpcs = malloc(window * sizeof(*rpcs));
+	if (futures == NULL || fps == NULL || rpcs == NULL)
+		err(1, "malloc");
+	for (int i = 0; i < window; i++) {
+		fps[i] = &futures[i];
+		rpcs[i] = rpc;
+	}
+
+	start = b_now_ns();
+	for (int sent = 0; sent < b_nrpcs; sent += window) {
+		for (int i = 0; i < window; i++)
+			hdfs_rpc_response_future_init(&futures[i]);
+
+		error = hdfs_namenode_invoke_batch(nn, rpcs, fps, window);
+		if (error)
+			errx(1, "invoke: %s", error);
+
+		for (int i = 0; i < window; i++) {
+			hdfs_future_get(&futures[i], &obj);
+			_check_result(obj);
+		}
+	}
+	start = b_now_ns() - start;
+
+	free(futures);
+	free(fps);
+	free(rpcs);
+	return start;
+}
+
+static void
+_cb_done(struct hdfs_object *obj, void *ctx)
+{
+	const char *error;
+	bool more;
+
+	(void)ctx;
+	_check_result(obj);
+
+	pthread_mutex_lock(&cbst.lock);
+	cbst.done++;
+	more = (cbst.sent < b_nrpcs);
+	if (more)
+		cbst.sent++;
+	else if (cbst.done == cbst.sent)
+		pthread_cond_signal(&cbst.cond);
+	pthread_mutex_unlock(&cbst.lock);
+
+	if (more) {
+		error = hdfs_namenode_invoke_cb(cbst.nn, cbst.rpc, _cb_done, NULL);
+		if (error)
+			errx(1, "invoke: %s", error);
+	}
+}
+
+static uint64_t
+_run_callbacks(struct hdfs_namenode *nn, struct hdfs_object *rpc,
+	struct hdfs_object *cbrpc, int window)
+{
+	const char *error;
+	uint64_t start;
+
+	cbst.nn = nn;
+	cbst.rpc = cbrpc;
+	cbst.sent = window;
+	cbst.done = 0;
+
+	// Invocation stamps the msgno into the rpc object, so the priming
+	// calls can't share cbst.rpc with the receive thread.
+	start = b_now_ns();
+	for (int i = 0; i < window; i++) {
+		error = hdfs_namenode_invoke_cb(nn, rpc, _cb_done, NULL);
+		if (error)
+			errx(1, "invoke: %s", error);
+	}
+
+	pthread_mutex_lock(&cbst.lock);
+	while (cbst.done < b_nrpcs)
+		pthread_cond_wait(&cbst.cond, &cbst.lock);
+	pthread_mutex_unlock(&cbst.lock);
+
+	return b_now_ns() - start;
+}
+
+void
+b_callback(void)
+{
+	const int windows[] = { 1, 16, 256 };
+
+	struct hdfs_namenode *nn;
+	struct hdfs_object *rpc, *cbrpc;
+	const char *error;
+	uint64_t fu_ns, cb_ns;
+
+	nn = hdfs_namenode_new_version("127.0.0.1", b_fakenn_start(), "bench",
+	    HDFS_NO_KERB, HDFS_NN_v1, &error);
+	if (nn == NULL)
+		errx(1, "connect: %s", error);
+
+	rpc = hdfs_rpc_invocation_new("getProtocolVersion",
+	    hdfs_string_new(HADOOFUS_CLIENT_PROTOCOL_STR),
+	    hdfs_long_new(61),
+	    NULL);
+	cbrpc = hdfs_rpc_invocation_new("getProtocolVersion",
+	    hdfs_string_new(HADOOFUS_CLIENT_PROTOCOL_STR),
+	    hdfs_long_new(61),
+	    NULL);
+
+	for (unsigned i = 0; i < nelem(windows); i++) {
+		fu_ns = _run_futures(nn, rpc, windows[i]);
+		cb_ns = _run_callbacks(nn, rpc, cbrpc, windows[i]);
+
+		printf("window %3d: futures %7.0f rpc/s (%5.0f ns/rpc)  "
+		    "callbacks %7.0f rpc/s (%5.0f ns/rpc)\n", windows[i],
+		    b_nrpcs * 1e9 / fu_ns, (double)fu_ns / b_nrpcs,
+		    b_nrpcs * 1e9 / cb_ns, (double)cb_ns / b_nrpcs);
+	}
+
+	hdfs_object_free(rpc);
+	hdfs_object_free(cbrpc);
+	hdfs_namenode_delete(nn);
+}
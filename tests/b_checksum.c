@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/checksum.h"
+
+#include "b_main.h"
+
+// Checksumming one 64 kB packet, as a datanode write or read does, with each
+// kernel this CPU can run: the default HDFS chunk size, a few larger ones, and
+// the whole packet as a single chunk (pure single-stream throughput).
+void
+b_checksum(void)
+{
+	const int32_t chunksizes[] = { 512, 4096, 65536 };
+	const size_t pktlen = 64 * 1024;
+	const struct _hdfs_crc_kernel *ks;
+	uint8_t *data, *crcs;
+	size_t nk;
+
+	data = malloc(pktlen);
+	crcs = malloc(pktlen / 4);
+	if (data == NULL || crcs == NULL)
+		abort();
+	for (size_t i = 0; i < pktlen; i++)
+		data[i] = (uint8_t)(i * 2654435761u >> 24);
+
+	ks = _hdfs_crc_kernels(&nk);
+	for (size_t i = 0; i < nk; i++) {
+		const char *tname;
+
+		if (!_hdfs_crc_kernel_usable(&ks[i]))
+			continue;
+		tname = (ks[i].ck_type == HDFS_CSUM_CRC32C) ? "crc32c" : "crc32";
+
+		for (unsigned c = 0; c < nelem(chunksizes); c++) {
+			uint64_t start, end, bytes = 0;
+			int iters = 0;
+
+			start = b_now_ns();
+			do {
+				for (int j = 0; j < 64; j++)
+					_hdfs_crc_kernel_chunks(&ks[i],
+					    chunksizes[c], data, pktlen, crcs);
+				iters += 64;
+				end = b_now_ns();
+			} while (end - start < 200000000);
+			bytes = (uint64_t)iters * pktlen;
+
+			printf("%-6s %-9s chunk %5d: %6.2f GB/s\n", tname,
+			    ks[i].ck_name, (int)chunksizes[c],
+			    (double)bytes / (end - start));
+		}
+	}
+
+	free(crcs);
+	free(data);
+}
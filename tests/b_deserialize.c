@@ -0,0 +1,131 @@
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <hadoofus/lowlevel.h>
+#include <hadoofus/objects.h>
+
+#include "../src/heapbuf.h"
+#include "../src/objects-internal.h"
+
+#include "b_main.h"
+
+//
+// Cost of parsing one HDFSv1 response, for responses whose Writable header
+// is most of the work: a long (getProtocolVersion, renewLease...), a null
+// file status (getFileInfo of a missing path) and a file status. Then a large
+// getListing response arriving a segment at a time, either decoded from the
+// start each time more arrives, or only once a pre-scan finds all of it.
+//
+
+#define B_NFILES	50000
+#define B_SEGMENT	4096
+
+// Frames a successful response the way the namenode does: object types are
+// named twice, nulls are named by two different strings.
+static void
+_response(struct hdfs_heap_buf *b, const char *type, const char *type2,
+	struct hdfs_object *obj)
+{
+
+	_bappend_s32(b, 1);	/* msgno */
+	_bappend_s32(b, 0);	/* status */
+	_bappend_string(b, type);
+	if (type2)
+		_bappend_string(b, type2);
+	hdfs_object_serialize(b, obj);
+	hdfs_object_free(obj);
+}
+
+// Feeds 'b' to the receiver B_SEGMENT bytes at a time.
+static uint64_t
+_segmented(struct hdfs_heap_buf *b, bool scan)
+{
+	struct _hdfs_v1_scan vscan = { 0 };
+	struct _hdfs_result *res = NULL;
+	uint64_t ns;
+	int len, sz;
+
+	ns = b_now_ns();
+	for (len = 0; res == NULL; ) {
+		len += B_SEGMENT;
+		if (len > b->used)
+			len = b->used;
+
+		if (scan && !_hdfs_result_scan(&vscan, b->buf, len))
+			continue;
+		res = _hdfs_result_deserialize(b->buf, len, &sz);
+	}
+	ns = b_now_ns() - ns;
+
+	if (res == _HDFS_INVALID_PROTO || sz != b->used)
+		errx(1, "bad parse of listing");
+	_hdfs_result_free(res);
+	return ns;
+}
+
+void
+b_deserialize(void)
+{
+	const int iters = 1000000;
+
+	struct {
+		const char *name;
+		struct hdfs_heap_buf buf;
+	} resps[] = {
+		{ "long", { 0 } },
+		{ "null", { 0 } },
+		{ "file_status", { 0 } },
+	};
+	struct hdfs_heap_buf listing = { 0 };
+	struct hdfs_object *dl;
+	struct _hdfs_result *res;
+	char name[16];
+	uint64_t ns;
+	int sz;
+
+	_response(&resps[0].buf, LONG_TYPE, NULL, hdfs_long_new(61));
+	_response(&resps[1].buf, NULL_TYPE1, NULL_TYPE2,
+	    hdfs_null_new(H_FILE_STATUS));
+	_response(&resps[2].buf, FILESTATUS_TYPE, FILESTATUS_TYPE,
+	    hdfs_file_status_new_ex("part-00000", 1234567, false, 3,
+	    128*1024*1024, 1400000000000LL, 1400000000000LL, 0644, "hdfs",
+	    "supergroup"));
+
+	for (unsigned r = 0; r < nelem(resps); r++) {
+		ns = b_now_ns();
+		for (int i = 0; i < iters; i++) {
+			res = _hdfs_result_deserialize(resps[r].buf.buf,
+			    resps[r].buf.used, &sz);
+			if (res == NULL || res == _HDFS_INVALID_PROTO ||
+			    sz != resps[r].buf.used)
+				errx(1, "bad parse of %s", resps[r].name);
+			_hdfs_result_free(res);
+		}
+		ns = b_now_ns() - ns;
+
+		printf("v1 %-11s: %6.1f ns/response (%d bytes)\n",
+		    resps[r].name, (double)ns / iters, resps[r].buf.used);
+		free(resps[r].buf.buf);
+	}
+
+	dl = hdfs_directory_listing_new();
+	for (int i = 0; i < B_NFILES; i++) {
+		snprintf(name, sizeof(name), "part-%05d", i);
+		hdfs_directory_listing_append_file_status(dl,
+		    hdfs_file_status_new_ex(name, 1234567, false, 3,
+		    128*1024*1024, 1400000000000LL, 1400000000000LL, 0644,
+		    "hdfs", "supergroup"), NULL);
+	}
+	_response(&listing, DIRECTORYLISTING_TYPE, DIRECTORYLISTING_TYPE, dl);
+
+	for (int scan = 0; scan < 2; scan++) {
+		ns = _segmented(&listing, scan);
+		printf("v1 %d-entry listing in %d-byte segments, %-8s: "
+		    "%8.1f ms\n", B_NFILES, B_SEGMENT,
+		    scan? "prescan" : "redecode", ns / 1e6);
+	}
+	free(listing.buf);
+}
@@ -0,0 +1,168 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <err.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "b_main.h"
+
+//
+// A loopback stand-in for an HDFSv1 namenode, good enough to drive the RPC
+// machinery at full speed: it accepts the connection header and answers
+// every call with (long)61.
+//
+
+static int
+_read_full(int s, void *vbuf, size_t len)
+{
+	char *buf = vbuf;
+	ssize_t r;
+
+	while (len > 0) {
+		r = read(s, buf, len);
+		if (r <= 0)
+			return -1;
+		buf += r;
+		len -= r;
+	}
+	return 0;
+}
+
+static uint32_t
+_get32(const char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return ntohl(v);
+}
+
+static void *
+_fakenn_conn(void *v_s)
+{
+	const size_t BUFSZ = 1024*1024,
+	      RESPSZ = 4 + 4 + 2 + 4 + 8;
+
+	int s = (intptr_t)v_s;
+	char preamble[6], lenbuf[4], *in, *out, *hdr;
+	size_t inlen = 0;
+	uint32_t hdrlen;
+
+	in = malloc(BUFSZ);
+	out = malloc(BUFSZ);
+	if (in == NULL || out == NULL)
+		err(1, "malloc");
+
+	// "hrpc" version auth, then the length-prefixed connection header
+	if (_read_full(s, preamble, sizeof(preamble)) ||
+	    _read_full(s, lenbuf, sizeof(lenbuf)))
+		goto out;
+	hdrlen = _get32(lenbuf);
+	hdr = malloc(hdrlen);
+	if (hdr == NULL || _read_full(s, hdr, hdrlen))
+		goto out;
+	free(hdr);
+
+	while (true) {
+		size_t off = 0, outlen = 0;
+		ssize_t r;
+
+		r = read(s, in + inlen, BUFSZ - inlen);
+		if (r <= 0)
+			break;
+		inlen += r;
+
+		// Each call is <s32 len><s32 msgno>...; answer all the whole
+		// ones with one write.
+		while (inlen - off >= 8 && outlen + RESPSZ <= BUFSZ) {
+			uint32_t flen = _get32(in + off);
+
+			if (inlen - off < 4 + flen)
+				break;
+
+			memcpy(out + outlen, in + off + 4, 4);	/* msgno */
+			memset(out + outlen + 4, 0, 4);		/* status */
+			memcpy(out + outlen + 8, "\0\4long", 6);
+			memset(out + outlen + 14, 0, 7);
+			out[outlen + 21] = 61;
+			outlen += RESPSZ;
+
+			off += 4 + flen;
+		}
+
+		memmove(in, in + off, inlen - off);
+		inlen -= off;
+
+		if (outlen > 0 && write(s, out, outlen) != (ssize_t)outlen)
+			break;
+	}
+
+out:
+	close(s);
+	free(in);
+	free(out);
+	return NULL;
+}
+
+static void *
+_fakenn_acceptor(void *v_ls)
+{
+	int ls = (intptr_t)v_ls, s, rc, one = 1;
+	pthread_t thr;
+
+	while (true) {
+		s = accept(ls, NULL, NULL);
+		if (s == -1)
+			continue;
+
+		// Like the real thing; otherwise Nagle and delayed ACKs
+		// dominate any test with few RPCs in flight.
+		(void)setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		rc = pthread_create(&thr, NULL, _fakenn_conn, (void *)(intptr_t)s);
+		if (rc)
+			errx(1, "pthread_create: %s", strerror(rc));
+		pthread_detach(thr);
+	}
+	return NULL;
+}
+
+// Returns the (loopback) port the fake namenode listens on.
+const char *
+b_fakenn_start(void)
+{
+	static char port[8];
+
+	struct sockaddr_in sin = { 0 };
+	socklen_t slen = sizeof(sin);
+	pthread_t thr;
+	int ls, rc;
+
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	ls = socket(AF_INET, SOCK_STREAM, 0);
+	if (ls == -1)
+		err(1, "socket");
+	if (bind(ls, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+		err(1, "bind");
+	if (listen(ls, 128) == -1)
+		err(1, "listen");
+	if (getsockname(ls, (struct sockaddr *)&sin, &slen) == -1)
+		err(1, "getsockname");
+
+	rc = pthread_create(&thr, NULL, _fakenn_acceptor, (void *)(intptr_t)ls);
+	if (rc)
+		errx(1, "pthread_create: %s", strerror(rc));
+	pthread_detach(thr);
+
+	snprintf(port, sizeof(port), "%u", (unsigned)ntohs(sin.sin_port));
+	return port;
+}
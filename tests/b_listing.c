@@ -0,0 +1,92 @@
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hadoofus/objects.h>
+
+#include "b_main.h"
+
+//
+// Decoding a large (HDFSv1) directory listing into an hdfs_object tree versus
+// a listing table: time, and memory held afterwards. Tree sizes count only
+// requested bytes, not malloc overhead, so they are an underestimate.
+//
+
+#define B_NFILES	100000
+
+static size_t
+_tree_bytes(const struct hdfs_object *dl)
+{
+	const struct hdfs_file_status *fs;
+	size_t res;
+	int n;
+
+	n = dl->ob_val._directory_listing._num_files;
+	res = sizeof(*dl) + (n + 7) / 8 * 8 * sizeof(struct hdfs_object *);
+	for (int i = 0; i < n; i++) {
+		fs = &dl->ob_val._directory_listing._files[i]->ob_val._file_status;
+		res += sizeof(struct hdfs_object) + strlen(fs->_file) + 1 +
+		    strlen(fs->_owner) + 1 + strlen(fs->_group) + 1;
+	}
+	return res;
+}
+
+void
+b_listing(void)
+{
+	const int iters = 10;
+
+	struct hdfs_heap_buf wire = { 0 }, rbuf;
+	struct hdfs_listing_table *lt = NULL;
+	struct hdfs_object *dl;
+	char name[32];
+	uint64_t ns;
+	size_t tree;
+
+	dl = hdfs_directory_listing_new();
+	for (int i = 0; i < B_NFILES; i++) {
+		snprintf(name, sizeof(name), "part-%05d.gz", i);
+		hdfs_directory_listing_append_file_status(dl,
+		    hdfs_file_status_new_ex(name, 1234567, false, 3,
+		    128*1024*1024, 1400000000000LL, 1400000000000LL, 0644,
+		    i % 3 ? "etl" : "hdfs", "supergroup"), NULL);
+	}
+	hdfs_object_serialize(&wire, dl);
+	hdfs_object_free(dl);
+
+	ns = b_now_ns();
+	for (int i = 0; i < iters; i++) {
+		rbuf = (struct hdfs_heap_buf) { .buf = wire.buf, .size = wire.used };
+		dl = hdfs_object_slurp(&rbuf, H_DIRECTORY_LISTING);
+		if (dl == NULL)
+			errx(1, "hdfs_object_slurp");
+		if (i < iters - 1)
+			hdfs_object_free(dl);
+	}
+	ns = b_now_ns() - ns;
+	tree = _tree_bytes(dl);
+	hdfs_object_free(dl);
+	printf("v1 %d-entry listing, tree : %6.1f ms, %9zu bytes "
+	    "(%5.1f/entry)\n", B_NFILES, ns / 1e6 / iters, tree,
+	    (double)tree / B_NFILES);
+
+	ns = b_now_ns();
+	for (int i = 0; i < iters; i++) {
+		if (lt)
+			hdfs_listing_table_free(lt);
+		rbuf = (struct hdfs_heap_buf) { .buf = wire.buf, .size = wire.used };
+		lt = hdfs_listing_table_slurp(&rbuf);
+		if (lt == NULL)
+			errx(1, "hdfs_listing_table_slurp");
+	}
+	ns = b_now_ns() - ns;
+	printf("v1 %d-entry listing, table: %6.1f ms, %9zu bytes "
+	    "(%5.1f/entry)\n", B_NFILES, ns / 1e6 / iters, lt->_bytes,
+	    (double)lt->_bytes / B_NFILES);
+
+	hdfs_listing_table_free(lt);
+	free(wire.buf);
+}
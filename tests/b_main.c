@@ -0,0 +1,41 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "b_main.h"
+
+static const struct {
+	const char *name;
+	void (*fn)(void);
+} benches[] = {
+	{ "arena", b_arena },
+	{ "blocktable", b_blocktable },
+	{ "callback", b_callback },
+	{ "checksum", b_checksum },
+	{ "deserialize", b_deserialize },
+	{ "listing", b_listing },
+	{ "mthello", b_mthello },
+	{ "pending", b_pending },
+	{ "serialize", b_serialize },
+};
+
+// With no arguments, run everything; otherwise, only the named benchmarks.
+int
+main(int argc, char **argv)
+{
+	for (unsigned i = 0; i < nelem(benches); i++) {
+		bool run = (argc < 2);
+
+		for (int j = 1; j < argc; j++)
+			if (strcmp(argv[j], benches[i].name) == 0)
+				run = true;
+		if (!run)
+			continue;
+
+		printf("== %s\n", benches[i].name);
+		benches[i].fn();
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,37 @@
+#ifndef _B_MAIN_H
+#define _B_MAIN_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifndef nelem
+# define nelem(ARR) (sizeof(ARR) / sizeof(ARR[0]))
+#endif
+
+// Offline micro-benchmarks. These don't need an HDFS cluster; each benchmark
+// prints one line per configuration it measures. Benchmarks that exercise the
+// RPC path talk to a fake loopback namenode instead.
+
+void		b_arena(void);
+void		b_blocktable(void);
+void		b_callback(void);
+void		b_checksum(void);
+void		b_deserialize(void);
+void		b_listing(void);
+void		b_mthello(void);
+void		b_pending(void);
+void		b_serialize(void);
+
+// b_fakenn.c: starts an HDFSv1 namenode stand-in; returns its port.
+const char *	b_fakenn_start(void);
+
+static inline uint64_t
+b_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,133 @@
+#include <err.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hadoofus/highlevel.h>
+#include <hadoofus/lowlevel.h>
+
+#include "b_main.h"
+
+//
+// examples/mt-hello.c as a benchmark: many threads share one namenode
+// connection, each repeatedly invoking a burst of RPCs and then waiting for
+// them. Reports throughput and send syscalls per RPC; then the same through a
+// hdfs_namenode_pool.
+//
+
+#define B_BURST		100
+static const int b_rounds = 20;
+
+struct b_target {
+	struct hdfs_namenode *nn;
+	struct hdfs_namenode_pool *pool;
+};
+
+static void *
+_mthello_thread(void *v_tgt)
+{
+	struct hdfs_rpc_response_future futures[B_BURST];
+	struct b_target *tgt = v_tgt;
+	struct hdfs_object *rpc, *obj;
+	const char *error;
+
+	rpc = hdfs_rpc_invocation_new("getProtocolVersion",
+	    hdfs_string_new(HADOOFUS_CLIENT_PROTOCOL_STR),
+	    hdfs_long_new(61),
+	    NULL);
+
+	for (int r = 0; r < b_rounds; r++) {
+		for (int i = 0; i < B_BURST; i++) {
+			futures[i] = HDFS_RPC_RESPONSE_FUTURE_INITIALIZER;
+			if (tgt->pool)
+				error = hdfs_namenode_pool_invoke(tgt->pool,
+				    rpc, &futures[i]);
+			else
+				error = hdfs_namenode_invoke(tgt->nn, rpc,
+				    &futures[i]);
+			if (error)
+				errx(1, "invoke: %s", error);
+		}
+
+		for (int i = 0; i < B_BURST; i++) {
+			hdfs_future_get(&futures[i], &obj);
+			if (obj->ob_type != H_LONG || obj->ob_val._long._val != 61)
+				errx(1, "bad result");
+			hdfs_object_free(obj);
+		}
+	}
+
+	hdfs_object_free(rpc);
+	return NULL;
+}
+
+static uint64_t
+_mthello_run(struct b_target *tgt, int nthreads)
+{
+	pthread_t *thrs;
+	uint64_t ns;
+	int rc;
+
+	thrs = malloc(nthreads * sizeof(*thrs));
+	if (thrs == NULL)
+		err(1, "malloc");
+
+	ns = b_now_ns();
+	for (int i = 0; i < nthreads; i++) {
+		rc = pthread_create(&thrs[i], NULL, _mthello_thread, tgt);
+		if (rc)
+			errx(1, "pthread_create: %s", strerror(rc));
+	}
+	for (int i = 0; i < nthreads; i++)
+		pthread_join(thrs[i], NULL);
+	ns = b_now_ns() - ns;
+
+	free(thrs);
+	return ns;
+}
+
+void
+b_mthello(void)
+{
+	const int nthreads[] = { 1, 10, 100 },
+	      npool = 4;
+
+	struct b_target tgt = { 0 };
+	const char *port, *error;
+	uint64_t ns, nrpcs, sends0;
+
+	port = b_fakenn_start();
+	tgt.nn = hdfs_namenode_new_version("127.0.0.1", port, "bench",
+	    HDFS_NO_KERB, HDFS_NN_v1, &error);
+	if (tgt.nn == NULL)
+		errx(1, "connect: %s", error);
+
+	for (unsigned t = 0; t < nelem(nthreads); t++) {
+		sends0 = tgt.nn->nn_send_syscalls;
+		ns = _mthello_run(&tgt, nthreads[t]);
+
+		nrpcs = (uint64_t)nthreads[t] * b_rounds * B_BURST;
+		printf("%3d threads, 1 conn:  %8.0f rpc/s, %.3f send syscalls/rpc\n",
+		    nthreads[t], nrpcs * 1e9 / ns,
+		    (double)(tgt.nn->nn_send_syscalls - sends0) / nrpcs);
+	}
+
+	hdfs_namenode_delete(tgt.nn);
+	tgt.nn = NULL;
+
+	tgt.pool = hdfs_namenode_pool_new("127.0.0.1", port, "bench",
+	    HDFS_NO_KERB, HDFS_NN_v1, npool, &error);
+	if (tgt.pool == NULL)
+		errx(1, "connect: %s", error);
+
+	for (unsigned t = 0; t < nelem(nthreads); t++) {
+		ns = _mthello_run(&tgt, nthreads[t]);
+
+		nrpcs = (uint64_t)nthreads[t] * b_rounds * B_BURST;
+		printf("%3d threads, %d conns: %8.0f rpc/s\n", nthreads[t],
+		    npool, nrpcs * 1e9 / ns);
+	}
+
+	hdfs_namenode_pool_delete(tgt.pool);
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/pending.h"
+
+#include "b_main.h"
+
+static uint64_t
+xorshift(uint64_t *s)
+{
+
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+// Steady state with 'depth' RPCs in flight: each response is looked up (as
+// the deserializer does), removed (completion), and replaced by a new
+// invocation. Responses arrive in random order.
+void
+b_pending(void)
+{
+	const int depths[] = { 10, 100, 1000, 10000, 100000 };
+	const int iters = 1000000;
+
+	for (unsigned d = 0; d < nelem(depths); d++) {
+		struct hdfs_namenode n = { 0 };
+		struct hdfs_rpc_response_future fu;
+		struct _hdfs_pending pd = { .pd_future = &fu };
+		int64_t *outstanding, msgno = 0;
+		uint64_t seed = 0x9e3779b97f4a7c15ULL, start, end;
+		int depth = depths[d];
+
+		outstanding = malloc(depth * sizeof(*outstanding));
+		if (outstanding == NULL)
+			abort();
+
+		for (int i = 0; i < depth; i++) {
+			outstanding[i] = pd.pd_msgno = msgno++;
+			_pending_insert(&n, &pd);
+		}
+
+		start = b_now_ns();
+		for (int i = 0; i < iters; i++) {
+			int k = xorshift(&seed) % depth;
+
+			if (_pending_lookup(&n, outstanding[k]) == NULL ||
+			    !_pending_remove(&n, outstanding[k], NULL))
+				abort();
+
+			outstanding[k] = pd.pd_msgno = msgno++;
+			_pending_insert(&n, &pd);
+		}
+		end = b_now_ns();
+
+		printf("%7d outstanding: %6.1f ns/response (table size %d)\n",
+		    depth, (double)(end - start) / iters, n.nn_pending_size);
+
+		_pending_free(&n);
+		free(outstanding);
+	}
+}
@@ -375,6 +375,26 @@ START_TEST(test_dn_write_file)
 	    towrite/1024/1024, end - begin, _i? " (with crcs)":"",
 	    (double)towrite/(end-begin)/1024*1000/1024);
 
+	// Cut the last block off the output file, and read it back again,
+	// directly into a mapping of the file
+	bl = bls->ob_val._located_blocks._blocks[
+	    bls->ob_val._located_blocks._num_blocks - 1];
+	fail_if(ftruncate(ofd, (off_t)blocksz *
+	    (bls->ob_val._located_blocks._num_blocks - 1)) == -1,
+	    "ftruncate: %s", strerror(errno));
+
+	dn = hdfs_datanode_new(bl, client, HDFS_DATANODE_AP_1_0, &err);
+	ck_assert_msg((intptr_t)dn, "error connecting to datanode: %s", err);
+
+	err = hdfs_datanode_read_file_mmap(dn, 0/*offset-in-block*/,
+	    bl->ob_val._located_block._len,
+	    ofd,
+	    (off_t)blocksz * (bls->ob_val._located_blocks._num_blocks - 1),
+	    _i/*crcs*/);
+
+	hdfs_datanode_delete(dn);
+	fail_if(err, "error reading block to mapping: %s", err);
+
 	hdfs_object_free(bls);
 	fail_if(filecmp(fd, ofd, towrite), "read differed from write");
 
@@ -1,5 +1,7 @@
 #include <check.h>
 
+#include <stdlib.h>
+
 #include <hadoofus/highlevel.h>
 
 #include "t_main.h"
@@ -39,6 +41,14 @@ setup22(void)
 	_setup(HDFS_NN_v2_2);
 }
 
+static void
+setup22_lazy(void)
+{
+
+	_setup(HDFS_NN_v2_2);
+	hdfs_namenode_set_lazy_decode(h, true);
+}
+
 static void
 teardown(void)
 {
@@ -404,6 +414,31 @@ START_TEST(test_renewLease)
 }
 END_TEST
 
+START_TEST(test_renewLease_raw)
+{
+	struct hdfs_rpc_response_future future =
+	    HDFS_RPC_RESPONSE_FUTURE_INITIALIZER;
+	struct hdfs_object *rpc, *obj;
+	const char *err;
+	size_t rawlen;
+	void *raw;
+
+	rpc = hdfs_rpc_invocation_new("renewLease",
+	    hdfs_string_new("HADOOFUS_CLIENT"),
+	    NULL);
+	err = hdfs_namenode_invoke(h, rpc, &future);
+	hdfs_object_free(rpc);
+	ck_assert_msg(err == NULL, "%s", err);
+
+	// Left undecoded; RenewLeaseResponseProto is empty
+	hdfs_future_get_raw(&future, &obj, &raw, &rawlen);
+	ck_assert(obj == NULL);
+	ck_assert(raw != NULL);
+	ck_assert_int_eq(rawlen, 0);
+	free(raw);
+}
+END_TEST
+
 START_TEST(test_getStats)
 {
 	struct hdfs_object *e = NULL, *stats;
@@ -811,6 +846,56 @@ err:
 }
 END_TEST
 
+START_TEST(test_pool)
+{
+	struct hdfs_rpc_response_future futures[8];
+	struct hdfs_namenode_pool *p;
+	struct hdfs_namenode *nns[4];
+	struct hdfs_object *rpc, *obj, *e = NULL;
+	const char *err = NULL;
+	int64_t pv;
+
+	p = hdfs_namenode_pool_new(H_ADDR, "8020", H_USER, HDFS_NO_KERB,
+	    HDFS_NN_v1, 4, &err);
+	ck_assert_msg((intptr_t)p, "Could not connect: %s", err);
+
+	// Borrowed connections are spread across the pool
+	for (unsigned i = 0; i < nelem(nns); i++) {
+		nns[i] = hdfs_namenode_pool_get(p);
+		ck_assert(nns[i]);
+		for (unsigned j = 0; j < i; j++)
+			ck_assert(nns[i] != nns[j]);
+	}
+	for (unsigned i = 0; i < nelem(nns); i++) {
+		pv = hdfs_getProtocolVersion(nns[i],
+		    HADOOFUS_CLIENT_PROTOCOL_STR, 61L, &e);
+		if (e)
+			ck_abort_msg("exception: %s", hdfs_exception_get_message(e));
+		ck_assert(pv == 61L);
+		hdfs_namenode_pool_put(p, nns[i]);
+	}
+
+	rpc = hdfs_rpc_invocation_new("getProtocolVersion",
+	    hdfs_string_new(HADOOFUS_CLIENT_PROTOCOL_STR),
+	    hdfs_long_new(61),
+	    NULL);
+	for (unsigned i = 0; i < nelem(futures); i++) {
+		futures[i] = HDFS_RPC_RESPONSE_FUTURE_INITIALIZER;
+		err = hdfs_namenode_pool_invoke(p, rpc, &futures[i]);
+		ck_assert_msg(err == NULL, "%s", err);
+	}
+	for (unsigned i = 0; i < nelem(futures); i++) {
+		hdfs_future_get(&futures[i], &obj);
+		ck_assert(obj->ob_type == H_LONG);
+		ck_assert(obj->ob_val._long._val == 61L);
+		hdfs_object_free(obj);
+	}
+	hdfs_object_free(rpc);
+
+	hdfs_namenode_pool_delete(p);
+}
+END_TEST
+
 Suite *
 t_hl_rpc_basics_suite()
 {
@@ -849,6 +934,11 @@ t_hl_rpc_basics_suite()
 
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("pool");
+	tcase_add_test(tc, test_pool);
+
+	suite_add_tcase(s, tc);
+
 	tc = tcase_create("slow");
 	tcase_add_checked_fixture(tc, setup, teardown);
 	tcase_set_timeout(tc, 30./*seconds*/);
@@ -925,6 +1015,17 @@ t_hl_rpc2_basics_suite()
 	tcase_add_test(tc, test_recoverLease);
 	suite_add_tcase(s, tc);
 
+	// Decoded by hdfs_future_get() rather than the receive thread
+	tc = tcase_create("lazy22");
+	tcase_add_checked_fixture(tc, setup22_lazy, teardown);
+	tcase_add_test(tc, test_getBlockLocations2);
+	tcase_add_test(tc, test_create);
+	tcase_add_test(tc, test_getListing);
+	tcase_add_test(tc, test_renewLease);
+	tcase_add_test(tc, test_renewLease_raw);
+	tcase_add_test(tc, test_getFileInfo);
+	suite_add_tcase(s, tc);
+
 	/* My implementation of HDFS doesn't support this RPC. */
 	tc = tcase_create("broken22");
 	tcase_add_checked_fixture(tc, setup22, teardown);
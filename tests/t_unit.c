@@ -1,13 +1,32 @@
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
 #include <check.h>
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <zlib.h>
+
+#include "../src/arena.h"
+#include "../src/checksum.h"
+#include "../src/datatransfer.pb-c.h"
+#include "../src/dncache.h"
 #include "../src/heapbuf.h"
+#include "../src/objects-internal.h"
+#include "../src/pbwire.h"
+#include "../src/pending.h"
+#include "../src/rpc2-internal.h"
+#include "../src/Rpc2_2Header.pb-c.h"
+#include "../src/util.h"
 
 #include "t_main.h"
 
@@ -141,6 +160,1354 @@ START_TEST(test_vlint_roundtrip)
 }
 END_TEST
 
+START_TEST(test_pending_sequential)
+{
+	struct hdfs_namenode n = { 0 };
+	struct _hdfs_pending pd;
+	struct hdfs_rpc_response_future fu;
+	int64_t i;
+
+	for (i = 0; i < 1000; i++) {
+		pd = (struct _hdfs_pending) { .pd_msgno = i, .pd_future = &fu };
+		_pending_insert(&n, &pd);
+	}
+	ck_assert_int_eq(n.nn_pending_len, 1000);
+
+	for (i = 0; i < 1000; i++)
+		ck_assert_msg(_pending_lookup(&n, i) != NULL, "missing %jd",
+		    (intmax_t)i);
+	ck_assert_msg(_pending_lookup(&n, 1000) == NULL, "bogus hit");
+
+	// Complete out of order: evens first
+	for (i = 0; i < 1000; i += 2) {
+		ck_assert(_pending_remove(&n, i, &pd));
+		ck_assert_msg(pd.pd_msgno == i && pd.pd_future == &fu,
+		    "wrong entry for %jd", (intmax_t)i);
+	}
+	for (i = 0; i < 1000; i++)
+		ck_assert_msg((_pending_lookup(&n, i) != NULL) == (i % 2 == 1),
+		    "bad lookup for %jd", (intmax_t)i);
+	ck_assert(!_pending_remove(&n, 0, NULL));
+
+	for (i = 1; i < 1000; i += 2)
+		ck_assert(_pending_remove(&n, i, NULL));
+	ck_assert_int_eq(n.nn_pending_len, 0);
+	ck_assert_int_eq(n.nn_pending_size, _PENDING_MIN_SIZE);
+
+	_pending_free(&n);
+}
+END_TEST
+
+START_TEST(test_pending_random)
+{
+	struct hdfs_namenode n = { 0 };
+	bool live[256] = { 0 };
+	unsigned seed = 1;
+	int nlive = 0;
+
+	// A small key space forces plenty of collisions, wraparound and
+	// backward shifts; check the table against a trivial model.
+	for (int i = 0; i < 100000; i++) {
+		int64_t k = rand_r(&seed) % nelem(live);
+
+		if (live[k]) {
+			ck_assert(_pending_remove(&n, k, NULL));
+			nlive--;
+		} else {
+			ck_assert(_pending_lookup(&n, k) == NULL);
+			_pending_insert(&n, &(struct _hdfs_pending) { .pd_msgno = k });
+			nlive++;
+		}
+		live[k] = !live[k];
+
+		k = rand_r(&seed) % nelem(live);
+		ck_assert_msg((_pending_lookup(&n, k) != NULL) == live[k],
+		    "bad lookup for %jd at step %d", (intmax_t)k, i);
+		ck_assert_int_eq(n.nn_pending_len, nlive);
+	}
+
+	_pending_free(&n);
+}
+END_TEST
+
+START_TEST(test_arena)
+{
+	struct _hdfs_arena *ar;
+	char *small[1000], *big;
+
+	ar = _arena_new(0);
+
+	// Enough to spill over several chunks
+	for (int i = 0; i < (int)nelem(small); i++) {
+		small[i] = _arena_alloc(ar, 1 + i % 37);
+		ck_assert_int_eq((uintptr_t)small[i] % sizeof(void *), 0);
+		memset(small[i], i & 0xff, 1 + i % 37);
+	}
+	big = _arena_alloc(ar, 1024*1024);
+	memset(big, 0xa5, 1024*1024);
+
+	for (int i = 0; i < (int)nelem(small); i++)
+		for (int j = 0; j < 1 + i % 37; j++)
+			ck_assert_int_eq((uint8_t)small[i][j], i & 0xff);
+
+	// protobuf-c allocations come out of the arena too
+	ck_assert(ar->ar_pballoc.alloc(ar->ar_pballoc.allocator_data, 8));
+
+	_arena_free(ar);
+}
+END_TEST
+
+// GetListingResponseProto: "a.txt" (alice:staff, 0644, 128MB) and a symlink
+// "lnk" -> "/target/x" (bob, empty group), 7 remaining.
+static const char listing_msg[] =
+    "\x0a\x66\x0a\x3c\x08\x02\x12\x05\x61\x2e\x74\x78\x74\x18\x80\x80"
+    "\x80\x40\x22\x03\x08\xa4\x03\x2a\x05\x61\x6c\x69\x63\x65\x32\x05"
+    "\x73\x74\x61\x66\x66\x38\x80\xd0\x95\xff\xbc\x31\x40\x81\xd0\x95"
+    "\xff\xbc\x31\x50\x03\x58\x80\x80\x80\x40\x68\x82\x80\x01\x70\x00"
+    "\x0a\x24\x08\x03\x12\x03\x6c\x6e\x6b\x18\x00\x22\x03\x08\xff\x03"
+    "\x2a\x03\x62\x6f\x62\x32\x00\x38\x05\x40\x06\x4a\x09\x2f\x74\x61"
+    "\x72\x67\x65\x74\x2f\x78\x10\x07";
+
+START_TEST(test_pbwire_listing)
+{
+	struct hdfs_directory_listing *dl;
+	struct hdfs_file_status *fs;
+	struct hdfs_object *res;
+	struct _hdfs_arena *ar;
+
+	ar = _arena_new(0);
+	res = _pbwire_directory_listing(ar, listing_msg,
+	    sizeof(listing_msg) - 1);
+	ck_assert(res);
+	ck_assert_int_eq(res->ob_type, H_DIRECTORY_LISTING);
+	ck_assert(res->ob_arena == ar);
+
+	dl = &res->ob_val._directory_listing;
+	ck_assert_int_eq(dl->_num_files, 2);
+	ck_assert_int_eq(dl->_remaining_entries, 7);
+	ck_assert(!dl->_has_locations);
+
+	fs = &dl->_files[0]->ob_val._file_status;
+	ck_assert_str_eq(fs->_file, "a.txt");
+	ck_assert_str_eq(fs->_owner, "alice");
+	ck_assert_str_eq(fs->_group, "staff");
+	ck_assert_int_eq(fs->_size, 128*1024*1024);
+	ck_assert_int_eq(fs->_permissions, 0644);
+	ck_assert_int_eq(fs->_replication, 3);
+	ck_assert_int_eq(fs->_mtime, 1700000000000LL);
+	ck_assert_int_eq(fs->_fileid, 16386);
+	ck_assert_int_eq(fs->_num_children, 0);
+	ck_assert(fs->_symlink_target == NULL);
+
+	fs = &dl->_files[1]->ob_val._file_status;
+	ck_assert_int_eq(fs->_type, HDFS_FT_SYMLINK);
+	ck_assert_str_eq(fs->_file, "lnk");
+	ck_assert_str_eq(fs->_group, "");
+	// Ends its message; terminated in the spare byte of the copy
+	ck_assert_str_eq(fs->_symlink_target, "/target/x");
+	ck_assert_int_eq(fs->_num_children, -1);
+
+	// Strings are borrowed, not copied
+	ck_assert((uintptr_t)(fs->_symlink_target - fs->_file) <
+	    sizeof(listing_msg));
+
+	ar->ar_root = res;
+	hdfs_object_free(res);
+
+	// Truncated anywhere, it's rejected
+	for (size_t len = 1; len < sizeof(listing_msg) - 1; len++) {
+		ar = _arena_new(0);
+		ck_assert(_pbwire_directory_listing(ar, listing_msg, len) ==
+		    NULL);
+		_arena_free(ar);
+	}
+
+	// An absent listing is a null
+	ar = _arena_new(0);
+	res = _pbwire_directory_listing(ar, "", 0);
+	ck_assert(res);
+	ck_assert_int_eq(res->ob_type, H_NULL);
+	ck_assert(res->ob_arena == NULL);
+	hdfs_object_free(res);
+	_arena_free(ar);
+}
+END_TEST
+
+START_TEST(test_rpc2_absent_results)
+{
+	static const struct {
+		enum hdfs_rpc_method method;
+		enum hdfs_object_type type;
+	} cases[] = {
+		{ HDFS_RPC_getListing, H_DIRECTORY_LISTING },
+		{ HDFS_RPC_getBlockLocations, H_LOCATED_BLOCKS },
+		{ HDFS_RPC_getFileInfo, H_FILE_STATUS },
+		{ HDFS_RPC_getFileLinkInfo, H_FILE_STATUS },
+	};
+	hdfs_object_slurper slurp;
+	struct hdfs_heap_buf b;
+	struct hdfs_object *rpc, *res;
+
+	// An empty response (e.g. for a path that doesn't exist) is a null,
+	// whether decoded by protobuf-c or straight from the wire.
+	for (unsigned i = 0; i < nelem(cases); i++) {
+		rpc = hdfs_rpc_invocation_new_method(cases[i].method,
+		    hdfs_string_new("/nonexistent"), NULL);
+		slurp = _rpc2_slurper_for_rpc(rpc);
+		ck_assert(slurp);
+
+		for (int arena = 0; arena < 2; arena++) {
+			b = (struct hdfs_heap_buf) { .buf = "", .size = 0 };
+			res = slurp(&b, arena);
+			ck_assert(res);
+			ck_assert_int_eq(b.used, b.size);
+			ck_assert_int_eq(res->ob_type, H_NULL);
+			ck_assert_int_eq(res->ob_val._null._type,
+			    cases[i].type);
+			hdfs_object_free(res);
+		}
+		hdfs_object_free(rpc);
+	}
+}
+END_TEST
+
+// Frames a successful HDFSv1 response.
+static void
+_v1_response(struct hdfs_heap_buf *b, const char *type, bool objtype,
+	struct hdfs_object *obj)
+{
+
+	_bappend_s32(b, 1);	/* msgno */
+	_bappend_s32(b, 0);	/* status */
+	_bappend_string(b, type);
+	if (objtype)
+		_bappend_string(b, type);
+	hdfs_object_serialize(b, obj);
+	hdfs_object_free(obj);
+}
+
+START_TEST(test_v1_scan)
+{
+	struct hdfs_object *obj, *lb;
+	struct hdfs_heap_buf b[3] = { { 0 } }, bogus = { 0 };
+	struct _hdfs_v1_scan scan;
+	struct _hdfs_result *res;
+	int64_t longs[] = { 1, 2, 3 };
+	int sz;
+
+	obj = hdfs_directory_listing_new();
+	for (int i = 0; i < 3; i++)
+		hdfs_directory_listing_append_file_status(obj,
+		    hdfs_file_status_new_ex("f", i, false, 3, 512, 0, 0, 0644,
+		    "owner", "group"), NULL);
+	_v1_response(&b[0], DIRECTORYLISTING_TYPE, true, obj);
+
+	obj = hdfs_located_blocks_new(false, 1024);
+	for (int i = 0; i < 2; i++) {
+		lb = hdfs_located_block_new(i, 512, 1, 512 * i);
+		for (int j = 0; j < 2; j++)
+			hdfs_located_block_append_datanode_info(lb,
+			    hdfs_datanode_info_new("dn", "50010", "/rack", 50020));
+		hdfs_located_blocks_append_located_block(obj, lb);
+	}
+	_v1_response(&b[1], LOCATEDBLOCKS_TYPE, true, obj);
+
+	_v1_response(&b[2], ARRAYLONG_TYPE, false, hdfs_array_long_new(3, longs));
+
+	// Arriving a byte at a time, responses are found complete exactly
+	// when they are.
+	for (unsigned r = 0; r < nelem(b); r++) {
+		memset(&scan, 0, sizeof(scan));
+		for (int len = 0; len < b[r].used; len++)
+			ck_assert(!_hdfs_result_scan(&scan, b[r].buf, len));
+		ck_assert(_hdfs_result_scan(&scan, b[r].buf, b[r].used));
+
+		res = _hdfs_result_deserialize(b[r].buf, b[r].used, &sz);
+		ck_assert(res && res != _HDFS_INVALID_PROTO);
+		ck_assert_int_eq(sz, b[r].used);
+		_hdfs_result_free(res);
+		free(b[r].buf);
+	}
+
+	// Errors are left for the decoder to report
+	memset(&scan, 0, sizeof(scan));
+	_v1_response(&bogus, "java.lang.Bogus", false, hdfs_long_new(1));
+	ck_assert(_hdfs_result_scan(&scan, bogus.buf, bogus.used));
+	free(bogus.buf);
+}
+END_TEST
+
+START_TEST(test_block_table)
+{
+	struct hdfs_object *lbs, *lb, *view;
+	struct hdfs_block_table *bt;
+	struct hdfs_heap_buf a = { 0 }, b = { 0 };
+	struct hdfs_token *tok;
+	char host[16];
+
+	// 10 blocks over 4 datanodes, all with one token
+	lbs = hdfs_located_blocks_new(true, 10 * 512 + 100);
+	for (int i = 0; i < 11; i++) {
+		lb = hdfs_located_block_new(1000 + i, i < 10 ? 512 : 100, 7,
+		    512 * i);
+		for (int j = 0; j < 3; j++) {
+			snprintf(host, sizeof(host), "dn%d", (i + j) % 4);
+			hdfs_located_block_append_datanode_info(lb,
+			    hdfs_datanode_info_new(host, "50010", "/rack",
+			    50020));
+		}
+		if (i < 10)
+			hdfs_located_blocks_append_located_block(lbs, lb);
+		else
+			lbs->ob_val._located_blocks._last_block = lb;
+	}
+
+	bt = hdfs_block_table_new(lbs);
+	ck_assert(bt != NULL);
+	ck_assert_int_eq(bt->_num_blocks, 10);
+	ck_assert(bt->_has_last_block);
+	ck_assert_int_eq(bt->_num_datanodes, 4);
+	ck_assert_int_eq(bt->_num_tokens, 1);
+	ck_assert(bt->_pool_id == NULL);
+
+	ck_assert_int_eq(hdfs_block_table_find(bt, 0), 0);
+	ck_assert_int_eq(hdfs_block_table_find(bt, 511), 0);
+	ck_assert_int_eq(hdfs_block_table_find(bt, 512 * 9 + 3), 9);
+	ck_assert_int_eq(hdfs_block_table_find(bt, 512 * 10), -1);
+	ck_assert_int_eq(hdfs_block_table_find(bt, -1), -1);
+	ck_assert_int_eq(hdfs_block_table_num_locs(bt, 10), 3);
+	ck_assert_str_eq(hdfs_block_table_loc(bt, 10, 2)->_hostname, "dn0");
+
+	// The view is indistinguishable from the original
+	view = hdfs_block_table_located_blocks(bt);
+	hdfs_object_serialize(&a, lbs);
+	hdfs_object_serialize(&b, view);
+	ck_assert_int_eq(a.used, b.used);
+	ck_assert(memcmp(a.buf, b.buf, a.used) == 0);
+	ck_assert(view->ob_val._located_blocks._last_block != NULL);
+	ck_assert_int_eq(view->ob_val._located_blocks._last_block->
+	    ob_val._located_block._len, 100);
+
+	free(a.buf);
+	free(b.buf);
+	hdfs_object_free(view);
+	hdfs_block_table_free(bt);
+
+	// An empty token field may be NULL rather than ""; it's the same token
+	tok = &lbs->ob_val._located_blocks._blocks[3]->ob_val._located_block.
+	    _token->ob_val._token;
+	free(tok->_strings[0]);
+	free(tok->_strings[1]);
+	tok->_strings[0] = tok->_strings[1] = NULL;
+	bt = hdfs_block_table_new(lbs);
+	ck_assert(bt != NULL);
+	ck_assert_int_eq(bt->_num_tokens, 1);
+	hdfs_block_table_free(bt);
+
+	// Blocks from different pools can't share a table
+	lbs->ob_val._located_blocks._blocks[0]->ob_val._located_block._pool_id =
+	    strdup("BP-1");
+	ck_assert(hdfs_block_table_new(lbs) == NULL);
+	hdfs_object_free(lbs);
+}
+END_TEST
+
+START_TEST(test_listing_table)
+{
+	struct hdfs_listing_table *lt, *lt2;
+	struct hdfs_object *dl, *view;
+	struct hdfs_heap_buf a = { 0 }, b = { 0 }, rbuf;
+	char name[16];
+
+	ck_assert(hdfs_listing_table_from_proto(listing_msg,
+	    sizeof(listing_msg) - 1, &lt) == NULL);
+	ck_assert(lt != NULL);
+	ck_assert_int_eq(lt->_num_files, 2);
+	ck_assert_int_eq(lt->_num_users, 4);
+	ck_assert_int_eq(lt->_remaining_entries, 7);
+	ck_assert_str_eq(hdfs_listing_table_name(lt, 0), "a.txt");
+	ck_assert_str_eq(hdfs_listing_table_owner(lt, 0), "alice");
+	ck_assert_str_eq(hdfs_listing_table_group(lt, 0), "staff");
+	ck_assert(hdfs_listing_table_symlink_target(lt, 0) == NULL);
+	ck_assert_int_eq(lt->_entries[0]._fileid, 16386);
+	ck_assert_str_eq(hdfs_listing_table_name(lt, 1), "lnk");
+	ck_assert_str_eq(hdfs_listing_table_group(lt, 1), "");
+	ck_assert_str_eq(hdfs_listing_table_symlink_target(lt, 1),
+	    "/target/x");
+	ck_assert_int_eq(lt->_entries[1]._type, HDFS_FT_SYMLINK);
+	ck_assert_int_eq(lt->_entries[1]._num_children, -1);
+
+	view = hdfs_listing_table_file_status(lt, 1);
+	ck_assert_str_eq(view->ob_val._file_status._symlink_target,
+	    "/target/x");
+	ck_assert_int_eq(view->ob_val._file_status._permissions, 0777);
+	hdfs_object_free(view);
+	hdfs_listing_table_free(lt);
+
+	for (size_t len = 1; len < sizeof(listing_msg) - 1; len++)
+		ck_assert(hdfs_listing_table_from_proto(listing_msg, len,
+		    &lt) != NULL);
+	ck_assert(hdfs_listing_table_from_proto("", 0, &lt) == NULL);
+	ck_assert(lt == NULL);
+
+	// Owners and groups are shared
+	dl = hdfs_directory_listing_new();
+	for (int i = 0; i < 100; i++) {
+		snprintf(name, sizeof(name), "part-%05d", i);
+		hdfs_directory_listing_append_file_status(dl,
+		    hdfs_file_status_new_ex(name, i, i % 10 == 0, 3, 512,
+		    1000 + i, 2000 + i, 0644, i % 2 ? "hdfs" : "mapred",
+		    "supergroup"), NULL);
+	}
+	dl->ob_val._directory_listing._remaining_entries = 5;
+
+	lt = hdfs_listing_table_new(dl);
+	ck_assert_int_eq(lt->_num_files, 100);
+	ck_assert_int_eq(lt->_num_users, 3);
+	ck_assert_int_eq(lt->_remaining_entries, 5);
+	ck_assert_str_eq(hdfs_listing_table_owner(lt, 3), "hdfs");
+	ck_assert(hdfs_listing_table_group(lt, 3) ==
+	    hdfs_listing_table_group(lt, 4));
+
+	// ... and the views are indistinguishable from the original
+	view = hdfs_listing_table_directory_listing(lt);
+	hdfs_object_serialize(&a, dl);
+	hdfs_object_serialize(&b, view);
+	ck_assert_int_eq(a.used, b.used);
+	ck_assert(memcmp(a.buf, b.buf, a.used) == 0);
+	hdfs_object_free(view);
+	free(b.buf);
+
+	// Decoding the serialized (v1) listing gives the same table
+	rbuf = (struct hdfs_heap_buf) { .buf = a.buf, .size = a.used };
+	lt2 = hdfs_listing_table_slurp(&rbuf);
+	ck_assert(lt2 != NULL);
+	ck_assert_int_eq(rbuf.used, a.used);
+	ck_assert_int_eq(lt2->_bytes, lt->_bytes);
+	for (int i = 0; i < 100; i++) {
+		ck_assert_str_eq(hdfs_listing_table_name(lt2, i),
+		    hdfs_listing_table_name(lt, i));
+		ck_assert_str_eq(hdfs_listing_table_owner(lt2, i),
+		    hdfs_listing_table_owner(lt, i));
+		ck_assert_int_eq(lt2->_entries[i]._mtime, 1000 + i);
+		ck_assert(lt2->_entries[i]._directory == (i % 10 == 0));
+	}
+	hdfs_listing_table_free(lt2);
+
+	rbuf = (struct hdfs_heap_buf) { .buf = a.buf, .size = a.used - 1 };
+	ck_assert(hdfs_listing_table_slurp(&rbuf) == NULL);
+	ck_assert_int_eq(rbuf.used, _H_PARSE_EOF);
+
+	free(a.buf);
+	hdfs_listing_table_free(lt);
+	hdfs_object_free(dl);
+}
+END_TEST
+
+static void *
+_ref_thread(void *v)
+{
+	struct hdfs_object *obj = v;
+
+	for (int i = 0; i < 100000; i++)
+		hdfs_object_free(hdfs_object_ref(obj));
+	return NULL;
+}
+
+START_TEST(test_object_ref)
+{
+	struct hdfs_object *lb, *lb2, *dl, *fs;
+	struct _hdfs_arena *ar;
+	pthread_t threads[4];
+
+	lb = hdfs_located_block_new(1, 512, 1, 0);
+	hdfs_located_block_append_datanode_info(lb,
+	    hdfs_datanode_info_new("dn", "50010", "/rack", 50020));
+
+	// Copies share the contained objects
+	lb2 = hdfs_located_block_copy(lb);
+	ck_assert(lb2 != lb);
+	ck_assert(lb2->ob_val._located_block._locs[0] ==
+	    lb->ob_val._located_block._locs[0]);
+	ck_assert(lb2->ob_val._located_block._token ==
+	    lb->ob_val._located_block._token);
+	ck_assert_int_eq(lb->ob_val._located_block._token->ob_refs, 1);
+	hdfs_object_free(lb);
+	ck_assert_str_eq(lb2->ob_val._located_block._locs[0]->
+	    ob_val._datanode_info._hostname, "dn");
+	ck_assert_int_eq(lb2->ob_val._located_block._token->ob_refs, 0);
+
+	for (unsigned i = 0; i < nelem(threads); i++)
+		ck_assert_int_eq(pthread_create(&threads[i], NULL, _ref_thread,
+		    lb2), 0);
+	for (unsigned i = 0; i < nelem(threads); i++)
+		pthread_join(threads[i], NULL);
+	ck_assert_int_eq(lb2->ob_refs, 0);
+	hdfs_object_free(lb2);
+
+	// A reference into an arena keeps the whole response alive
+	ar = _arena_new(0);
+	dl = _pbwire_directory_listing(ar, listing_msg,
+	    sizeof(listing_msg) - 1);
+	ck_assert(dl);
+	ar->ar_root = dl;
+	fs = dl->ob_val._directory_listing._files[0];
+
+	// Freeing an unreferenced non-root object does nothing, and can't
+	// drop the root's references
+	hdfs_object_free(fs);
+	hdfs_object_ref(dl);
+	hdfs_object_free(fs);
+	ck_assert_int_eq(ar->ar_refs, 1);
+	hdfs_object_free(dl);
+	ck_assert_int_eq(ar->ar_refs, 0);
+
+	hdfs_object_ref(fs);
+	hdfs_object_ref(fs);
+	ck_assert_int_eq(fs->ob_refs, 2);
+	hdfs_object_free(dl);
+	ck_assert_str_eq(fs->ob_val._file_status._owner, "alice");
+	hdfs_object_free(fs);
+	ck_assert_str_eq(fs->ob_val._file_status._group, "staff");
+	ck_assert_int_eq(ar->ar_refs, 0);
+	hdfs_object_free(fs);
+}
+END_TEST
+
+START_TEST(test_rpc_method_names)
+{
+	struct hdfs_object *rpc;
+
+	for (unsigned m = HDFS_RPC_UNKNOWN + 1; m < _HDFS_RPC_END; m++) {
+		rpc = hdfs_rpc_invocation_new(hdfs_rpc_method_to_string(m),
+		    NULL);
+		ck_assert_int_eq(rpc->ob_val._rpc_invocation._method_id, m);
+		hdfs_object_free(rpc);
+	}
+
+	rpc = hdfs_rpc_invocation_new_method(HDFS_RPC_getFileInfo,
+	    hdfs_string_new("/"), NULL);
+	ck_assert_str_eq(rpc->ob_val._rpc_invocation._method, "getFileInfo");
+	ck_assert_int_eq(rpc->ob_val._rpc_invocation._nargs, 1);
+	hdfs_object_free(rpc);
+
+	// Unknown methods are still usable by name
+	rpc = hdfs_rpc_invocation_new("noSuchMethod", NULL);
+	ck_assert_int_eq(rpc->ob_val._rpc_invocation._method_id,
+	    HDFS_RPC_UNKNOWN);
+	ck_assert_str_eq(rpc->ob_val._rpc_invocation._method, "noSuchMethod");
+	hdfs_object_free(rpc);
+}
+END_TEST
+
+START_TEST(test_rpc_init)
+{
+	struct hdfs_object *heap, stack, path, nopath, perms;
+	struct hdfs_heap_buf hb = { 0 }, sb = { 0 };
+	int32_t framelen;
+
+	heap = hdfs_rpc_invocation_new_method(HDFS_RPC_mkdirs,
+	    hdfs_string_new("/tmp"), hdfs_null_new(H_STRING),
+	    hdfs_fsperms_new(0755), NULL);
+
+	// Borrowed arguments serialize the same as owned ones
+	path = (struct hdfs_object) {
+		.ob_type = H_STRING,
+		.ob_val._string._val = __DECONST(char *, "/tmp"),
+	};
+	nopath = (struct hdfs_object) {
+		.ob_type = H_NULL,
+		.ob_val._null._type = H_STRING,
+	};
+	perms = (struct hdfs_object) {
+		.ob_type = H_FSPERMS,
+		.ob_val._fsperms._perms = 0755,
+	};
+	_rpc_invocation_init(&stack, HDFS_RPC_mkdirs, &path, &nopath, &perms,
+	    NULL);
+	ck_assert_str_eq(stack.ob_val._rpc_invocation._method, "mkdirs");
+	ck_assert_int_eq(stack.ob_val._rpc_invocation._nargs, 3);
+
+	_rpc_invocation_set_msgno(heap, 7);
+	_rpc_invocation_set_proto(heap, HDFS_NN_v1);
+	_rpc_invocation_set_msgno(&stack, 7);
+	_rpc_invocation_set_proto(&stack, HDFS_NN_v1);
+
+	hdfs_object_serialize(&hb, heap);
+	hdfs_object_serialize(&sb, &stack);
+	_ck_assert_mem_eq(hb.buf, hb.used, sb.buf, sb.used);
+
+	// The frame's length prefix covers everything after it
+	framelen = _be32dec(sb.buf);
+	ck_assert_int_eq(framelen, sb.used - 4);
+
+	hdfs_object_free(heap);
+	free(hb.buf);
+	free(sb.buf);
+}
+END_TEST
+
+START_TEST(test_rpc2_2_header)
+{
+	static const int32_t callids[] = { 0, 1, 63, 64, -1, INT32_MIN };
+	uint8_t cid[_HDFS_CLIENT_ID_LEN], want[128];
+	Hadoop__Common__RpcRequestHeaderProto header =
+	    HADOOP__COMMON__RPC_REQUEST_HEADER_PROTO__INIT;
+	struct hdfs_object *rpc;
+	struct hdfs_heap_buf hb;
+	size_t want_sz;
+
+	for (unsigned i = 0; i < sizeof(cid); i++)
+		cid[i] = (uint8_t)(0xa0 + i);
+
+	// The header template must pack the same as protobuf-c does
+	header.has_rpckind = true;
+	header.rpckind = HADOOP__COMMON__RPC_KIND_PROTO__RPC_PROTOCOL_BUFFER;
+	header.has_rpcop = true;
+	header.rpcop =
+	    HADOOP__COMMON__RPC_REQUEST_HEADER_PROTO__OPERATION_PROTO__RPC_FINAL_PACKET;
+	header.clientid.len = sizeof(cid);
+	header.clientid.data = cid;
+	header.has_retrycount = true;
+	header.retrycount = 0;
+
+	for (unsigned i = 0; i < nelem(callids); i++) {
+		header.callid = callids[i];
+		want_sz =
+		    hadoop__common__rpc_request_header_proto__get_packed_size(
+		    &header);
+		ck_assert(want_sz < sizeof(want));
+		hadoop__common__rpc_request_header_proto__pack(&header, want);
+
+		rpc = hdfs_rpc_invocation_new_method(HDFS_RPC_getFileInfo,
+		    hdfs_string_new("/"), NULL);
+		_rpc_invocation_set_msgno(rpc, callids[i]);
+		_rpc_invocation_set_proto(rpc, HDFS_NN_v2_2);
+		_rpc_invocation_set_clientid(rpc, cid);
+
+		memset(&hb, 0, sizeof(hb));
+		hdfs_object_serialize(&hb, rpc);
+
+		// total size:i32, then the header's size as a 1-byte varint
+		ck_assert_int_eq(_be32dec(hb.buf), hb.used - 4);
+		ck_assert_int_eq((uint8_t)hb.buf[4], want_sz);
+		_ck_assert_mem_eq(&hb.buf[5], want_sz, want, want_sz);
+
+		hdfs_object_free(rpc);
+		free(hb.buf);
+	}
+}
+END_TEST
+
+START_TEST(test_crc32c)
+{
+	static const char check[] = "123456789";
+	uint8_t buf[1100 + 8], crcs[4 * 3];
+	unsigned seed = 42;
+
+	ck_assert_int_eq(_hdfs_crc32c(0, check, strlen(check)), 0xe3069283);
+	ck_assert_int_eq(_hdfs_crc32c_sw(0, check, strlen(check)),
+	    0xe3069283);
+	ck_assert_int_eq(_hdfs_crc32c(0, NULL, 0), 0);
+	// Continuing from a previous result
+	ck_assert_int_eq(_hdfs_crc32c(_hdfs_crc32c(0, check, 4), check + 4,
+	    strlen(check) - 4), 0xe3069283);
+
+	for (unsigned i = 0; i < sizeof(buf); i++)
+		buf[i] = rand_r(&seed);
+
+	// Whatever the CPU uses agrees with the tables, at any alignment
+	for (unsigned off = 0; off < 8; off++)
+		for (unsigned len = 0; len <= 1100; len += (len < 64? 1 : 37))
+			ck_assert_int_eq(_hdfs_crc32c(0, buf + off, len),
+			    _hdfs_crc32c_sw(0, buf + off, len));
+
+	// Chunked, big-endian; a short last chunk; and corruption is caught
+	_hdfs_checksum_chunks(HDFS_CSUM_CRC32C, 512, buf, 1100, crcs);
+	ck_assert_int_eq(_be32dec(crcs + 4), _hdfs_crc32c(0, buf + 512, 512));
+	ck_assert_int_eq(_be32dec(crcs + 8), _hdfs_crc32c(0, buf + 1024, 76));
+	ck_assert(_hdfs_checksum_verify(HDFS_CSUM_CRC32C, 512, buf, 1100,
+	    crcs) == NULL);
+	ck_assert(_hdfs_checksum_verify(HDFS_CSUM_CRC32, 512, buf, 1100,
+	    crcs) != NULL);
+
+	_hdfs_checksum_chunks(HDFS_CSUM_CRC32, 512, buf, 1100, crcs);
+	ck_assert(_hdfs_checksum_verify(HDFS_CSUM_CRC32, 512, buf, 1100,
+	    crcs) == NULL);
+	buf[1099] ^= 1;
+	ck_assert(_hdfs_checksum_verify(HDFS_CSUM_CRC32, 512, buf, 1100,
+	    crcs) != NULL);
+}
+END_TEST
+
+static uint32_t
+_ref_crc(enum hdfs_checksum_type type, const uint8_t *p, size_t len)
+{
+
+	if (type == HDFS_CSUM_CRC32)
+		return crc32(0, p, len);
+	return _hdfs_crc32c_sw(0, p, len);
+}
+
+START_TEST(test_crc_kernels)
+{
+	static const int32_t chunksizes[] = { 1, 8, 16, 100, 512, 520, 4096 };
+	static uint8_t buf[3 * 4096 + 77 + 8], crcs[4 * (sizeof(buf) / 1 + 1)];
+	const struct _hdfs_crc_kernel *ks;
+	unsigned seed = 7;
+	size_t nks, dlen;
+	int32_t cs;
+
+	for (unsigned i = 0; i < sizeof(buf); i++)
+		buf[i] = rand_r(&seed);
+
+	ks = _hdfs_crc_kernels(&nks);
+	for (size_t k = 0; k < nks; k++) {
+		if (!_hdfs_crc_kernel_usable(&ks[k]))
+			continue;
+
+		for (unsigned off = 0; off < 8; off++)
+			for (size_t len = 0; len <= 1100;
+			    len += (len < 160? 1 : 37))
+				ck_assert_int_eq(ks[k].ck_crc(0, buf + off, len),
+				    _ref_crc(ks[k].ck_type, buf + off, len));
+
+		for (unsigned c = 0; c < nelem(chunksizes); c++) {
+			cs = chunksizes[c];
+			dlen = sizeof(buf) - 8 - (c % 3);
+			if (cs == 1)
+				dlen = 1000;
+
+			_hdfs_crc_kernel_chunks(&ks[k], cs, buf + 1, dlen,
+			    crcs);
+			for (size_t i = 0; i * cs < dlen; i++)
+				ck_assert_int_eq(_be32dec(crcs + 4 * i),
+				    _ref_crc(ks[k].ck_type, buf + 1 + i * cs,
+				    _min(cs, dlen - i * cs)));
+		}
+	}
+}
+END_TEST
+
+static void
+_socketpair(int sv[2])
+{
+
+	ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+}
+
+static bool
+_fd_open(int fd)
+{
+
+	return fcntl(fd, F_GETFD) != -1;
+}
+
+START_TEST(test_dncache)
+{
+	int a[2], b[2], c[2], d[2], e[2];
+
+	hdfs_datanode_cache_configure(2/*capacity*/, 1/*per datanode*/,
+	    60*1000);
+
+	// By host and port
+	_socketpair(a);
+	_dncache_put("dn1", "50010", a[0]);
+	ck_assert_int_eq(_dncache_get("dn1", "50020"), -1);
+	ck_assert_int_eq(_dncache_get("dn2", "50010"), -1);
+	ck_assert_int_eq(_dncache_get("dn1", "50010"), a[0]);
+	ck_assert_int_eq(_dncache_get("dn1", "50010"), -1);
+
+	// Over the per-datanode limit, the older goes
+	_socketpair(b);
+	_dncache_put("dn1", "50010", a[0]);
+	_dncache_put("dn1", "50010", b[0]);
+	ck_assert(!_fd_open(a[0]));
+	ck_assert_int_eq(_dncache_get("dn1", "50010"), b[0]);
+
+	// Over capacity, the least recently parked goes
+	_socketpair(c);
+	_socketpair(d);
+	_dncache_put("dn1", "50010", b[0]);
+	_dncache_put("dn2", "50010", c[0]);
+	_dncache_put("dn3", "50010", d[0]);
+	ck_assert(!_fd_open(b[0]));
+	ck_assert_int_eq(_dncache_get("dn2", "50010"), c[0]);
+	ck_assert_int_eq(_dncache_get("dn3", "50010"), d[0]);
+
+	// Closed by the datanode while idle
+	close(c[1]);
+	_dncache_put("dn2", "50010", c[0]);
+	ck_assert_int_eq(_dncache_get("dn2", "50010"), -1);
+	ck_assert(!_fd_open(c[0]));
+
+	// Idle too long
+	hdfs_datanode_cache_configure(2, 1, 0/*ms*/);
+	_dncache_put("dn3", "50010", d[0]);
+	ck_assert_int_eq(_dncache_get("dn3", "50010"), -1);
+	ck_assert(!_fd_open(d[0]));
+
+	// Disabled
+	hdfs_datanode_cache_configure(0, 1, 60*1000);
+	_socketpair(e);
+	_dncache_put("dn1", "50010", e[0]);
+	ck_assert(!_fd_open(e[0]));
+
+	close(a[1]);
+	close(b[1]);
+	close(d[1]);
+	close(e[1]);
+	hdfs_datanode_cache_configure(HDFS_DATANODE_CACHE_CAPACITY,
+	    HDFS_DATANODE_CACHE_PER_DATANODE, HDFS_DATANODE_CACHE_IDLE_MS);
+}
+END_TEST
+
+// A stand-in HDFSv1 datanode, on the other end of a socketpair: it serves
+// one read of a block whose byte at offset i is _fake_dn_byte(i), and sends
+// its response in pieces cut without regard for the status, packet header,
+// CRC or data boundaries. (The v2 one, below, serves reads until the client
+// hangs up.)
+struct _fake_dn {
+	int fd;
+	enum hdfs_checksum_type csum;
+	int32_t chunk,		/* bytes per checksum */
+		pkt;		/* data bytes per packet */
+	int64_t corrupt;	/* block offset of a byte to damage, or -1 */
+
+	/* v2 */
+	int listen_fd;		/* to accept fd from, if it is -1 */
+	int ops,		/* requests received */
+	    fail_op;		/* answer this one with an error status */
+	bool hangup;		/* close on the first request instead */
+};
+
+static uint8_t
+_fake_dn_byte(int64_t off)
+{
+
+	return (uint8_t)(off * 131 + (off >> 9));
+}
+
+static void
+_fake_dn_send(int fd, const char *p, size_t len)
+{
+	static const size_t cuts[] = { 1, 2, 3, 5, 8, 13, 21, 34, 55, 89,
+	    144, 233, 377, 610, 987, 1597 };
+	ssize_t n;
+
+	for (unsigned i = 0; len > 0; i++) {
+		n = send(fd, p, _min(cuts[i % nelem(cuts)], len),
+		    MSG_NOSIGNAL);
+		if (n <= 0)
+			return;
+		p += n;
+		len -= n;
+		// Let the reader see each piece on its own
+		usleep(20);
+	}
+}
+
+// Appends a packet's CRCs and the block's bytes [p, p+dlen).
+static void
+_fake_dn_payload(struct _fake_dn *dn, struct hdfs_heap_buf *h, int64_t p,
+	int32_t dlen, int32_t ncrcs)
+{
+	uint8_t *data;
+
+	_hbuf_reserve(h, 4 * ncrcs + dlen);
+	data = (uint8_t *)h->buf + h->used + 4 * ncrcs;
+	for (int32_t i = 0; i < dlen; i++)
+		data[i] = _fake_dn_byte(p + i);
+	_hdfs_checksum_chunks(dn->csum, dn->chunk, data, dlen,
+	    h->buf + h->used);
+	if (dn->corrupt >= p && dn->corrupt < p + dlen)
+		data[dn->corrupt - p] ^= 0x40;
+	h->used += 4 * ncrcs + dlen;
+}
+
+static void *
+_fake_dn_v1(void *v)
+{
+	struct _fake_dn *dn = v;
+	struct hdfs_heap_buf rsp = { 0 };
+	int64_t off, len, start, end, seq;
+	int32_t dlen, ncrcs;
+	char req[35];
+
+	// Version, op, block id and generation, then the range
+	for (size_t got = 0; got < sizeof(req);) {
+		ssize_t n = read(dn->fd, req + got, sizeof(req) - got);
+		ck_assert(n > 0);
+		got += n;
+	}
+	off = (int64_t)_be32dec(req + 19) << 32 | _be32dec(req + 23);
+	len = (int64_t)_be32dec(req + 27) << 32 | _be32dec(req + 31);
+	start = off - off % dn->chunk;
+	end = off + len;
+
+	_bappend_s16(&rsp, 0/*success*/);
+	_bappend_s8(&rsp, dn->csum);
+	_bappend_s32(&rsp, dn->chunk);
+	_bappend_s64(&rsp, start);
+
+	seq = 0;
+	for (int64_t p = start; p < end; p += dlen) {
+		dlen = _min(dn->pkt, end - p);
+		ncrcs = (dlen + dn->chunk - 1) / dn->chunk;
+
+		_bappend_s32(&rsp, 4 + 4 * ncrcs + dlen);
+		_bappend_s64(&rsp, p);
+		_bappend_s64(&rsp, seq++);
+		_bappend_s8(&rsp, p + dlen >= end);
+		_bappend_s32(&rsp, dlen);
+
+		_fake_dn_payload(dn, &rsp, p, dlen, ncrcs);
+	}
+
+	// The empty last packet
+	_bappend_s32(&rsp, 4);
+	_bappend_s64(&rsp, end);
+	_bappend_s64(&rsp, seq);
+	_bappend_s8(&rsp, 1);
+	_bappend_s32(&rsp, 0);
+
+	_fake_dn_send(dn->fd, rsp.buf, rsp.used);
+	free(rsp.buf);
+
+	// Wait for the client to hang up
+	while (read(dn->fd, req, sizeof(req)) > 0)
+		;
+	close(dn->fd);
+	return NULL;
+}
+
+// Connects d to a new stand-in; _fake_dn_done() hangs up and waits for it.
+static void
+_fake_dn_start(struct _fake_dn *dn, struct hdfs_datanode *d, pthread_t *thr)
+{
+	int sv[2];
+
+	_socketpair(sv);
+	dn->fd = sv[1];
+	ck_assert_int_eq(pthread_create(thr, NULL, _fake_dn_v1, dn), 0);
+
+	hdfs_datanode_init(d, 1/*blkid*/, 1 << 20, 1/*gen*/, 0, "client",
+	    NULL, HDFS_DATANODE_AP_1_0);
+	d->dn_sock = sv[0];
+}
+
+static void
+_fake_dn_done(struct hdfs_datanode *d, pthread_t thr)
+{
+
+	hdfs_datanode_destroy(d);
+	pthread_join(thr, NULL);
+}
+
+static const char *
+_fake_dn_read(struct _fake_dn *dn, int64_t off, int64_t len, void *buf)
+{
+	struct hdfs_datanode d;
+	const char *error;
+	pthread_t thr;
+
+	_fake_dn_start(dn, &d, &thr);
+	error = hdfs_datanode_read(&d, off, len, buf, true/*verify*/);
+	_fake_dn_done(&d, thr);
+	return error;
+}
+
+START_TEST(test_datanode_read_v1)
+{
+	static const int64_t ranges[][2] = {
+		{ 0, 1 }, { 1, 1000 }, { 99, 5000 }, { 511, 4097 },
+		{ 700, 20001 },
+	};
+	static const int32_t chunks[][2] = {
+		{ 512, 4096 }, { 100, 1000 }, { 7, 63 },
+	};
+	struct _fake_dn dn;
+	const char *error;
+	uint8_t *buf;
+
+	buf = malloc(32 * 1024);
+	ck_assert(buf);
+
+	for (int c = HDFS_CSUM_CRC32; c <= HDFS_CSUM_CRC32C; c++)
+	for (unsigned k = 0; k < nelem(chunks); k++)
+	for (unsigned r = 0; r < nelem(ranges); r++) {
+		int64_t off = ranges[r][0], len = ranges[r][1];
+
+		dn = (struct _fake_dn) {
+			.csum = c,
+			.chunk = chunks[k][0],
+			.pkt = chunks[k][1],
+			.corrupt = -1,
+		};
+		memset(buf, 0, len);
+		error = _fake_dn_read(&dn, off, len, buf);
+		ck_assert_msg(error == NULL, "%s", error);
+		for (int64_t i = 0; i < len; i++)
+			ck_assert_int_eq(buf[i], _fake_dn_byte(off + i));
+
+		// Damage in the first, a middle or the last byte read, or
+		// outside the range but within a chunk it covers
+		const int64_t bad[] = { off, off + len / 2, off + len - 1,
+		    off - off % dn.chunk };
+		for (unsigned b = 0; b < nelem(bad); b++) {
+			dn.corrupt = bad[b];
+			error = _fake_dn_read(&dn, off, len, buf);
+			ck_assert_msg(error != NULL,
+			    "corrupt byte %jd of [%jd, +%jd) not detected",
+			    (intmax_t)bad[b], (intmax_t)off, (intmax_t)len);
+		}
+	}
+
+	free(buf);
+}
+END_TEST
+
+static int
+_tmpfile(void)
+{
+	char path[] = "/tmp/hadoofus_unit.XXXXXX";
+	int fd;
+
+	fd = mkstemp(path);
+	ck_assert(fd != -1);
+	unlink(path);
+	return fd;
+}
+
+static void
+_check_file(int fd, off_t size, off_t fdoff, int64_t bloff, uint8_t *buf)
+{
+	struct stat sb;
+	off_t len = size - fdoff;
+
+	ck_assert_int_eq(fstat(fd, &sb), 0);
+	ck_assert_int_eq(sb.st_size, size);
+	ck_assert_int_eq(pread(fd, buf, len, fdoff), len);
+	for (off_t i = 0; i < len; i++)
+		ck_assert_int_eq(buf[i], _fake_dn_byte(bloff + i));
+}
+
+// Unverified reads to file are spliced, verified ones can go through a
+// mapping; both should leave the same bytes behind.
+START_TEST(test_datanode_read_file)
+{
+	static const off_t fdoffs[] = { 0, 1, 4095, 4096 + 77 };
+	const int64_t off = 777, len = 100000;
+	struct _fake_dn dn = {
+		.csum = HDFS_CSUM_CRC32C,
+		.chunk = 512,
+		.pkt = 4096,
+		.corrupt = -1,
+	};
+	struct hdfs_datanode d;
+	const char *error;
+	struct stat sb;
+	uint8_t *buf, *buf2;
+	pthread_t thr;
+	int fd, fd2;
+
+	buf = malloc(len);
+	buf2 = malloc(len);
+	ck_assert(buf && buf2);
+
+	for (unsigned i = 0; i < nelem(fdoffs); i++) {
+		fd = _tmpfile();
+		_fake_dn_start(&dn, &d, &thr);
+		error = hdfs_datanode_read_file(&d, off, len, fd, fdoffs[i],
+		    false/*verify*/);
+		_fake_dn_done(&d, thr);
+		ck_assert_msg(error == NULL, "%s", error);
+		_check_file(fd, fdoffs[i] + len, fdoffs[i], off, buf);
+
+		fd2 = _tmpfile();
+		_fake_dn_start(&dn, &d, &thr);
+		error = hdfs_datanode_read_file_mmap(&d, off, len, fd2,
+		    fdoffs[i], true/*verify*/);
+		_fake_dn_done(&d, thr);
+		ck_assert_msg(error == NULL, "%s", error);
+		_check_file(fd2, fdoffs[i] + len, fdoffs[i], off, buf2);
+
+		ck_assert(memcmp(buf, buf2, len) == 0);
+		close(fd);
+		close(fd2);
+	}
+
+	// A failed read through a mapping leaves the file's size alone
+	fd = _tmpfile();
+	ck_assert_int_eq(write(fd, "0123456789", 10), 10);
+	dn.corrupt = off + len / 2;
+	_fake_dn_start(&dn, &d, &thr);
+	error = hdfs_datanode_read_file_mmap(&d, off, len, fd, 5,
+	    true/*verify*/);
+	_fake_dn_done(&d, thr);
+	ck_assert(error != NULL);
+	ck_assert_int_eq(fstat(fd, &sb), 0);
+	ck_assert_int_eq(sb.st_size, 10);
+	close(fd);
+
+	free(buf);
+	free(buf2);
+}
+END_TEST
+
+static bool
+_fake_dn_recv(int fd, void *buf, size_t len)
+{
+	ssize_t n;
+
+	for (size_t got = 0; got < len; got += n) {
+		n = read(fd, (char *)buf + got, len - got);
+		if (n <= 0)
+			return false;
+	}
+	return true;
+}
+
+// Receives a vlint-delimited protobuf message; false at EOF.
+static bool
+_fake_dn_recv_msg(int fd, uint8_t **msg, size_t *len)
+{
+	uint8_t c;
+
+	*len = 0;
+	for (unsigned shift = 0;; shift += 7) {
+		if (!_fake_dn_recv(fd, &c, 1))
+			return false;
+		*len |= (size_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			break;
+	}
+	*msg = malloc(*len);
+	ck_assert(*msg);
+	if (!_fake_dn_recv(fd, *msg, *len)) {
+		free(*msg);
+		return false;
+	}
+	return true;
+}
+
+static void *
+_fake_dn_v2(void *v)
+{
+	struct _fake_dn *dn = v;
+	struct hdfs_heap_buf rsp = { 0 };
+	int64_t off, len, start, end, seq;
+	int32_t dlen, ncrcs;
+	OpReadBlockProto *req;
+	uint8_t op[3], *msg;
+	size_t sz;
+
+	if (dn->fd == -1)
+		dn->fd = accept(dn->listen_fd, NULL, NULL);
+	ck_assert(dn->fd != -1);
+
+	// Version and op, then the OpReadBlockProto
+	while (_fake_dn_recv(dn->fd, op, sizeof(op)) &&
+	    _fake_dn_recv_msg(dn->fd, &msg, &sz)) {
+		BlockOpResponseProto status = BLOCK_OP_RESPONSE_PROTO__INIT;
+		ReadOpChecksumInfoProto csinfo =
+		    READ_OP_CHECKSUM_INFO_PROTO__INIT;
+		ChecksumProto cs = CHECKSUM_PROTO__INIT;
+
+		dn->ops++;
+		req = op_read_block_proto__unpack(NULL, sz, msg);
+		free(msg);
+		ck_assert(req);
+		off = req->offset;
+		len = req->len;
+		op_read_block_proto__free_unpacked(req, NULL);
+		if (dn->hangup)
+			break;
+
+		start = off - off % dn->chunk;
+		end = off + len;
+
+		cs.type = _hdfs_csum_to_proto(dn->csum);
+		cs.bytesperchecksum = dn->chunk;
+		csinfo.checksum = &cs;
+		csinfo.chunkoffset = start;
+		status.status = STATUS__SUCCESS;
+		status.readopchecksuminfo = &csinfo;
+		if (dn->ops == dn->fail_op) {
+			status.status = STATUS__ERROR;
+			status.readopchecksuminfo = NULL;
+		}
+
+		rsp.used = 0;
+		sz = block_op_response_proto__get_packed_size(&status);
+		_bappend_vlint(&rsp, sz);
+		_hbuf_reserve(&rsp, sz);
+		block_op_response_proto__pack(&status,
+		    (void *)&rsp.buf[rsp.used]);
+		rsp.used += sz;
+		if (status.status != STATUS__SUCCESS) {
+			_fake_dn_send(dn->fd, rsp.buf, rsp.used);
+			continue;
+		}
+
+		// The data, then an empty last packet
+		seq = 0;
+		for (int64_t p = start; p <= end; p += dlen) {
+			PacketHeaderProto hdr = PACKET_HEADER_PROTO__INIT;
+
+			dlen = _min(dn->pkt, end - p);
+			ncrcs = (dlen + dn->chunk - 1) / dn->chunk;
+
+			hdr.offsetinblock = p;
+			hdr.seqno = seq++;
+			hdr.lastpacketinblock = (dlen == 0);
+			hdr.datalen = dlen;
+			sz = packet_header_proto__get_packed_size(&hdr);
+
+			_bappend_s32(&rsp, 4 + 4 * ncrcs + dlen);
+			_bappend_s16(&rsp, sz);
+			_hbuf_reserve(&rsp, sz);
+			packet_header_proto__pack(&hdr,
+			    (void *)&rsp.buf[rsp.used]);
+			rsp.used += sz;
+
+			_fake_dn_payload(dn, &rsp, p, dlen, ncrcs);
+			if (dlen == 0)
+				break;
+		}
+		_fake_dn_send(dn->fd, rsp.buf, rsp.used);
+
+		// The client's ClientReadStatusProto
+		if (!_fake_dn_recv_msg(dn->fd, &msg, &sz))
+			break;
+		free(msg);
+	}
+
+	free(rsp.buf);
+	close(dn->fd);
+	return NULL;
+}
+
+static const char *
+_fake_dn_read_v2(const char *port, int64_t off, int64_t len, uint8_t *buf,
+	int expect_sock)
+{
+	struct hdfs_datanode d;
+	const char *error;
+
+	hdfs_datanode_init(&d, 1/*blkid*/, 1 << 20, 1/*gen*/, 0, "client",
+	    NULL, HDFS_DATANODE_AP_2_0);
+	hdfs_datanode_set_pool_id(&d, "pool");
+	error = hdfs_datanode_connect(&d, "127.0.0.1", port);
+	ck_assert_msg(error == NULL, "%s", error);
+	ck_assert_int_eq(d.dn_sock, expect_sock);
+
+	memset(buf, 0, len);
+	error = hdfs_datanode_read(&d, off, len, buf, true/*verify*/);
+	if (error == NULL)
+		for (int64_t i = 0; i < len; i++)
+			ck_assert_int_eq(buf[i], _fake_dn_byte(off + i));
+	hdfs_datanode_destroy(&d);
+	return error;
+}
+
+static bool
+_pending_connection(int listen_fd)
+{
+	struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+
+	return poll(&pfd, 1, 0) == 1;
+}
+
+// v2 connections go back to the cache after a read, for the next one. If a
+// cached connection turns out to be closed, the read is retried on a new one;
+// an error the datanode sends is not.
+START_TEST(test_datanode_read_v2)
+{
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t sinlen = sizeof(sin);
+	struct _fake_dn dn, dn2, dn3;
+	pthread_t thr, thr2, thr3;
+	const char *error;
+	int lfd, sv[2];
+	char port[8];
+	uint8_t *buf;
+
+	buf = malloc(32 * 1024);
+	ck_assert(buf);
+
+	// Retries connect here
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	ck_assert(lfd != -1);
+	ck_assert_int_eq(bind(lfd, (struct sockaddr *)&sin, sizeof(sin)), 0);
+	ck_assert_int_eq(listen(lfd, 4), 0);
+	ck_assert_int_eq(getsockname(lfd, (struct sockaddr *)&sin, &sinlen),
+	    0);
+	snprintf(port, sizeof(port), "%u", (unsigned)ntohs(sin.sin_port));
+
+	hdfs_datanode_cache_configure(HDFS_DATANODE_CACHE_CAPACITY,
+	    HDFS_DATANODE_CACHE_PER_DATANODE, HDFS_DATANODE_CACHE_IDLE_MS);
+
+	// Two reads over one connection, parked in the cache in between
+	_socketpair(sv);
+	dn = (struct _fake_dn) {
+		.fd = sv[1],
+		.csum = HDFS_CSUM_CRC32C,
+		.chunk = 512,
+		.pkt = 4096,
+		.corrupt = -1,
+		.fail_op = 3,
+	};
+	ck_assert_int_eq(pthread_create(&thr, NULL, _fake_dn_v2, &dn), 0);
+	_dncache_put("127.0.0.1", port, sv[0]);
+
+	error = _fake_dn_read_v2(port, 0, 10000, buf, sv[0]);
+	ck_assert_msg(error == NULL, "%s", error);
+	error = _fake_dn_read_v2(port, 777, 20001, buf, sv[0]);
+	ck_assert_msg(error == NULL, "%s", error);
+	ck_assert_int_eq(dn.ops, 2);
+
+	// The datanode's error status stands; it isn't retried on a new
+	// connection (which would be served)
+	dn3 = dn;
+	dn3.fd = -1;
+	dn3.listen_fd = lfd;
+	dn3.ops = 0;
+	ck_assert_int_eq(pthread_create(&thr3, NULL, _fake_dn_v2, &dn3), 0);
+	error = _fake_dn_read_v2(port, 5, 100, buf, sv[0]);
+	ck_assert(error != NULL);
+	ck_assert_int_eq(dn.ops, 3);
+	ck_assert(!_pending_connection(lfd));
+	pthread_join(thr, NULL);
+
+	// A cached connection the datanode closed is retried on a new one
+	_socketpair(sv);
+	dn2 = dn;
+	dn2.fd = sv[1];
+	dn2.ops = 0;
+	dn2.hangup = true;
+	ck_assert_int_eq(pthread_create(&thr2, NULL, _fake_dn_v2, &dn2), 0);
+	_dncache_put("127.0.0.1", port, sv[0]);
+
+	error = _fake_dn_read_v2(port, 100, 5000, buf, sv[0]);
+	ck_assert_msg(error == NULL, "%s", error);
+	ck_assert_int_eq(dn2.ops, 1);
+	ck_assert_int_eq(dn3.ops, 1);
+	pthread_join(thr2, NULL);
+
+	// (Re)configuring empties the cache, closing the new connection
+	hdfs_datanode_cache_configure(HDFS_DATANODE_CACHE_CAPACITY,
+	    HDFS_DATANODE_CACHE_PER_DATANODE, HDFS_DATANODE_CACHE_IDLE_MS);
+	pthread_join(thr3, NULL);
+
+	close(lfd);
+	free(buf);
+}
+END_TEST
+
 Suite *
 t_unit(void)
 {
@@ -153,5 +1520,67 @@ t_unit(void)
 
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("pending");
+	tcase_add_test(tc, test_pending_sequential);
+	tcase_add_test(tc, test_pending_random);
+
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("arena");
+	tcase_add_test(tc, test_arena);
+
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("pbwire");
+	tcase_add_test(tc, test_pbwire_listing);
+	tcase_add_test(tc, test_rpc2_absent_results);
+
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("v1_scan");
+	tcase_add_test(tc, test_v1_scan);
+
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("block_table");
+	tcase_add_test(tc, test_block_table);
+
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("listing_table");
+	tcase_add_test(tc, test_listing_table);
+
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("object_ref");
+	tcase_add_test(tc, test_object_ref);
+
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("checksum");
+	tcase_add_test(tc, test_crc32c);
+	tcase_add_test(tc, test_crc_kernels);
+
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("dncache");
+	tcase_add_test(tc, test_dncache);
+
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("datanode_read");
+	tcase_add_test(tc, test_datanode_read_v1);
+	tcase_add_test(tc, test_datanode_read_file);
+	tcase_add_test(tc, test_datanode_read_v2);
+
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("rpc_method");
+	tcase_add_test(tc, test_rpc_method_names);
+	tcase_add_test(tc, test_rpc_init);
+	tcase_add_test(tc, test_rpc2_2_header);
+
+	suite_add_tcase(s, tc);
+
 	return s;
 }
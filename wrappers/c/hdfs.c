@@ -1499,7 +1499,7 @@ dn_failed:
 
 			hdfs_array_datanode_info_append_datanode_info(
 			    excl,
-			    hdfs_datanode_info_copy(
+			    hdfs_object_ref(
 				lb->ob_val._located_block._locs[0]
 				)
 			    );